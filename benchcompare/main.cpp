@@ -0,0 +1,194 @@
+/***
+* Copyright 2017 Marc Stevens <marc@marc-stevens.nl>, Dan Shumow <danshu@microsoft.com>
+* Distributed under the MIT Software License.
+* See accompanying file LICENSE.txt or copy at
+* https://opensource.org/licenses/MIT
+***/
+
+#include <cmath>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+
+#include <boost/program_options.hpp>
+#include <boost/math/distributions/students_t.hpp>
+
+#include "../common/bench_results.hpp"
+
+using namespace std;
+
+namespace po = boost::program_options;
+
+// compares the latest results of each benchmark metric (as recorded with --results by libcheck,
+// perftest and ubc_check_test) against a baseline and exits with 1 when any of them regressed:
+// it became more than 'threshold' slower and Welch's t-test considers that significant
+
+// all recorded runs of one benchmark metric in file order
+struct bench_history
+{
+	vector<bench_record> runs;
+};
+
+bool load_results(const string& filename, map<string, bench_history>& histories, vector<string>& order)
+{
+	ifstream ifs(filename.c_str());
+	if (!ifs)
+	{
+		cerr << "Could not open " << filename << endl;
+		return false;
+	}
+	string line;
+	for (size_t lineno = 1; getline(ifs, line); ++lineno)
+	{
+		if (line.find_first_not_of(" \t\r") == string::npos)
+			continue;
+		bench_record rec;
+		if (!bench_record_from_json(line, rec))
+		{
+			cerr << filename << ":" << lineno << ": skipping malformed line" << endl;
+			continue;
+		}
+		if (histories.find(rec.key()) == histories.end())
+			order.push_back(rec.key());
+		histories[rec.key()].runs.push_back(rec);
+	}
+	return true;
+}
+
+void mean_variance(const vector<double>& samples, double& mean, double& variance)
+{
+	mean = variance = 0;
+	for (size_t i = 0; i < samples.size(); ++i)
+		mean += samples[i];
+	mean /= double(samples.size());
+	for (size_t i = 0; i < samples.size(); ++i)
+		variance += (samples[i] - mean) * (samples[i] - mean);
+	if (samples.size() > 1)
+		variance /= double(samples.size() - 1);
+}
+
+// one-sided p-value of Welch's t-test for the current samples being worse than the baseline,
+// returns -1 when there are too few samples or no variance to perform the test
+double welch_p_worse(const bench_record& base, const bench_record& cur)
+{
+	double m1, v1, m2, v2;
+	mean_variance(base.samples, m1, v1);
+	mean_variance(cur.samples, m2, v2);
+	double n1 = double(base.samples.size()), n2 = double(cur.samples.size());
+	if (n1 < 2 || n2 < 2)
+		return -1;
+	double s1 = v1 / n1, s2 = v2 / n2;
+	if (s1 + s2 <= 0)
+		return -1;
+	double t = (m2 - m1) / std::sqrt(s1 + s2);
+	if (cur.higher_is_better)
+		t = -t;
+	double df = (s1 + s2) * (s1 + s2) / (s1 * s1 / (n1 - 1) + s2 * s2 / (n2 - 1));
+	boost::math::students_t dist(df);
+	return boost::math::cdf(boost::math::complement(dist, t));
+}
+
+int main(int argc, char** argv)
+{
+	string baselinefile, currentfile;
+	double threshold, alpha;
+
+	po::options_description desc("Allowed options");
+	desc.add_options()
+		("help,h", "Show options")
+		("baseline,b", po::value<string>(&baselinefile), "Results file with the baseline runs")
+		("current,c", po::value<string>(&currentfile), "Results file with the current run (default: the latest run in the baseline file against the one before it)")
+		("threshold,t", po::value<double>(&threshold)->default_value(0.05), "Fail when a metric becomes worse by more than this fraction")
+		("alpha,a", po::value<double>(&alpha)->default_value(0.05), "Significance level of the one-sided Welch t-test")
+		("quiet,q", "Only print regressions")
+		;
+	po::positional_options_description pos;
+	pos.add("baseline", 1).add("current", 1);
+	po::variables_map vm;
+	po::store(po::command_line_parser(argc, argv).options(desc).positional(pos).run(), vm);
+	po::notify(vm);
+
+	if (vm.count("help") || !vm.count("baseline"))
+	{
+		cout << "Usage: " << argv[0] << " [options] <baseline.jsonl> [<current.jsonl>]" << endl << desc << endl;
+		return vm.count("help") ? 0 : 2;
+	}
+
+	map<string, bench_history> base, cur;
+	vector<string> order, curorder;
+	if (!load_results(baselinefile, base, order))
+		return 2;
+	bool samefile = !vm.count("current");
+	if (!samefile && !load_results(currentfile, cur, curorder))
+		return 2;
+
+	cout << setprecision(4);
+	cout << "benchmark\tunit\tbaseline\tcurrent\tchange\tp\tverdict" << endl;
+	unsigned regressions = 0, compared = 0;
+	const vector<string>& keys = samefile ? order : curorder;
+	for (size_t k = 0; k < keys.size(); ++k)
+	{
+		const bench_record* b = 0;
+		const bench_record* c = 0;
+		if (samefile)
+		{
+			const vector<bench_record>& runs = base[keys[k]].runs;
+			if (runs.size() < 2)
+				continue;
+			c = &runs[runs.size() - 1];
+			b = &runs[runs.size() - 2];
+		}
+		else
+		{
+			c = &cur[keys[k]].runs.back();
+			map<string, bench_history>::const_iterator it = base.find(keys[k]);
+			if (it == base.end())
+			{
+				if (!vm.count("quiet"))
+					cout << keys[k] << "\t" << c->unit << "\t-\t-\t-\t-\tnew" << endl;
+				continue;
+			}
+			b = &it->second.runs.back();
+		}
+		if (b->samples.empty() || c->samples.empty())
+			continue;
+		if (b->host != c->host || b->cpu != c->cpu)
+			cerr << "Warning: " << keys[k] << " compares " << b->host << " (" << b->cpu << ") against " << c->host << " (" << c->cpu << ")" << endl;
+
+		double bmean, cmean, var;
+		mean_variance(b->samples, bmean, var);
+		mean_variance(c->samples, cmean, var);
+		double change = (bmean != 0) ? (cmean - bmean) / bmean : 0;
+		double loss = c->higher_is_better ? -change : change;
+		double p = welch_p_worse(*b, *c);
+		// with single samples only the threshold decides
+		bool significant = (p < 0) || (p < alpha);
+		string verdict = "ok";
+		if (loss > threshold && significant)
+		{
+			verdict = "REGRESSION";
+			++regressions;
+		}
+		else if (loss > threshold)
+			verdict = "noise";
+		else if (-loss > threshold && significant)
+			verdict = "improved";
+		++compared;
+
+		if (verdict == "REGRESSION" || !vm.count("quiet"))
+		{
+			cout << keys[k] << "\t" << c->unit << "\t" << bmean << "\t" << cmean << "\t" << showpos << 100 * change << noshowpos << "%\t";
+			if (p < 0)
+				cout << "n/a";
+			else
+				cout << p;
+			cout << "\t" << verdict << endl;
+		}
+	}
+
+	cout << "Compared " << compared << " metrics, " << regressions << " regressed by more than " << 100 * threshold << "%." << endl;
+	return regressions ? 1 : 0;
+}
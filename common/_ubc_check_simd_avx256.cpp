@@ -0,0 +1,26 @@
+/***
+* Copyright 2017 Marc Stevens <marc@marc-stevens.nl>, Dan Shumow <danshu@microsoft.com>
+* Distributed under the MIT Software License.
+* See accompanying file LICENSE.txt or copy at
+* https://opensource.org/licenses/MIT
+***/
+
+// compiled for avx2 whatever the target flags, see the SIMD wrappers in ubc_check_dispatch.hpp
+
+#include <stdint.h>
+
+#ifdef HAVE_AVX
+#include <immintrin.h>
+#pragma GCC push_options
+#pragma GCC target("avx2")
+extern "C" {
+#include "../../lib/ubc_check_simd_avx256.c"
+}
+
+// W and dvmask are aligned SoA arrays with as many lanes as the vector has words
+void ubc_check_lanes_avx256(const uint32_t* W, uint32_t* dvmask)
+{
+	ubc_check_avx256(reinterpret_cast<const __m256i*>(W), reinterpret_cast<__m256i*>(dvmask));
+}
+#pragma GCC pop_options
+#endif
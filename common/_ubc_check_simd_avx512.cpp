@@ -0,0 +1,28 @@
+/***
+* Copyright 2017 Marc Stevens <marc@marc-stevens.nl>, Dan Shumow <danshu@microsoft.com>
+* Distributed under the MIT Software License.
+* See accompanying file LICENSE.txt or copy at
+* https://opensource.org/licenses/MIT
+***/
+
+// compiled for avx512f whatever the target flags, see the SIMD wrappers in ubc_check_dispatch.hpp
+
+#include <stdint.h>
+
+#ifdef HAVE_AVX512
+#include <immintrin.h>
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+// the library has no AVX-512 variant, instantiate its generated SIMD ubc_check for 16 lanes
+extern "C" {
+#include "../common/simd_avx512.h"
+#include "../../lib/ubc_check_simd.cinc"
+}
+
+// W and dvmask are aligned SoA arrays with 16 lanes
+void ubc_check_lanes_avx512(const uint32_t* W, uint32_t* dvmask)
+{
+	ubc_check_avx512(reinterpret_cast<const __m512i*>(W), reinterpret_cast<__m512i*>(dvmask));
+}
+#pragma GCC pop_options
+#endif
@@ -0,0 +1,28 @@
+/***
+* Copyright 2017 Marc Stevens <marc@marc-stevens.nl>, Dan Shumow <danshu@microsoft.com>
+* Distributed under the MIT Software License.
+* See accompanying file LICENSE.txt or copy at
+* https://opensource.org/licenses/MIT
+***/
+
+// compiled for mmx whatever the target flags, see the SIMD wrappers in ubc_check_dispatch.hpp
+
+#include <stdint.h>
+
+#ifdef HAVE_MMX
+#include <immintrin.h>
+#pragma GCC push_options
+#pragma GCC target("mmx")
+extern "C" {
+#include "../../lib/ubc_check_simd_mmx64.c"
+}
+
+// W and dvmask are aligned SoA arrays with as many lanes as the vector has words
+void ubc_check_lanes_mmx64(const uint32_t* W, uint32_t* dvmask)
+{
+	ubc_check_mmx64(reinterpret_cast<const __m64*>(W), reinterpret_cast<__m64*>(dvmask));
+	// leave the x87 registers usable for the caller
+	_mm_empty();
+}
+#pragma GCC pop_options
+#endif
@@ -0,0 +1,23 @@
+/***
+* Copyright 2017 Marc Stevens <marc@marc-stevens.nl>, Dan Shumow <danshu@microsoft.com>
+* Distributed under the MIT Software License.
+* See accompanying file LICENSE.txt or copy at
+* https://opensource.org/licenses/MIT
+***/
+
+// NEON is part of the target flags on arm, see the SIMD wrappers in ubc_check_dispatch.hpp
+
+#include <stdint.h>
+
+#ifdef HAVE_NEON
+#include <arm_neon.h>
+extern "C" {
+#include "../../lib/ubc_check_simd_neon128.c"
+}
+
+// W and dvmask are aligned SoA arrays with as many lanes as the vector has words
+void ubc_check_lanes_neon128(const uint32_t* W, uint32_t* dvmask)
+{
+	ubc_check_neon128(reinterpret_cast<const int32x4_t*>(W), reinterpret_cast<int32x4_t*>(dvmask));
+}
+#endif
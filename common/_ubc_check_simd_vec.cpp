@@ -0,0 +1,52 @@
+/***
+* Copyright 2017 Marc Stevens <marc@marc-stevens.nl>, Dan Shumow <danshu@microsoft.com>
+* Distributed under the MIT Software License.
+* See accompanying file LICENSE.txt or copy at
+* https://opensource.org/licenses/MIT
+***/
+
+
+#include <stdint.h>
+
+#ifdef UBC_CHECK_VEC
+// the library's generated SIMD ubc_check on vector extensions for 4, 8, 16 and 32 lanes, each in
+// its own namespace; compiled for the target flags like the scalar ubc_check, see the vec variants
+// in ubc_check_dispatch.hpp
+#define UBC_CHECK_VEC_INSTANCE(lanes) \
+	void ubc_check_lanes_vec##lanes(const uint32_t* W, uint32_t* dvmask) \
+	{ \
+		simd_vec##lanes::ubc_check_vec##lanes(reinterpret_cast<const simd_vec##lanes::SIMD_WORD*>(W), reinterpret_cast<simd_vec##lanes::SIMD_WORD*>(dvmask)); \
+	}
+
+#define SIMD_VEC_LANES 4
+namespace simd_vec4 {
+#include "../common/simd_vec.h"
+#include "../../lib/ubc_check_simd.cinc"
+}
+UBC_CHECK_VEC_INSTANCE(4)
+#undef SIMD_VEC_LANES
+
+#define SIMD_VEC_LANES 8
+namespace simd_vec8 {
+#include "../common/simd_vec.h"
+#include "../../lib/ubc_check_simd.cinc"
+}
+UBC_CHECK_VEC_INSTANCE(8)
+#undef SIMD_VEC_LANES
+
+#define SIMD_VEC_LANES 16
+namespace simd_vec16 {
+#include "../common/simd_vec.h"
+#include "../../lib/ubc_check_simd.cinc"
+}
+UBC_CHECK_VEC_INSTANCE(16)
+#undef SIMD_VEC_LANES
+
+#define SIMD_VEC_LANES 32
+namespace simd_vec32 {
+#include "../common/simd_vec.h"
+#include "../../lib/ubc_check_simd.cinc"
+}
+UBC_CHECK_VEC_INSTANCE(32)
+#undef SIMD_VEC_LANES
+#endif
@@ -0,0 +1,160 @@
+/***
+* Copyright 2017 Marc Stevens <marc@marc-stevens.nl>, Dan Shumow <danshu@microsoft.com>
+* Distributed under the MIT Software License.
+* See accompanying file LICENSE.txt or copy at
+* https://opensource.org/licenses/MIT
+***/
+
+#ifndef ALIGNED_ARENA_HPP
+#define ALIGNED_ARENA_HPP
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+#include <fstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+// a single contiguous, cache-line aligned allocation of 'count' elements of a POD type T
+// with 'hugepages' the arena is aligned and padded to 2 MiB and transparent huge pages are requested,
+// so that benchmark inputs are free of allocator and (mostly) of TLB noise
+template<typename T>
+class aligned_arena
+{
+public:
+	static const size_t cacheline_size = 64;
+	static const size_t hugepage_size = size_t(1) << 21;
+
+	explicit aligned_arena(size_t count = 0, bool hugepages = false)
+		: ptr(0), cnt(0), huge(false)
+	{
+		allocate(count, hugepages);
+	}
+
+	~aligned_arena()
+	{
+		release();
+	}
+
+	void allocate(size_t count, bool hugepages = false)
+	{
+		release();
+		if (count == 0)
+			return;
+		size_t alignment = hugepages ? hugepage_size : cacheline_size;
+		size_t bytes = ((count * sizeof(T) + alignment - 1) / alignment) * alignment;
+		void* p = 0;
+#if defined(_MSC_VER)
+		p = _aligned_malloc(bytes, alignment);
+#else
+		if (posix_memalign(&p, alignment, bytes) != 0)
+			p = 0;
+#endif
+		if (p == 0)
+			throw std::bad_alloc();
+#if defined(MADV_HUGEPAGE)
+		if (hugepages)
+			huge = (madvise(p, bytes, MADV_HUGEPAGE) == 0);
+#endif
+		// touch all pages now so that page faults do not end up in the measurements
+		memset(p, 0, bytes);
+		ptr = static_cast<T*>(p);
+		cnt = count;
+	}
+
+	void release()
+	{
+		if (ptr)
+		{
+#if defined(_MSC_VER)
+			_aligned_free(ptr);
+#else
+			free(ptr);
+#endif
+		}
+		ptr = 0;
+		cnt = 0;
+		huge = false;
+	}
+
+	T* data() { return ptr; }
+	const T* data() const { return ptr; }
+	size_t size() const { return cnt; }
+	bool hugepages() const { return huge; }
+	T& operator[](size_t i) { return ptr[i]; }
+	const T& operator[](size_t i) const { return ptr[i]; }
+
+private:
+	T* ptr;
+	size_t cnt;
+	bool huge;
+
+	aligned_arena(const aligned_arena&);
+	aligned_arena& operator=(const aligned_arena&);
+};
+
+struct cache_sizes
+{
+	size_t l1d, l2, llc;
+};
+
+// data cache sizes of the first cpu, falling back to typical values when they cannot be determined
+inline cache_sizes detect_cache_sizes()
+{
+	cache_sizes ret;
+	ret.l1d = size_t(32) << 10;
+	ret.l2 = size_t(1) << 20;
+	ret.llc = size_t(32) << 20;
+#ifdef __linux__
+	// sysfs lists each cache level of cpu0 with its type and size, e.g. "48K"
+	for (unsigned index = 0; index < 8; ++index)
+	{
+		std::string dir = "/sys/devices/system/cpu/cpu0/cache/index" + std::to_string(index) + "/";
+		std::ifstream ifs_level((dir + "level").c_str()), ifs_type((dir + "type").c_str()), ifs_size((dir + "size").c_str());
+		unsigned level = 0;
+		std::string type, size;
+		if (!(ifs_level >> level) || !(ifs_type >> type) || !(ifs_size >> size) || type == "Instruction")
+			continue;
+		size_t bytes = std::strtoul(size.c_str(), 0, 10);
+		if (size.find('K') != std::string::npos)
+			bytes <<= 10;
+		else if (size.find('M') != std::string::npos)
+			bytes <<= 20;
+		if (bytes == 0)
+			continue;
+		if (level == 1)
+			ret.l1d = bytes;
+		else if (level == 2)
+			ret.l2 = bytes;
+		if (level >= 2)
+			ret.llc = bytes;
+	}
+#endif
+	return ret;
+}
+
+struct working_set
+{
+	std::string name;
+	size_t bytes;
+};
+
+// working set sizes that sit comfortably in each cache level (half of it, leaving room for everything else)
+// followed by a streaming working set of 8x the last level cache (at least 256 MiB) that is served from DRAM
+inline std::vector<working_set> cache_working_sets(const cache_sizes& cs)
+{
+	std::vector<working_set> ret(4);
+	ret[0].name = "L1"; ret[0].bytes = cs.l1d / 2;
+	ret[1].name = "L2"; ret[1].bytes = cs.l2 / 2;
+	ret[2].name = "LLC"; ret[2].bytes = cs.llc / 2;
+	ret[3].name = "DRAM"; ret[3].bytes = (8 * cs.llc > (size_t(256) << 20)) ? 8 * cs.llc : (size_t(256) << 20);
+	return ret;
+}
+
+#endif // ALIGNED_ARENA_HPP
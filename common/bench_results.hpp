@@ -0,0 +1,302 @@
+/***
+* Copyright 2017 Marc Stevens <marc@marc-stevens.nl>, Dan Shumow <danshu@microsoft.com>
+* Distributed under the MIT Software License.
+* See accompanying file LICENSE.txt or copy at
+* https://opensource.org/licenses/MIT
+***/
+
+#ifndef BENCH_RESULTS_HPP
+#define BENCH_RESULTS_HPP
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+
+#include <sys/stat.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+#include "cpu_features.hpp"
+
+// benchmark results are appended as JSON lines, one measured metric per line, to a file per host
+// and cpu model so that runs on the same machine can be compared by benchcompare, e.g.:
+// {"run":"20170301T120000Z-1234","tool":"libcheck","host":"build1","cpu":"Intel(R) Xeon(R) ...",
+//  "benchmark":"sweep/1024/ubc","metric":"per_byte","unit":"cycles","higher_is_better":false,"samples":[5.1,5.2]}
+struct bench_record
+{
+	std::string run, tool, host, cpu, benchmark, metric, unit;
+	bool higher_is_better;
+	std::vector<double> samples;
+
+	bench_record() : higher_is_better(true) {}
+
+	// identifies the same measurement across runs
+	std::string key() const { return tool + " " + benchmark + " " + metric; }
+};
+
+inline std::string bench_host_name()
+{
+#if defined(__unix__) || defined(__APPLE__)
+	char name[256];
+	if (gethostname(name, sizeof(name)) == 0)
+	{
+		name[sizeof(name) - 1] = 0;
+		return name;
+	}
+#else
+	if (const char* name = std::getenv("COMPUTERNAME"))
+		return name;
+#endif
+	return "unknown";
+}
+
+inline std::string bench_cpu_model()
+{
+	std::string model;
+#ifdef HAVE_CPU_FEATURES_CPUID
+	unsigned regs[12];
+	if (__get_cpuid_max(0x80000000, 0) >= 0x80000004)
+	{
+		for (unsigned i = 0; i < 3; ++i)
+			__get_cpuid(0x80000002 + i, &regs[4 * i], &regs[4 * i + 1], &regs[4 * i + 2], &regs[4 * i + 3]);
+		model.assign(reinterpret_cast<const char*>(regs), sizeof(regs));
+		model = model.substr(0, model.find('\0'));
+	}
+#endif
+	if (model.empty())
+	{
+		std::ifstream ifs("/proc/cpuinfo");
+		std::string line;
+		while (model.empty() && std::getline(ifs, line))
+			if (line.compare(0, 10, "model name") == 0 || line.compare(0, 8, "Hardware") == 0)
+				model = line.substr(line.find(':') == std::string::npos ? line.size() : line.find(':') + 1);
+	}
+	size_t first = model.find_first_not_of(' '), last = model.find_last_not_of(' ');
+	return (first == std::string::npos) ? std::string("unknown") : model.substr(first, last - first + 1);
+}
+
+// host and cpu model reduced to a file name, e.g. build1_Intel_R_Xeon_R_CPU_E5-2680_v4_2.40GHz.jsonl
+inline std::string bench_results_filename()
+{
+	std::string name = bench_host_name() + "_" + bench_cpu_model(), ret;
+	for (size_t i = 0; i < name.size(); ++i)
+	{
+		char c = name[i];
+		bool keep = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '.';
+		if (keep)
+			ret += c;
+		else if (!ret.empty() && ret[ret.size() - 1] != '_')
+			ret += '_';
+	}
+	while (!ret.empty() && ret[ret.size() - 1] == '_')
+		ret.erase(ret.size() - 1);
+	return ret + ".jsonl";
+}
+
+inline std::string json_escape(const std::string& str)
+{
+	std::string ret;
+	for (size_t i = 0; i < str.size(); ++i)
+	{
+		char c = str[i];
+		if (c == '"' || c == '\\')
+			(ret += '\\') += c;
+		else if ((unsigned char)(c) < 0x20)
+		{
+			char buf[8];
+			std::snprintf(buf, sizeof(buf), "\\u%04x", unsigned(c));
+			ret += buf;
+		}
+		else
+			ret += c;
+	}
+	return ret;
+}
+
+inline std::string bench_record_to_json(const bench_record& rec)
+{
+	std::ostringstream out;
+	out << std::setprecision(10);
+	out << "{\"run\":\"" << json_escape(rec.run) << "\",\"tool\":\"" << json_escape(rec.tool)
+		<< "\",\"host\":\"" << json_escape(rec.host) << "\",\"cpu\":\"" << json_escape(rec.cpu)
+		<< "\",\"benchmark\":\"" << json_escape(rec.benchmark) << "\",\"metric\":\"" << json_escape(rec.metric)
+		<< "\",\"unit\":\"" << json_escape(rec.unit) << "\",\"higher_is_better\":" << (rec.higher_is_better ? "true" : "false")
+		<< ",\"samples\":[";
+	for (size_t i = 0; i < rec.samples.size(); ++i)
+		out << (i ? "," : "") << rec.samples[i];
+	out << "]}";
+	return out.str();
+}
+
+// parses a line written by bench_record_to_json: a flat object of strings, booleans and number arrays
+// unknown keys are skipped, returns false on malformed input
+inline bool bench_record_from_json(const std::string& line, bench_record& rec)
+{
+	size_t pos = 0;
+	struct parser
+	{
+		const std::string& s;
+		size_t& pos;
+		void ws() { while (pos < s.size() && (s[pos] == ' ' || s[pos] == '\t' || s[pos] == '\r' || s[pos] == '\n')) ++pos; }
+		bool expect(char c) { ws(); if (pos < s.size() && s[pos] == c) { ++pos; return true; } return false; }
+		bool quoted(std::string& out)
+		{
+			out.clear();
+			if (!expect('"'))
+				return false;
+			while (pos < s.size() && s[pos] != '"')
+			{
+				char c = s[pos++];
+				if (c == '\\' && pos < s.size())
+				{
+					c = s[pos++];
+					if (c == 'u' && pos + 4 <= s.size())
+					{
+						c = char(std::strtoul(s.substr(pos, 4).c_str(), 0, 16));
+						pos += 4;
+					}
+					else if (c == 'n') c = '\n';
+					else if (c == 't') c = '\t';
+				}
+				out += c;
+			}
+			return expect('"');
+		}
+		bool number(double& out)
+		{
+			ws();
+			const char* begin = s.c_str() + pos;
+			char* end = 0;
+			out = std::strtod(begin, &end);
+			if (end == begin)
+				return false;
+			pos += size_t(end - begin);
+			return true;
+		}
+	} p = { line, pos };
+
+	rec = bench_record();
+	if (!p.expect('{'))
+		return false;
+	if (p.expect('}'))
+		return true;
+	do
+	{
+		std::string key, str;
+		if (!p.quoted(key) || !p.expect(':'))
+			return false;
+		p.ws();
+		if (pos >= line.size())
+			return false;
+		if (line[pos] == '"')
+		{
+			if (!p.quoted(str))
+				return false;
+			if (key == "run") rec.run = str;
+			else if (key == "tool") rec.tool = str;
+			else if (key == "host") rec.host = str;
+			else if (key == "cpu") rec.cpu = str;
+			else if (key == "benchmark") rec.benchmark = str;
+			else if (key == "metric") rec.metric = str;
+			else if (key == "unit") rec.unit = str;
+		}
+		else if (line[pos] == '[')
+		{
+			++pos;
+			std::vector<double> values;
+			if (!p.expect(']'))
+			{
+				do
+				{
+					double v;
+					if (!p.number(v))
+						return false;
+					values.push_back(v);
+				} while (p.expect(','));
+				if (!p.expect(']'))
+					return false;
+			}
+			if (key == "samples")
+				rec.samples = values;
+		}
+		else if (line.compare(pos, 4, "true") == 0 || line.compare(pos, 5, "false") == 0)
+		{
+			bool value = (line[pos] == 't');
+			pos += value ? 4 : 5;
+			if (key == "higher_is_better")
+				rec.higher_is_better = value;
+		}
+		else
+		{
+			double v;
+			if (!p.number(v))
+				return false;
+		}
+	} while (p.expect(','));
+	return p.expect('}');
+}
+
+// the results of one run of a tool; disabled (recording nothing) until open() succeeds
+class bench_results
+{
+public:
+	bench_results()
+	{
+		char stamp[32];
+		std::time_t now = std::time(0);
+		std::strftime(stamp, sizeof(stamp), "%Y%m%dT%H%M%SZ", std::gmtime(&now));
+		run = stamp;
+#if defined(__unix__) || defined(__APPLE__)
+		run += "-" + std::to_string(getpid());
+#endif
+	}
+
+	// appends to 'path', or to <path>/<host>_<cpu>.jsonl if 'path' is a directory
+	bool open(const std::string& path, const std::string& toolname)
+	{
+		struct stat st;
+		file = path;
+		if (stat(path.c_str(), &st) == 0 && (st.st_mode & S_IFDIR))
+			file = path + "/" + bench_results_filename();
+		tool = toolname;
+		host = bench_host_name();
+		cpu = bench_cpu_model();
+		ofs.open(file.c_str(), std::ios::out | std::ios::app);
+		return ofs.is_open();
+	}
+
+	bool enabled() const { return ofs.is_open(); }
+	const std::string& filename() const { return file; }
+
+	void record(const std::string& benchmark, const std::string& metric, const std::string& unit, bool higher_is_better, const std::vector<double>& samples)
+	{
+		if (!enabled())
+			return;
+		bench_record rec;
+		rec.run = run; rec.tool = tool; rec.host = host; rec.cpu = cpu;
+		rec.benchmark = benchmark; rec.metric = metric; rec.unit = unit;
+		rec.higher_is_better = higher_is_better;
+		rec.samples = samples;
+		ofs << bench_record_to_json(rec) << std::endl;
+	}
+
+	void record(const std::string& benchmark, const std::string& metric, const std::string& unit, bool higher_is_better, double sample)
+	{
+		record(benchmark, metric, unit, higher_is_better, std::vector<double>(1, sample));
+	}
+
+private:
+	std::string run, tool, host, cpu, file;
+	std::ofstream ofs;
+
+	bench_results(const bench_results&);
+	bench_results& operator=(const bench_results&);
+};
+
+#endif // BENCH_RESULTS_HPP
@@ -0,0 +1,71 @@
+/***
+* Copyright 2017 Marc Stevens <marc@marc-stevens.nl>, Dan Shumow <danshu@microsoft.com>
+* Distributed under the MIT Software License.
+* See accompanying file LICENSE.txt or copy at
+* https://opensource.org/licenses/MIT
+***/
+
+#ifndef CPU_FEATURES_HPP
+#define CPU_FEATURES_HPP
+
+#include <string>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#define HAVE_CPU_FEATURES_CPUID
+#endif
+
+// instruction set extensions of the running cpu, used to select kernels at runtime
+// AVX, AVX2 and AVX-512 are only reported when the OS also saves the ymm (and zmm) registers
+struct cpu_features
+{
+	bool mmx, sse2, ssse3, sse41, avx, avx2, avx512f, sha;
+
+	std::string describe() const
+	{
+		std::string ret;
+		if (mmx) ret += " mmx";
+		if (sse2) ret += " sse2";
+		if (ssse3) ret += " ssse3";
+		if (sse41) ret += " sse4.1";
+		if (avx) ret += " avx";
+		if (avx2) ret += " avx2";
+		if (avx512f) ret += " avx512f";
+		if (sha) ret += " sha";
+		return ret.empty() ? std::string("none") : ret.substr(1);
+	}
+};
+
+inline cpu_features detect_cpu_features()
+{
+	cpu_features ret;
+	ret.mmx = ret.sse2 = ret.ssse3 = ret.sse41 = ret.avx = ret.avx2 = ret.avx512f = ret.sha = false;
+#ifdef HAVE_CPU_FEATURES_CPUID
+	unsigned eax = 0, ebx = 0, ecx = 0, edx = 0;
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return ret;
+	ret.mmx = (edx >> 23) & 1;
+	ret.sse2 = (edx >> 26) & 1;
+	ret.ssse3 = (ecx >> 9) & 1;
+	ret.sse41 = (ecx >> 19) & 1;
+	bool osxsave = (ecx >> 27) & 1, zmmsaved = false;
+	if (osxsave && ((ecx >> 28) & 1))
+	{
+		unsigned xcr0_lo, xcr0_hi;
+		__asm__ __volatile__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+		ret.avx = (xcr0_lo & 6) == 6;
+		// opmask, upper halves of zmm0-15 and zmm16-31
+		zmmsaved = (xcr0_lo & 0xe6) == 0xe6;
+	}
+	if (__get_cpuid_max(0, 0) >= 7)
+	{
+		__cpuid_count(7, 0, eax, ebx, ecx, edx);
+		ret.avx2 = ret.avx && ((ebx >> 5) & 1);
+		ret.avx512f = zmmsaved && ((ebx >> 16) & 1);
+		ret.sha = (ebx >> 29) & 1;
+	}
+#endif
+	return ret;
+}
+
+#endif // CPU_FEATURES_HPP
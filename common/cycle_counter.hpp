@@ -0,0 +1,70 @@
+/***
+* Copyright 2017 Marc Stevens <marc@marc-stevens.nl>, Dan Shumow <danshu@microsoft.com>
+* Distributed under the MIT Software License.
+* See accompanying file LICENSE.txt or copy at
+* https://opensource.org/licenses/MIT
+***/
+
+#ifndef CYCLE_COUNTER_HPP
+#define CYCLE_COUNTER_HPP
+
+#include <cstdint>
+#include <chrono>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define HAVE_CYCLE_COUNTER_TSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_CYCLE_COUNTER_TSC
+#endif
+
+// returns a monotonically increasing cycle count
+// on x86 this is the time-stamp counter, which ticks at the nominal (not the turbo) frequency
+// on other platforms nanoseconds are returned instead, see cycle_counter_unit()
+inline uint64_t cycle_counter()
+{
+#ifdef HAVE_CYCLE_COUNTER_TSC
+	return __rdtsc();
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// serialized reads for timing short code sequences: cycle_counter_start() is not executed before
+// preceding instructions have completed and later instructions do not start before the
+// cycle_counter_stop() read, so that only the code in between is measured
+inline uint64_t cycle_counter_start()
+{
+#ifdef HAVE_CYCLE_COUNTER_TSC
+	_mm_lfence();
+	uint64_t ret = __rdtsc();
+	_mm_lfence();
+	return ret;
+#else
+	return cycle_counter();
+#endif
+}
+
+inline uint64_t cycle_counter_stop()
+{
+#ifdef HAVE_CYCLE_COUNTER_TSC
+	unsigned int aux;
+	uint64_t ret = __rdtscp(&aux);
+	_mm_lfence();
+	return ret;
+#else
+	return cycle_counter();
+#endif
+}
+
+inline const char* cycle_counter_unit()
+{
+#ifdef HAVE_CYCLE_COUNTER_TSC
+	return "cycles";
+#else
+	return "ns";
+#endif
+}
+
+#endif // CYCLE_COUNTER_HPP
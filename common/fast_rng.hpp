@@ -0,0 +1,173 @@
+/***
+* Copyright 2017 Marc Stevens <marc@marc-stevens.nl>, Dan Shumow <danshu@microsoft.com>
+* Distributed under the MIT Software License.
+* See accompanying file LICENSE.txt or copy at
+* https://opensource.org/licenses/MIT
+***/
+
+#ifndef FAST_RNG_HPP
+#define FAST_RNG_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "cpu_features.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_FAST_RNG_AVX2
+#include <immintrin.h>
+#endif
+
+// a counter-based generator for test and benchmark data: 64-bit output n of a stream is the
+// SplitMix64 finalizer applied to key + (n + 1) * golden gamma, so outputs are independent of each
+// other, any position can be reached in O(1) with seek() and bulk fill() computes 4 outputs per
+// AVX2 instruction sequence, at memory bandwidth rather than the ~1 byte/ns of mt19937
+// the 32-bit words returned by operator() are the low and then the high half of each 64-bit
+// output, fill() writes the same word stream in little endian byte order
+// each (seed, stream) pair starts at a pseudorandom point of the same 2^64 period, so two streams
+// of 2^40 outputs each overlap with probability about 2^-23; this is not a cryptographic generator
+class fast_rng
+{
+public:
+	typedef uint32_t result_type;
+	static const uint64_t golden_gamma = 0x9e3779b97f4a7c15ULL;
+
+	static result_type min() { return 0; }
+	static result_type max() { return 0xffffffffU; }
+
+	explicit fast_rng(uint64_t seed = 0, uint64_t stream = 0)
+	{
+		this->seed(seed, stream);
+	}
+
+	void seed(uint64_t seed, uint64_t stream = 0)
+	{
+		key = mix(mix(seed) + stream * golden_gamma + 1);
+		pos = 0;
+	}
+
+	// position in 32-bit words of the next output
+	void seek(uint64_t word) { pos = word; }
+	uint64_t tell() const { return pos; }
+
+	// the 64-bit output n, independent of the current position
+	uint64_t at(uint64_t n) const { return mix(key + (n + 1) * golden_gamma); }
+
+	result_type operator()()
+	{
+		uint64_t out = at(pos >> 1);
+		result_type ret = result_type((pos & 1) ? (out >> 32) : out);
+		++pos;
+		return ret;
+	}
+
+	// fills 'bytes' bytes with the next words, a final partial word still consumes a whole word
+	void fill(void* dst, size_t bytes)
+	{
+		unsigned char* p = static_cast<unsigned char*>(dst);
+		if ((pos & 1) && bytes)
+			put_word(p, bytes);
+		size_t n = bytes / 8;
+		if (n)
+		{
+			bulk_fill()(p, n, pos >> 1, key);
+			pos += 2 * uint64_t(n);
+			p += 8 * n;
+			bytes -= 8 * n;
+		}
+		while (bytes)
+			put_word(p, bytes);
+	}
+
+	// the bulk fill implementation selected for this cpu
+	static const char* fill_name()
+	{
+		return (bulk_fill() == fill_scalar) ? "scalar" : "avx2";
+	}
+
+	static uint64_t mix(uint64_t z)
+	{
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		return z ^ (z >> 31);
+	}
+
+	// writes outputs index, ..., index + n - 1 of the stream with 'key' to out
+	typedef void (*fill_fn)(unsigned char* out, size_t n, uint64_t index, uint64_t key);
+
+	static void fill_scalar(unsigned char* out, size_t n, uint64_t index, uint64_t key)
+	{
+		uint64_t z = key + (index + 1) * golden_gamma;
+		for (size_t i = 0; i < n; ++i, z += golden_gamma)
+			store_le64(out + 8 * i, mix(z));
+	}
+
+#ifdef HAVE_FAST_RNG_AVX2
+	// 64x64-bit multiplication modulo 2^64 from three 32x32->64-bit multiplications
+	__attribute__((target("avx2"))) static __m256i mul64_avx2(__m256i a, __m256i b)
+	{
+		__m256i lo = _mm256_mul_epu32(a, b);
+		__m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b), _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+		return _mm256_add_epi64(lo, _mm256_slli_epi64(cross, 32));
+	}
+
+	__attribute__((target("avx2"))) static __m256i mix_avx2(__m256i z)
+	{
+		const __m256i m1 = _mm256_set1_epi64x(int64_t(0xbf58476d1ce4e5b9ULL));
+		const __m256i m2 = _mm256_set1_epi64x(int64_t(0x94d049bb133111ebULL));
+		z = mul64_avx2(_mm256_xor_si256(z, _mm256_srli_epi64(z, 30)), m1);
+		z = mul64_avx2(_mm256_xor_si256(z, _mm256_srli_epi64(z, 27)), m2);
+		return _mm256_xor_si256(z, _mm256_srli_epi64(z, 31));
+	}
+
+	// two independent vectors per iteration to hide the multiplication latency
+	__attribute__((target("avx2"))) static void fill_avx2(unsigned char* out, size_t n, uint64_t index, uint64_t key)
+	{
+		uint64_t z0 = key + (index + 1) * golden_gamma;
+		__m256i z = _mm256_set_epi64x(int64_t(z0 + 3 * golden_gamma), int64_t(z0 + 2 * golden_gamma), int64_t(z0 + golden_gamma), int64_t(z0));
+		__m256i z2 = _mm256_add_epi64(z, _mm256_set1_epi64x(int64_t(4 * golden_gamma)));
+		const __m256i step = _mm256_set1_epi64x(int64_t(8 * golden_gamma));
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8)
+		{
+			_mm256_storeu_si256((__m256i*)(out + 8 * i), mix_avx2(z));
+			_mm256_storeu_si256((__m256i*)(out + 8 * i + 32), mix_avx2(z2));
+			z = _mm256_add_epi64(z, step);
+			z2 = _mm256_add_epi64(z2, step);
+		}
+		fill_scalar(out + 8 * i, n - i, index + i, key);
+	}
+#endif
+
+private:
+	uint64_t key, pos;
+
+	static fill_fn bulk_fill()
+	{
+#ifdef HAVE_FAST_RNG_AVX2
+		static const fill_fn fn = detect_cpu_features().avx2 ? fill_avx2 : fill_scalar;
+		return fn;
+#else
+		return fill_scalar;
+#endif
+	}
+
+	static void store_le64(unsigned char* p, uint64_t v)
+	{
+		for (unsigned i = 0; i < 8; ++i)
+			p[i] = (unsigned char)(v >> (8 * i));
+	}
+
+	void put_word(unsigned char*& p, size_t& bytes)
+	{
+		result_type w = (*this)();
+		size_t len = (bytes < 4) ? bytes : 4;
+		for (size_t i = 0; i < len; ++i)
+			p[i] = (unsigned char)(w >> (8 * i));
+		p += len;
+		bytes -= len;
+	}
+};
+
+#endif // FAST_RNG_HPP
@@ -0,0 +1,313 @@
+/***
+* Copyright 2017 Marc Stevens <marc@marc-stevens.nl>, Dan Shumow <danshu@microsoft.com>
+* Distributed under the MIT Software License.
+* See accompanying file LICENSE.txt or copy at
+* https://opensource.org/licenses/MIT
+***/
+
+#ifndef GIT_WORKLOAD_HPP
+#define GIT_WORKLOAD_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <istream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "aligned_arena.hpp"
+#include "fast_rng.hpp"
+
+// a workload of git objects as git hashes them: SHA-1 over "<type> <size>\0" followed by the
+// content, for many mostly small objects. Object types are drawn with the model's shares, the
+// content sizes per type from a log-normal distribution, and the contents look like the real
+// thing: source-like text for blobs (or random bytes for the binary share), mode/name/SHA-1
+// entries for trees and header lines plus a message for commits.
+// the default model follows the shape of large source repositories; git_workload_model::fit
+// replaces it with the distribution of an actual repository, from the output of
+//   git cat-file --batch-all-objects --batch-check='%(objecttype) %(objectsize)'
+
+enum git_object_type { git_blob = 0, git_tree = 1, git_commit = 2 };
+const unsigned git_object_types = 3;
+
+inline const char* git_object_type_name(unsigned type)
+{
+	static const char* names[git_object_types] = { "blob", "tree", "commit" };
+	return type < git_object_types ? names[type] : "unknown";
+}
+
+struct git_workload_model
+{
+	double share[git_object_types]; // fraction of the objects of each type
+	double mu[git_object_types], sigma[git_object_types]; // ln(size) ~ N(mu, sigma^2) per type
+	double compressibility; // fraction of blobs with text instead of random (binary) content
+	size_t max_size; // sizes are capped to bound the memory of a workload
+
+	git_workload_model()
+		: compressibility(0.9), max_size(size_t(16) << 20)
+	{
+		// medians of about 3 KiB per blob, 600 bytes per tree and 450 bytes per commit
+		share[git_blob] = 0.45; mu[git_blob] = std::log(3000.0); sigma[git_blob] = 1.6;
+		share[git_tree] = 0.40; mu[git_tree] = std::log(600.0); sigma[git_tree] = 1.1;
+		share[git_commit] = 0.15; mu[git_commit] = std::log(450.0); sigma[git_commit] = 0.5;
+	}
+
+	// fits shares and size distributions to "<type> <size>" lines; types without objects keep
+	// their distribution with share 0, other object types (tags) are ignored
+	bool fit(std::istream& in, std::string& error)
+	{
+		uint64_t count[git_object_types] = { 0, 0, 0 }, total = 0;
+		double sum[git_object_types] = { 0, 0, 0 }, sumsq[git_object_types] = { 0, 0, 0 };
+		std::string line;
+		while (std::getline(in, line))
+		{
+			std::istringstream ls(line);
+			std::string type;
+			uint64_t size;
+			if (!(ls >> type >> size))
+				continue;
+			for (unsigned t = 0; t < git_object_types; ++t)
+				if (type == git_object_type_name(t))
+				{
+					// the empty blob and tree count as one byte in the log domain
+					double l = std::log(double(std::max<uint64_t>(size, 1)));
+					++count[t];
+					++total;
+					sum[t] += l;
+					sumsq[t] += l * l;
+				}
+		}
+		if (total == 0)
+		{
+			error = "no blob, tree or commit sizes found";
+			return false;
+		}
+		for (unsigned t = 0; t < git_object_types; ++t)
+		{
+			share[t] = double(count[t]) / double(total);
+			if (count[t] == 0)
+				continue;
+			mu[t] = sum[t] / double(count[t]);
+			sigma[t] = std::sqrt(std::max(0.0, sumsq[t] / double(count[t]) - mu[t] * mu[t]));
+		}
+		return true;
+	}
+
+	std::string describe() const
+	{
+		std::ostringstream out;
+		for (unsigned t = 0; t < git_object_types; ++t)
+			out << (t ? ", " : "") << git_object_type_name(t) << " " << int(100 * share[t] + 0.5) << "% median " << size_t(std::exp(mu[t]) + 0.5) << " sigma " << sigma[t];
+		out << ", " << int(100 * compressibility + 0.5) << "% text blobs";
+		return out.str();
+	}
+};
+
+struct git_object
+{
+	unsigned type;
+	size_t offset; // of the header in git_workload::data(), the content follows it
+	size_t header_size; // including the terminating 0
+	size_t size; // of the content
+};
+
+class git_workload
+{
+public:
+	// generates objects until their contents total at least 'bytes' bytes
+	void generate(const git_workload_model& model, size_t bytes, fast_rng& rng)
+	{
+		objs.clear();
+		content = headers = 0;
+		make_vocabulary(rng);
+
+		size_t total = 0;
+		while (content < bytes)
+		{
+			git_object obj;
+			obj.type = draw_type(model, rng);
+			double l = model.mu[obj.type] + model.sigma[obj.type] * normal(rng);
+			obj.size = size_t(std::min(std::exp(l), double(model.max_size)));
+			char header[32];
+			obj.header_size = size_t(std::snprintf(header, sizeof(header), "%s %lu", git_object_type_name(obj.type), (unsigned long)(obj.size))) + 1;
+			obj.offset = total;
+			total += obj.header_size + obj.size;
+			content += obj.size;
+			headers += obj.header_size;
+			objs.push_back(obj);
+		}
+
+		arena.allocate(std::max<size_t>(total, 1));
+		for (size_t i = 0; i < objs.size(); ++i)
+		{
+			const git_object& obj = objs[i];
+			char* p = arena.data() + obj.offset;
+			std::snprintf(p, obj.header_size, "%s %lu", git_object_type_name(obj.type), (unsigned long)(obj.size));
+			p[obj.header_size - 1] = 0;
+			p += obj.header_size;
+			if (obj.type == git_tree)
+				fill_tree(p, obj.size, rng);
+			else if (obj.type == git_commit)
+				fill_commit(p, obj.size, rng);
+			else if (uniform(rng) < model.compressibility)
+				fill_text(p, obj.size, rng);
+			else
+				rng.fill(p, obj.size);
+		}
+	}
+
+	const std::vector<git_object>& objects() const { return objs; }
+	const char* data() const { return arena.data(); }
+	const char* header(const git_object& obj) const { return arena.data() + obj.offset; }
+	const char* contents(const git_object& obj) const { return arena.data() + obj.offset + obj.header_size; }
+	uint64_t content_bytes() const { return content; }
+	uint64_t header_bytes() const { return headers; }
+
+	// the object count and content bytes per type
+	void type_totals(uint64_t count[git_object_types], uint64_t bytes[git_object_types]) const
+	{
+		for (unsigned t = 0; t < git_object_types; ++t)
+			count[t] = bytes[t] = 0;
+		for (size_t i = 0; i < objs.size(); ++i)
+		{
+			++count[objs[i].type];
+			bytes[objs[i].type] += objs[i].size;
+		}
+	}
+
+private:
+	std::vector<git_object> objs;
+	aligned_arena<char> arena;
+	uint64_t content, headers;
+	std::vector<std::string> words;
+	std::vector<double> zipf; // cumulative word probabilities
+
+	static double uniform(fast_rng& rng)
+	{
+		return (double(rng()) + 0.5) / 4294967296.0;
+	}
+
+	// Box-Muller, so that workloads are the same on every platform for the same seed
+	static double normal(fast_rng& rng)
+	{
+		return std::sqrt(-2.0 * std::log(uniform(rng))) * std::cos(6.283185307179586 * uniform(rng));
+	}
+
+	static unsigned draw_type(const git_workload_model& model, fast_rng& rng)
+	{
+		double u = uniform(rng) * (model.share[0] + model.share[1] + model.share[2]);
+		for (unsigned t = 0; t + 1 < git_object_types; ++t)
+		{
+			if (u < model.share[t])
+				return t;
+			u -= model.share[t];
+		}
+		return git_object_types - 1;
+	}
+
+	// identifiers and keywords with Zipf distributed frequencies, like source code and prose
+	void make_vocabulary(fast_rng& rng)
+	{
+		static const char* keywords[] = { "if", "else", "for", "return", "int", "const", "static", "void", "struct", "the", "of", "to", "and", "a", "in", "is", "that", "this", "with" };
+		const size_t nwords = 4096;
+		words.assign(keywords, keywords + sizeof(keywords) / sizeof(keywords[0]));
+		while (words.size() < nwords)
+		{
+			std::string w;
+			size_t len = 2 + rng() % 10;
+			for (size_t i = 0; i < len; ++i)
+				w += (i > 0 && rng() % 8 == 0) ? '_' : char('a' + rng() % 26);
+			words.push_back(w);
+		}
+		zipf.resize(nwords);
+		double sum = 0;
+		for (size_t i = 0; i < nwords; ++i)
+			zipf[i] = (sum += 1.0 / double(i + 1));
+		for (size_t i = 0; i < nwords; ++i)
+			zipf[i] /= sum;
+	}
+
+	const std::string& draw_word(fast_rng& rng) const
+	{
+		size_t i = size_t(std::lower_bound(zipf.begin(), zipf.end(), uniform(rng)) - zipf.begin());
+		return words[std::min(i, words.size() - 1)];
+	}
+
+	// copies as much of 'str' as fits before 'end'
+	static void put(char*& p, char* end, const char* str, size_t len)
+	{
+		len = std::min(len, size_t(end - p));
+		memcpy(p, str, len);
+		p += len;
+	}
+
+	void fill_text(char* p, size_t size, fast_rng& rng) const
+	{
+		static const char* punctuation[] = { " ", " ", " ", " ", ", ", ". ", "(", ") ", " = ", "; ", "->" };
+		char* end = p + size;
+		while (p < end)
+		{
+			size_t indent = rng() % 4, linelen = 20 + rng() % 60;
+			char* line = p;
+			for (size_t i = 0; i < indent; ++i)
+				put(p, end, "\t", 1);
+			while (p < end && size_t(p - line) < linelen)
+			{
+				const std::string& w = draw_word(rng);
+				put(p, end, w.data(), w.size());
+				const char* sep = punctuation[rng() % (sizeof(punctuation) / sizeof(punctuation[0]))];
+				put(p, end, sep, strlen(sep));
+			}
+			put(p, end, "\n", 1);
+		}
+	}
+
+	void fill_tree(char* p, size_t size, fast_rng& rng) const
+	{
+		static const char* modes[] = { "100644 ", "100644 ", "100644 ", "40000 ", "100755 ", "120000 " };
+		static const char* extensions[] = { ".c", ".h", ".txt", ".md", ".py", "" };
+		char* end = p + size;
+		while (p < end)
+		{
+			const char* mode = modes[rng() % (sizeof(modes) / sizeof(modes[0]))];
+			const std::string& name = draw_word(rng);
+			const char* ext = (mode[0] == '4') ? "" : extensions[rng() % (sizeof(extensions) / sizeof(extensions[0]))];
+			unsigned char sha1[20];
+			rng.fill(sha1, sizeof(sha1));
+			put(p, end, mode, strlen(mode));
+			put(p, end, name.data(), name.size());
+			put(p, end, ext, strlen(ext));
+			put(p, end, "", 1);
+			put(p, end, reinterpret_cast<const char*>(sha1), sizeof(sha1));
+		}
+	}
+
+	void fill_commit(char* p, size_t size, fast_rng& rng) const
+	{
+		char* end = p + size;
+		char line[128];
+		static const char* fields[] = { "tree", "parent" };
+		for (unsigned f = 0; f < 2; ++f)
+		{
+			int len = std::snprintf(line, sizeof(line), "%s ", fields[f]);
+			for (unsigned i = 0; i < 5; ++i)
+				len += std::snprintf(line + len, sizeof(line) - size_t(len), "%08x", rng());
+			line[len++] = '\n';
+			put(p, end, line, size_t(len));
+		}
+		unsigned long when = 1100000000UL + rng() % 400000000UL;
+		const std::string& name = draw_word(rng);
+		for (unsigned f = 0; f < 2; ++f)
+		{
+			int len = std::snprintf(line, sizeof(line), "%s %s <%s@example.org> %lu +0100\n", f ? "committer" : "author", name.c_str(), name.c_str(), when);
+			put(p, end, line, size_t(len));
+		}
+		put(p, end, "\n", 1);
+		fill_text(p, size_t(end - p), rng);
+	}
+};
+
+#endif // GIT_WORKLOAD_HPP
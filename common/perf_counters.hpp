@@ -0,0 +1,163 @@
+/***
+* Copyright 2017 Marc Stevens <marc@marc-stevens.nl>, Dan Shumow <danshu@microsoft.com>
+* Distributed under the MIT Software License.
+* See accompanying file LICENSE.txt or copy at
+* https://opensource.org/licenses/MIT
+***/
+
+#ifndef PERF_COUNTERS_HPP
+#define PERF_COUNTERS_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include <string>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+// hardware performance counters of the calling thread using Linux perf_event_open
+// counters that cannot be opened (no permission, virtual machine, other OS) are reported as n/a
+enum perf_counter_id
+{
+	PERF_INSTRUCTIONS = 0,
+	PERF_CYCLES,
+	PERF_BRANCH_MISSES,
+	PERF_L1D_MISSES,
+	PERF_LLC_MISSES,
+	PERF_COUNTER_COUNT
+};
+
+struct perf_counter_values
+{
+	double value[PERF_COUNTER_COUNT];
+	bool valid[PERF_COUNTER_COUNT];
+
+	perf_counter_values()
+	{
+		for (unsigned i = 0; i < PERF_COUNTER_COUNT; ++i)
+		{
+			value[i] = 0;
+			valid[i] = false;
+		}
+	}
+
+	// prints all counters divided by 'units', e.g. the number of calls or bytes of a measured section
+	void print(std::ostream& out, double units, const std::string& unitname) const
+	{
+		static const char* names[PERF_COUNTER_COUNT] = { "instructions", "cycles", "branch-misses", "L1D-misses", "LLC-misses" };
+		out << "per " << unitname << ":";
+		for (unsigned i = 0; i < PERF_COUNTER_COUNT; ++i)
+		{
+			out << " " << names[i] << " ";
+			if (valid[i])
+				out << value[i] / units;
+			else
+				out << "n/a";
+			if (i == PERF_CYCLES)
+			{
+				out << " IPC ";
+				if (valid[PERF_INSTRUCTIONS] && valid[PERF_CYCLES] && value[PERF_CYCLES] > 0)
+					out << value[PERF_INSTRUCTIONS] / value[PERF_CYCLES];
+				else
+					out << "n/a";
+			}
+		}
+	}
+};
+
+class perf_counters
+{
+public:
+	perf_counters()
+	{
+		for (unsigned i = 0; i < PERF_COUNTER_COUNT; ++i)
+			fd[i] = -1;
+#ifdef __linux__
+		open_counter(PERF_INSTRUCTIONS, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+		open_counter(PERF_CYCLES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+		open_counter(PERF_BRANCH_MISSES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+		open_counter(PERF_L1D_MISSES, PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+		open_counter(PERF_LLC_MISSES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+#endif
+	}
+
+	~perf_counters()
+	{
+#ifdef __linux__
+		for (unsigned i = 0; i < PERF_COUNTER_COUNT; ++i)
+			if (fd[i] != -1)
+				close(fd[i]);
+#endif
+	}
+
+	bool available() const
+	{
+		for (unsigned i = 0; i < PERF_COUNTER_COUNT; ++i)
+			if (fd[i] != -1)
+				return true;
+		return false;
+	}
+
+	// resets and enables all counters
+	void start()
+	{
+#ifdef __linux__
+		for (unsigned i = 0; i < PERF_COUNTER_COUNT; ++i)
+			if (fd[i] != -1)
+			{
+				ioctl(fd[i], PERF_EVENT_IOC_RESET, 0);
+				ioctl(fd[i], PERF_EVENT_IOC_ENABLE, 0);
+			}
+#endif
+	}
+
+	// disables all counters and returns their values since start(), scaled up if the kernel multiplexed them
+	perf_counter_values stop()
+	{
+		perf_counter_values ret;
+#ifdef __linux__
+		for (unsigned i = 0; i < PERF_COUNTER_COUNT; ++i)
+			if (fd[i] != -1)
+				ioctl(fd[i], PERF_EVENT_IOC_DISABLE, 0);
+		for (unsigned i = 0; i < PERF_COUNTER_COUNT; ++i)
+		{
+			uint64_t data[3]; // value, time enabled, time running
+			if (fd[i] == -1 || read(fd[i], data, sizeof(data)) != sizeof(data) || data[2] == 0)
+				continue;
+			ret.value[i] = double(data[0]) * double(data[1]) / double(data[2]);
+			ret.valid[i] = true;
+		}
+#endif
+		return ret;
+	}
+
+private:
+	int fd[PERF_COUNTER_COUNT];
+
+	perf_counters(const perf_counters&);
+	perf_counters& operator=(const perf_counters&);
+
+#ifdef __linux__
+	void open_counter(perf_counter_id id, uint32_t type, uint64_t config)
+	{
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = type;
+		attr.config = config;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		fd[id] = int(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+	}
+#endif
+};
+
+#endif // PERF_COUNTERS_HPP
@@ -0,0 +1,228 @@
+/***
+* Copyright 2017 Marc Stevens <marc@marc-stevens.nl>, Dan Shumow <danshu@microsoft.com>
+* Distributed under the MIT Software License.
+* See accompanying file LICENSE.txt or copy at
+* https://opensource.org/licenses/MIT
+***/
+
+#ifndef SHA1_BASELINES_HPP
+#define SHA1_BASELINES_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include "cpu_features.hpp"
+
+// optimized plain SHA-1 compression functions (without collision detection) that serve as
+// baselines for the cost of collision detection; they are compiled with target attributes
+// so that the binary runs everywhere and available_sha1_baselines() selects them at runtime
+// all kernels compress 'lanes' independent blocks given as host order words in SoA layout:
+// word i of lane j of ihv[5*lanes] and m[16*lanes] is at [i * lanes + j]
+// the SIMD kernels also come as sha1_expand_* and sha1_compress_w_* on the expanded message
+// W[80*lanes], on which the multi-buffer collision detection runs ubc_check
+
+typedef void (*sha1_baseline_fn)(uint32_t* ihv, const uint32_t* m);
+
+struct sha1_baseline
+{
+	const char* name;
+	unsigned lanes;
+	sha1_baseline_fn compress;
+};
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_SHA1_BASELINES_X86
+#include <immintrin.h>
+
+// SSE2: 4 lanes
+#define SHA1_LANES 4
+#define SHA1_LANES_FUNC sha1_compress_sse2_x4
+#define SHA1_LANES_EXPAND_FUNC sha1_expand_sse2_x4
+#define SHA1_LANES_W_FUNC sha1_compress_w_sse2_x4
+#define SHA1_LANES_TARGET __attribute__((target("sse2")))
+#define V __m128i
+#define V_LOAD(p) _mm_loadu_si128((const __m128i*)(p))
+#define V_STORE(p, v) _mm_storeu_si128((__m128i*)(p), v)
+#define V_SET1(x) _mm_set1_epi32(int(x))
+#define V_ADD(x, y) _mm_add_epi32(x, y)
+#define V_XOR(x, y) _mm_xor_si128(x, y)
+#define V_AND(x, y) _mm_and_si128(x, y)
+#define V_OR(x, y) _mm_or_si128(x, y)
+#define V_ROTL(x, n) _mm_or_si128(_mm_slli_epi32(x, n), _mm_srli_epi32(x, 32 - (n)))
+#include "sha1_lanes.cinc"
+#undef SHA1_LANES
+#undef SHA1_LANES_FUNC
+#undef SHA1_LANES_EXPAND_FUNC
+#undef SHA1_LANES_W_FUNC
+#undef SHA1_LANES_TARGET
+#undef V
+#undef V_LOAD
+#undef V_STORE
+#undef V_SET1
+#undef V_ADD
+#undef V_XOR
+#undef V_AND
+#undef V_OR
+#undef V_ROTL
+
+// AVX2: 8 lanes
+#define SHA1_LANES 8
+#define SHA1_LANES_FUNC sha1_compress_avx2_x8
+#define SHA1_LANES_EXPAND_FUNC sha1_expand_avx2_x8
+#define SHA1_LANES_W_FUNC sha1_compress_w_avx2_x8
+#define SHA1_LANES_TARGET __attribute__((target("avx2")))
+#define V __m256i
+#define V_LOAD(p) _mm256_loadu_si256((const __m256i*)(p))
+#define V_STORE(p, v) _mm256_storeu_si256((__m256i*)(p), v)
+#define V_SET1(x) _mm256_set1_epi32(int(x))
+#define V_ADD(x, y) _mm256_add_epi32(x, y)
+#define V_XOR(x, y) _mm256_xor_si256(x, y)
+#define V_AND(x, y) _mm256_and_si256(x, y)
+#define V_OR(x, y) _mm256_or_si256(x, y)
+#define V_ROTL(x, n) _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - (n)))
+#include "sha1_lanes.cinc"
+#undef SHA1_LANES
+#undef SHA1_LANES_FUNC
+#undef SHA1_LANES_EXPAND_FUNC
+#undef SHA1_LANES_W_FUNC
+#undef SHA1_LANES_TARGET
+#undef V
+#undef V_LOAD
+#undef V_STORE
+#undef V_SET1
+#undef V_ADD
+#undef V_XOR
+#undef V_AND
+#undef V_OR
+#undef V_ROTL
+
+// AVX-512F: 16 lanes
+#define SHA1_LANES 16
+#define SHA1_LANES_FUNC sha1_compress_avx512_x16
+#define SHA1_LANES_EXPAND_FUNC sha1_expand_avx512_x16
+#define SHA1_LANES_W_FUNC sha1_compress_w_avx512_x16
+#define SHA1_LANES_TARGET __attribute__((target("avx512f")))
+#define V __m512i
+#define V_LOAD(p) _mm512_loadu_si512((const void*)(p))
+#define V_STORE(p, v) _mm512_storeu_si512((void*)(p), v)
+#define V_SET1(x) _mm512_set1_epi32(int(x))
+#define V_ADD(x, y) _mm512_add_epi32(x, y)
+#define V_XOR(x, y) _mm512_xor_si512(x, y)
+#define V_AND(x, y) _mm512_and_si512(x, y)
+#define V_OR(x, y) _mm512_or_si512(x, y)
+#define V_ROTL(x, n) _mm512_rol_epi32(x, n)
+#include "sha1_lanes.cinc"
+#undef SHA1_LANES
+#undef SHA1_LANES_FUNC
+#undef SHA1_LANES_EXPAND_FUNC
+#undef SHA1_LANES_W_FUNC
+#undef SHA1_LANES_TARGET
+#undef V
+#undef V_LOAD
+#undef V_STORE
+#undef V_SET1
+#undef V_ADD
+#undef V_XOR
+#undef V_AND
+#undef V_OR
+#undef V_ROTL
+
+// SHA extensions: 1 lane, four steps per sha1rnds4 instruction
+// E0/E1 alternate as the register holding the next four steps' e + W
+#define SHA1_SHANI_STEPS(Ein, Eout, cur, f) \
+	{ Ein = _mm_sha1nexte_epu32(Ein, cur); Eout = ABCD; ABCD = _mm_sha1rnds4_epu32(ABCD, Ein, f); }
+// and advance the message schedule: w1, w2 and w3 are the message registers after cur
+#define SHA1_SHANI_STEPS_MSG(Ein, Eout, cur, w1, w2, w3, f) \
+	{ SHA1_SHANI_STEPS(Ein, Eout, cur, f); w1 = _mm_sha1msg2_epu32(w1, cur); w3 = _mm_sha1msg1_epu32(w3, cur); w2 = _mm_xor_si128(w2, cur); }
+
+__attribute__((target("sha,sse4.1"))) inline void sha1_compress_shani(uint32_t* ihv, const uint32_t* m)
+{
+	__m128i ABCD, ABCD_SAVE, E0, E0_SAVE, E1, MSG0, MSG1, MSG2, MSG3;
+
+	// the instructions expect a in the highest and W[t] for the first step in the highest lane
+	ABCD = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(ihv)), 0x1B);
+	E0 = _mm_set_epi32(int(ihv[4]), 0, 0, 0);
+	ABCD_SAVE = ABCD;
+	E0_SAVE = E0;
+	MSG0 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(m)), 0x1B);
+	MSG1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(m + 4)), 0x1B);
+	MSG2 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(m + 8)), 0x1B);
+	MSG3 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(m + 12)), 0x1B);
+
+	// steps 0-15 load the message, from step 12 on W[t+16] is computed 4 words at a time
+	E0 = _mm_add_epi32(E0, MSG0);
+	E1 = ABCD;
+	ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 0);
+	SHA1_SHANI_STEPS(E1, E0, MSG1, 0);
+	MSG0 = _mm_sha1msg1_epu32(MSG0, MSG1);
+	SHA1_SHANI_STEPS(E0, E1, MSG2, 0);
+	MSG1 = _mm_sha1msg1_epu32(MSG1, MSG2);
+	MSG0 = _mm_xor_si128(MSG0, MSG2);
+	SHA1_SHANI_STEPS_MSG(E1, E0, MSG3, MSG0, MSG1, MSG2, 0);
+	SHA1_SHANI_STEPS_MSG(E0, E1, MSG0, MSG1, MSG2, MSG3, 0);
+
+	SHA1_SHANI_STEPS_MSG(E1, E0, MSG1, MSG2, MSG3, MSG0, 1);
+	SHA1_SHANI_STEPS_MSG(E0, E1, MSG2, MSG3, MSG0, MSG1, 1);
+	SHA1_SHANI_STEPS_MSG(E1, E0, MSG3, MSG0, MSG1, MSG2, 1);
+	SHA1_SHANI_STEPS_MSG(E0, E1, MSG0, MSG1, MSG2, MSG3, 1);
+	SHA1_SHANI_STEPS_MSG(E1, E0, MSG1, MSG2, MSG3, MSG0, 1);
+
+	SHA1_SHANI_STEPS_MSG(E0, E1, MSG2, MSG3, MSG0, MSG1, 2);
+	SHA1_SHANI_STEPS_MSG(E1, E0, MSG3, MSG0, MSG1, MSG2, 2);
+	SHA1_SHANI_STEPS_MSG(E0, E1, MSG0, MSG1, MSG2, MSG3, 2);
+	SHA1_SHANI_STEPS_MSG(E1, E0, MSG1, MSG2, MSG3, MSG0, 2);
+	SHA1_SHANI_STEPS_MSG(E0, E1, MSG2, MSG3, MSG0, MSG1, 2);
+
+	SHA1_SHANI_STEPS_MSG(E1, E0, MSG3, MSG0, MSG1, MSG2, 3);
+	SHA1_SHANI_STEPS_MSG(E0, E1, MSG0, MSG1, MSG2, MSG3, 3);
+	// steps 68-79 only need the remaining W[76..79]
+	SHA1_SHANI_STEPS(E1, E0, MSG1, 3);
+	MSG2 = _mm_sha1msg2_epu32(MSG2, MSG1);
+	MSG3 = _mm_xor_si128(MSG3, MSG1);
+	SHA1_SHANI_STEPS(E0, E1, MSG2, 3);
+	MSG3 = _mm_sha1msg2_epu32(MSG3, MSG2);
+	SHA1_SHANI_STEPS(E1, E0, MSG3, 3);
+
+	E0 = _mm_sha1nexte_epu32(E0, E0_SAVE);
+	ABCD = _mm_add_epi32(ABCD, ABCD_SAVE);
+	_mm_storeu_si128((__m128i*)(ihv), _mm_shuffle_epi32(ABCD, 0x1B));
+	ihv[4] = uint32_t(_mm_extract_epi32(E0, 3));
+}
+
+#undef SHA1_SHANI_STEPS
+#undef SHA1_SHANI_STEPS_MSG
+#endif // x86
+
+// the optimized baselines the running cpu supports, widest first
+// callers should verify them against a reference before trusting their timings
+inline std::vector<sha1_baseline> available_sha1_baselines(const cpu_features& cpu = detect_cpu_features())
+{
+	std::vector<sha1_baseline> ret;
+#ifdef HAVE_SHA1_BASELINES_X86
+	if (cpu.avx512f)
+	{
+		sha1_baseline b = { "avx512x16", 16, sha1_compress_avx512_x16 };
+		ret.push_back(b);
+	}
+	if (cpu.avx2)
+	{
+		sha1_baseline b = { "avx2x8", 8, sha1_compress_avx2_x8 };
+		ret.push_back(b);
+	}
+	if (cpu.sse2)
+	{
+		sha1_baseline b = { "sse2x4", 4, sha1_compress_sse2_x4 };
+		ret.push_back(b);
+	}
+	if (cpu.sha && cpu.sse41)
+	{
+		sha1_baseline b = { "shani", 1, sha1_compress_shani };
+		ret.push_back(b);
+	}
+#else
+	(void)cpu;
+#endif
+	return ret;
+}
+
+#endif // SHA1_BASELINES_HPP
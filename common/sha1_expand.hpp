@@ -0,0 +1,122 @@
+/***
+* Copyright 2017 Marc Stevens <marc@marc-stevens.nl>, Dan Shumow <danshu@microsoft.com>
+* Distributed under the MIT Software License.
+* See accompanying file LICENSE.txt or copy at
+* https://opensource.org/licenses/MIT
+***/
+
+#ifndef SHA1_EXPAND_HPP
+#define SHA1_EXPAND_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// the SHA-1 message expansion W[t] = rotl(W[t-3] ^ W[t-8] ^ W[t-14] ^ W[t-16], 1) for t = 16..79,
+// in place on W[0..15], for the test inputs of the tools. With GCC/Clang vector extensions the
+// rotates and xors run on 16, 8 and 4 words at a time, lowered to the instruction set of the
+// target flags; other compilers get the plain loops.
+
+// the plain expansion of one block, the reference for the vectorized ones
+inline void sha1_expand_scalar(uint32_t* W)
+{
+	for (unsigned t = 16; t < 80; ++t)
+	{
+		uint32_t w = W[t - 3] ^ W[t - 8] ^ W[t - 14] ^ W[t - 16];
+		W[t] = (w << 1) | (w >> 31);
+	}
+}
+
+#if defined(__GNUC__)
+namespace sha1_expand_detail {
+
+	typedef uint32_t v4 __attribute__((vector_size(16)));
+	typedef uint32_t v8 __attribute__((vector_size(32)));
+	typedef uint32_t v16 __attribute__((vector_size(64)));
+
+	// memcpy for unaligned SoA rows that may alias the other rows; vectors are passed by
+	// reference, wider ones than the target flags support would change the ABI by value
+	template<typename V>
+	inline void load_xor(V& v, const uint32_t* p)
+	{
+		V w;
+		memcpy(&w, p, sizeof(V));
+		v ^= w;
+	}
+
+	// W[t..] = rotl(W[t-a..] ^ W[t-b..] ^ W[t-c..] ^ W[t-d..], r) for one vector of words
+	template<typename V>
+	inline void expand_step(uint32_t* Wt, size_t a, size_t b, size_t c, size_t d, unsigned r)
+	{
+		V w = {};
+		load_xor(w, Wt - a);
+		load_xor(w, Wt - b);
+		load_xor(w, Wt - c);
+		load_xor(w, Wt - d);
+		w = (w << r) | (w >> (32 - r));
+		memcpy(Wt, &w, sizeof(V));
+	}
+
+	// lanes [j, j + sizeof(V) / 4) of W[16..79] in SoA layout with 'lanes' words per row
+	template<typename V>
+	inline void expand_rows(uint32_t* W, size_t lanes, size_t j)
+	{
+		for (unsigned t = 16; t < 80; ++t)
+			expand_step<V>(W + t * lanes + j, 3 * lanes, 8 * lanes, 14 * lanes, 16 * lanes, 1);
+	}
+
+}
+#endif
+
+// one block: W[16..31] word by word, then W[32..79] four words at a time from the equivalent
+// W[t] = rotl(W[t-6] ^ W[t-16] ^ W[t-28] ^ W[t-32], 2), whose nearest input is outside the vector
+inline void sha1_expand(uint32_t* W)
+{
+#if defined(__GNUC__)
+	using namespace sha1_expand_detail;
+	for (unsigned t = 16; t < 32; ++t)
+	{
+		uint32_t w = W[t - 3] ^ W[t - 8] ^ W[t - 14] ^ W[t - 16];
+		W[t] = (w << 1) | (w >> 31);
+	}
+	for (unsigned t = 32; t < 80; t += 4)
+		expand_step<v4>(W + t, 6, 16, 28, 32, 2);
+#else
+	sha1_expand_scalar(W);
+#endif
+}
+
+// 'lanes' blocks in SoA layout, word t of block j at W[t * lanes + j], as the SIMD ubc_check
+// variants take them
+inline void sha1_expand_soa(uint32_t* W, size_t lanes)
+{
+	if (lanes == 1)
+	{
+		sha1_expand(W);
+		return;
+	}
+	size_t j = 0;
+#if defined(__GNUC__)
+	using namespace sha1_expand_detail;
+	for (; j + 16 <= lanes; j += 16)
+		expand_rows<v16>(W, lanes, j);
+	if (j + 8 <= lanes)
+	{
+		expand_rows<v8>(W, lanes, j);
+		j += 8;
+	}
+	if (j + 4 <= lanes)
+	{
+		expand_rows<v4>(W, lanes, j);
+		j += 4;
+	}
+#endif
+	for (unsigned t = 16; t < 80 && j < lanes; ++t)
+		for (size_t k = j; k < lanes; ++k)
+		{
+			uint32_t w = W[(t - 3) * lanes + k] ^ W[(t - 8) * lanes + k] ^ W[(t - 14) * lanes + k] ^ W[(t - 16) * lanes + k];
+			W[t * lanes + k] = (w << 1) | (w >> 31);
+		}
+}
+
+#endif // SHA1_EXPAND_HPP
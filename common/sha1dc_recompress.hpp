@@ -0,0 +1,164 @@
+/***
+* Copyright 2017 Marc Stevens <marc@marc-stevens.nl>, Dan Shumow <danshu@microsoft.com>
+* Distributed under the MIT Software License.
+* See accompanying file LICENSE.txt or copy at
+* https://opensource.org/licenses/MIT
+***/
+
+#ifndef SHA1DC_RECOMPRESS_HPP
+#define SHA1DC_RECOMPRESS_HPP
+
+#include <cstdint>
+
+extern "C"
+{
+#include "ubc_check.h"
+}
+
+// parse_bitrel also generates sha1_recompress.cinc, with the recompression of every DV unrolled and
+// its message differences as constants; Makefile.local defines HAVE_SHA1_RECOMPRESS if the library
+// has it, otherwise the differences are applied and the steps replayed generically
+#ifdef HAVE_SHA1_RECOMPRESS
+#include "sha1_recompress.cinc"
+#endif
+
+// scalar collision detection of a single compressed block outside of a SHA1_CTX, for callers that
+// compress and run ubc_check themselves (e.g. across SIMD lanes) and only fall back to this for the
+// blocks whose dvmask is non-zero: for every DV left in the dvmask, the block with that DV's message
+// differences applied is recompressed from the state at step testt of the original block, and a
+// collision is reported when both blocks lead to the same output ihv
+
+namespace sha1dc_detail {
+
+	inline uint32_t rotl(uint32_t x, unsigned n) { return (x << n) | (x >> (32 - n)); }
+	inline uint32_t rotr(uint32_t x, unsigned n) { return (x >> n) | (x << (32 - n)); }
+
+	inline uint32_t f(unsigned t, uint32_t b, uint32_t c, uint32_t d)
+	{
+		if (t < 20) return d ^ (b & (c ^ d));
+		if (t < 40 || t >= 60) return b ^ c ^ d;
+		return (b & (c | d)) | (c & d);
+	}
+
+	inline uint32_t k(unsigned t)
+	{
+		static const uint32_t K[4] = { 0x5A827999, 0x6ED9EBA1, 0x8F1BBCDC, 0xCA62C1D6 };
+		return K[t / 20];
+	}
+
+	// W2 = the message W with the differences of a DV: all 80 words of the legacy table, or only the
+	// runs of non-zero ones of the sparse table that goes with the hot table
+	inline void apply_dv(const dv_info_t& dv, const uint32_t W[80], uint32_t W2[80])
+	{
+		for (unsigned j = 0; j < 80; ++j)
+			W2[j] = W[j] ^ dv.dm[j];
+	}
+
+#ifdef SHA1_DVS_HOT
+	inline void apply_dv(const dv_hot_t& dv, const uint32_t W[80], uint32_t W2[80])
+	{
+		for (unsigned j = 0; j < 80; ++j)
+			W2[j] = W[j];
+		const uint32_t* dm = sha1_dvs_dmword + dv.dmword;
+		for (const uint8_t (*run)[2] = sha1_dvs_dmrun + dv.dmrun; (*run)[1] != 0; dm += (*run)[1], ++run)
+			for (unsigned j = 0; j < (*run)[1]; ++j)
+				W2[(*run)[0] + j] ^= dm[j];
+	}
+#endif
+
+}
+
+// compresses the expanded message W into ihv, storing the working state before each step
+inline void sha1_compression_states(uint32_t ihv[5], const uint32_t W[80], uint32_t states[80][5])
+{
+	using namespace sha1dc_detail;
+	uint32_t a = ihv[0], b = ihv[1], c = ihv[2], d = ihv[3], e = ihv[4];
+	for (unsigned t = 0; t < 80; ++t)
+	{
+		states[t][0] = a; states[t][1] = b; states[t][2] = c; states[t][3] = d; states[t][4] = e;
+		uint32_t tmp = rotl(a, 5) + f(t, b, c, d) + e + k(t) + W[t];
+		e = d; d = c; c = rotl(b, 30); b = a; a = tmp;
+	}
+	ihv[0] += a; ihv[1] += b; ihv[2] += c; ihv[3] += d; ihv[4] += e;
+}
+
+inline void sha1_compression_W(uint32_t ihv[5], const uint32_t W[80])
+{
+	uint32_t states[80][5];
+	sha1_compression_states(ihv, W, states);
+}
+
+// from the working state before step t: computes steps t-1 down to 0 backwards to the input ihvin
+// and steps t to 79 forwards to the output ihvout of the compression of W
+inline void sha1_recompression_step(unsigned t, uint32_t ihvin[5], uint32_t ihvout[5], const uint32_t W[80], const uint32_t state[5])
+{
+	using namespace sha1dc_detail;
+	uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+	for (unsigned i = t; i-- > 0;)
+	{
+		uint32_t pa = b, pb = rotr(c, 30), pc = d, pd = e;
+		uint32_t pe = a - rotl(pa, 5) - f(i, pb, pc, pd) - k(i) - W[i];
+		a = pa; b = pb; c = pc; d = pd; e = pe;
+	}
+	ihvin[0] = a; ihvin[1] = b; ihvin[2] = c; ihvin[3] = d; ihvin[4] = e;
+	a = state[0]; b = state[1]; c = state[2]; d = state[3]; e = state[4];
+	for (unsigned i = t; i < 80; ++i)
+	{
+		uint32_t tmp = rotl(a, 5) + f(i, b, c, d) + e + k(i) + W[i];
+		e = d; d = c; c = rotl(b, 30); b = a; a = tmp;
+	}
+	ihvout[0] = ihvin[0] + a; ihvout[1] = ihvin[1] + b; ihvout[2] = ihvin[2] + c; ihvout[3] = ihvin[3] + d; ihvout[4] = ihvin[4] + e;
+}
+
+// checks the block W compressed from ihvin to ihvout against every DV in dvmask, as SHA1DCUpdate
+// does after ubc_check; returns true on a collision, with the colliding block's ihvin and
+// expanded message in ihv2 and m2 if given
+inline bool sha1dc_check_block(const uint32_t ihvin[5], const uint32_t W[80], const uint32_t dvmask[DVMASKSIZE], const uint32_t ihvout[5], uint32_t* ihv2 = 0, uint32_t* m2 = 0)
+{
+	uint32_t ihv[5] = { ihvin[0], ihvin[1], ihvin[2], ihvin[3], ihvin[4] };
+	uint32_t states[80][5];
+	bool computed = false;
+#ifdef SHA1_DVS_HOT
+	// a library generated with the hot/cold split: the loop only reads the few cache lines of the
+	// hot table, sorted by testt, and the differences of a DV only when its bit is set
+	for (unsigned h = 0; h < DVCOUNT; ++h)
+	{
+		const dv_hot_t& dv = sha1_dvs_hot[h];
+#else
+	for (unsigned index = 0; sha1_dvs[index].dvType != 0; ++index)
+	{
+		const dv_info_t& dv = sha1_dvs[index];
+#endif
+		if (!((dvmask[dv.maski] >> dv.maskb) & 1))
+			continue;
+		// the states are only needed once a DV passed ubc_check, which is rare
+		if (!computed)
+		{
+			sha1_compression_states(ihv, W, states);
+			computed = true;
+		}
+		uint32_t ihvin2[5];
+#ifdef HAVE_SHA1_RECOMPRESS
+#ifdef SHA1_DVS_HOT
+		// the generated functions are in the order of sha1_dvs
+		const unsigned index = dv.dv;
+#endif
+		if (sha1_recompress_dvs[index](W, states[dv.testt], ihvout, ihvin2))
+#else
+		uint32_t W2[80], ihvout2[5];
+		sha1dc_detail::apply_dv(dv, W, W2);
+		sha1_recompression_step(unsigned(dv.testt), ihvin2, ihvout2, W2, states[dv.testt]);
+		if (0 == ((ihvout2[0] ^ ihvout[0]) | (ihvout2[1] ^ ihvout[1]) | (ihvout2[2] ^ ihvout[2]) | (ihvout2[3] ^ ihvout[3]) | (ihvout2[4] ^ ihvout[4])))
+#endif
+		{
+			for (unsigned j = 0; ihv2 && j < 5; ++j)
+				ihv2[j] = ihvin2[j];
+			if (m2)
+				sha1dc_detail::apply_dv(dv, W, m2);
+			return true;
+		}
+	}
+	return false;
+}
+
+#endif // SHA1DC_RECOMPRESS_HPP
@@ -0,0 +1,249 @@
+/***
+* Copyright 2017 Marc Stevens <marc@marc-stevens.nl>, Dan Shumow <danshu@microsoft.com>
+* Distributed under the MIT Software License.
+* See accompanying file LICENSE.txt or copy at
+* https://opensource.org/licenses/MIT
+***/
+
+#ifndef SHA1DC_STREAM_HPP
+#define SHA1DC_STREAM_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+
+#include "aligned_arena.hpp"
+#include "sha1_baselines.hpp"
+#include "sha1_expand.hpp"
+#include "sha1dc_recompress.hpp"
+#include "ubc_check_dispatch.hpp"
+
+// the pieces of SHA-1 with collision detection that sha1dc_stream, the multi-buffer engine and the
+// two-phase scan share: message words are big endian, and the SIMD ubc_check variants work on
+// 'lanes' expanded blocks in SoA layout, word t of block j at W[t * lanes + j]
+
+const uint32_t sha1dc_iv[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+
+inline uint32_t sha1dc_load_be32(const unsigned char* p)
+{
+	return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+// 0x80, zeros and the message length in bits complete the last one or two blocks: the last
+// 'fill' bytes of the message are at the start of buf, which has room for two more blocks after
+// the last whole one; returns the number of blocks from buf
+inline size_t sha1dc_pad(unsigned char* buf, size_t fill, uint64_t bytes)
+{
+	size_t end = (fill + 1 + 8 + 63) / 64 * 64;
+	buf[fill] = 0x80;
+	memset(&buf[fill + 1], 0, end - fill - 1);
+	uint64_t bits = bytes << 3;
+	for (unsigned i = 0; i < 8; ++i)
+		buf[end - 1 - i] = (unsigned char)(bits >> (8 * i));
+	return end / 64;
+}
+
+inline void sha1dc_store_hash(const uint32_t ihv[5], unsigned char hash[20])
+{
+	for (unsigned i = 0; i < 20; ++i)
+		hash[i] = (unsigned char)(ihv[i / 4] >> (24 - 8 * (i % 4)));
+}
+
+// copies the dvmask of block j out of the SoA dvmask, every DV without ubc; returns false if it
+// is zero and the block needs no recompressions
+inline bool sha1dc_lane_dvmask(const uint32_t* dvmask, size_t lanes, size_t j, bool ubc, uint32_t mask[DVMASKSIZE])
+{
+	uint32_t any = ubc ? 0 : 1;
+	for (unsigned i = 0; i < DVMASKSIZE; ++i)
+	{
+		mask[i] = ubc ? dvmask[i * lanes + j] : 0xFFFFFFFF;
+		any |= mask[i];
+	}
+	return any != 0;
+}
+
+inline void sha1dc_lane_words(const uint32_t* W, size_t lanes, size_t j, uint32_t Wj[80])
+{
+	for (unsigned t = 0; t < 80; ++t)
+		Wj[t] = W[t * lanes + j];
+}
+
+// ubc_check does not depend on the chaining value, so consecutive blocks of one message are
+// expanded and checked by one call of a SIMD variant; only the blocks with a non-zero dvmask
+// are handed on, for the scalar recompressions of sha1dc_recompress.hpp
+class sha1dc_block_batch
+{
+public:
+	explicit sha1dc_block_batch(const ubc_check_kernel& kernel, bool ubc = true)
+		: k(kernel), ubc(ubc), L(kernel.lanes), W(80 * kernel.lanes), dvmask(DVMASKSIZE * kernel.lanes)
+	{
+	}
+
+	size_t lanes() const { return L; }
+
+	// the SoA message words of the last check
+	const uint32_t* words() const { return &W[0]; }
+
+	// checks the 'blocks' <= lanes() consecutive blocks at p and calls found(j, Wj, mask) in order
+	// for every block j with a non-zero dvmask, with its expanded message and dvmask; the lanes
+	// after the last block keep stale words, their dvmasks are ignored
+	template<typename F>
+	void check(const unsigned char* p, size_t blocks, F found)
+	{
+		for (size_t j = 0; j < blocks; ++j)
+			for (unsigned i = 0; i < 16; ++i)
+				W[i * L + j] = sha1dc_load_be32(p + 64 * j + 4 * i);
+		sha1_expand_soa(&W[0], L);
+		if (ubc)
+			k.check(&W[0], &dvmask[0]);
+		uint32_t Wj[80], mask[DVMASKSIZE];
+		for (size_t j = 0; j < blocks; ++j)
+		{
+			if (!sha1dc_lane_dvmask(&dvmask[0], L, j, ubc, mask))
+				continue;
+			sha1dc_lane_words(&W[0], L, j, Wj);
+			found(j, Wj, mask);
+		}
+	}
+
+private:
+	ubc_check_kernel k;
+	bool ubc;
+	size_t L;
+	aligned_arena<uint32_t> W, dvmask;
+
+	sha1dc_block_batch(const sha1dc_block_batch&);
+	sha1dc_block_batch& operator=(const sha1dc_block_batch&);
+};
+
+// SHA-1 with collision detection of a single message on the SIMD ubc_check variants: the next
+// 'lanes' consecutive blocks of the message are checked by sha1dc_block_batch and then compressed
+// one after another. This brings the SIMD speedup to large files, where there is no
+// parallelism across messages for sha1dc_multibuffer.
+// results are the same as SHA1DCInit/SHA1DCUpdate/SHA1DCFinal with the default settings, i.e.
+// including the safe hash of colliding blocks; without ubc every DV is checked on every block
+
+class sha1dc_stream
+{
+public:
+	explicit sha1dc_stream(const ubc_check_kernel& kernel = dispatch_ubc_check_kernel(), bool ubc = true, bool safe_hash = true)
+		: batch(kernel, ubc), safe_hash(safe_hash), lanes(kernel.lanes), plain(0),
+		buf(64 * kernel.lanes + 128), recompressions(0)
+	{
+		// the plain compression of the chain, from the message words: the SHA extensions if the
+		// cpu has them, otherwise the scalar compression of the already expanded message
+		std::vector<sha1_baseline> baselines = available_sha1_baselines();
+		for (size_t i = 0; i < baselines.size(); ++i)
+			if (baselines[i].lanes == 1)
+				plain = baselines[i].compress;
+		init();
+	}
+
+	void init()
+	{
+		memcpy(ihv, sha1dc_iv, sizeof(ihv));
+		fill = 0;
+		total = 0;
+		collision = false;
+	}
+
+	void update(const char* data, size_t len)
+	{
+		const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+		const size_t batch = 64 * lanes;
+		total += len;
+		if (fill)
+		{
+			size_t n = std::min(len, batch - fill);
+			memcpy(&buf[fill], p, n);
+			fill += n;
+			p += n;
+			len -= n;
+			if (fill < batch)
+				return;
+			process(&buf[0], lanes);
+			fill = 0;
+		}
+		// whole batches straight from the caller's data
+		for (; len >= batch; p += batch, len -= batch)
+			process(p, lanes);
+		memcpy(&buf[0], p, len);
+		fill = len;
+	}
+
+	// returns true if a collision was detected
+	bool final(unsigned char hash[20])
+	{
+		size_t blocks = sha1dc_pad(&buf[0], fill, total);
+		process(&buf[0], std::min<size_t>(blocks, lanes));
+		if (blocks > lanes)
+			process(&buf[64 * lanes], blocks - lanes);
+		sha1dc_store_hash(ihv, hash);
+		return collision;
+	}
+
+	// blocks that went through the recompressions since construction
+	uint64_t recompressed() const { return recompressions; }
+
+private:
+	sha1dc_block_batch batch;
+	bool safe_hash;
+	size_t lanes;
+	sha1_baseline_fn plain;
+	std::vector<unsigned char> buf;
+	size_t fill;
+	uint64_t total, recompressions;
+	uint32_t ihv[5];
+	bool collision;
+
+	// the blocks [from, to) of the last batch, none of which needs the recompressions
+	void compress_plain(size_t from, size_t to)
+	{
+		const uint32_t* W = batch.words();
+		uint32_t Wj[80];
+		for (size_t j = from; j < to; ++j)
+		{
+			if (plain)
+			{
+				uint32_t m[16];
+				for (unsigned i = 0; i < 16; ++i)
+					m[i] = W[i * lanes + j];
+				plain(ihv, m);
+				continue;
+			}
+			sha1dc_lane_words(W, lanes, j, Wj);
+			sha1_compression_W(ihv, Wj);
+		}
+	}
+
+	// checks 'blocks' <= lanes consecutive blocks at once, then compresses them in order
+	void process(const unsigned char* p, size_t blocks)
+	{
+		size_t next = 0;
+		batch.check(p, blocks, [&](size_t j, const uint32_t* Wj, const uint32_t* mask)
+		{
+			compress_plain(next, j);
+			next = j + 1;
+			uint32_t ihvin[5];
+			memcpy(ihvin, ihv, sizeof(ihv));
+			sha1_compression_W(ihv, Wj);
+			++recompressions;
+			if (sha1dc_check_block(ihvin, Wj, mask, ihv))
+			{
+				collision = true;
+				if (safe_hash)
+				{
+					// as the library does: compress the colliding block twice more so that the
+					// colliding messages get different hashes
+					sha1_compression_W(ihv, Wj);
+					sha1_compression_W(ihv, Wj);
+				}
+			}
+		});
+		compress_plain(next, blocks);
+	}
+};
+
+#endif // SHA1DC_STREAM_HPP
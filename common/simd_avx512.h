@@ -0,0 +1,28 @@
+/***
+* Copyright 2017 Marc Stevens <marc@marc-stevens.nl>, Dan Shumow <danshu@microsoft.com>
+* Distributed under the MIT Software License.
+* See accompanying file LICENSE.txt or copy at
+* https://opensource.org/licenses/MIT
+***/
+
+// the SIMD operations of the library's generated ubc_check_simd.cinc for AVX-512F, as in its simd_avx256.h
+#ifndef SIMD_AVX512_H
+#define SIMD_AVX512_H
+#include <immintrin.h>
+#define SIMD_VECSIZE 16
+#define SIMD_WORD __m512i
+#define SIMD_WTOV(l) _mm512_set1_epi32(l)
+#define SIMD_AND_VV(l,r) _mm512_and_si512(l,r)
+#define SIMD_AND_VW(l,r) _mm512_and_si512(l,_mm512_set1_epi32(r))
+#define SIMD_OR_VV(l,r) _mm512_or_si512(l,r)
+#define SIMD_OR_VW(l,r) _mm512_or_si512(l,_mm512_set1_epi32(r))
+#define SIMD_XOR_VV(l,r) _mm512_xor_si512(l,r)
+#define SIMD_XOR_VW(l,r) _mm512_xor_si512(l,_mm512_set1_epi32(r))
+#define SIMD_NOT_V(l) _mm512_xor_si512(l,_mm512_set1_epi32(~0))
+#define SIMD_SHL_V(l,i) _mm512_slli_epi32(l,i)
+#define SIMD_SHR_V(l,i) _mm512_srli_epi32(l,i)
+#define SIMD_SUB_VV(l,r) _mm512_sub_epi32(l,r)
+#define SIMD_SUB_VW(l,r) _mm512_sub_epi32(l,_mm512_set1_epi32(r))
+#define SIMD_NEG_V(l) _mm512_sub_epi32(_mm512_setzero_si512(),l)
+#define UBC_CHECK_SIMD ubc_check_avx512
+#endif
@@ -0,0 +1,57 @@
+/***
+* Copyright 2017 Marc Stevens <marc@marc-stevens.nl>, Dan Shumow <danshu@microsoft.com>
+* Distributed under the MIT Software License.
+* See accompanying file LICENSE.txt or copy at
+* https://opensource.org/licenses/MIT
+***/
+
+// the SIMD operations of the library's generated ubc_check_simd.cinc on GCC/Clang vector extensions,
+// for any number of uint32_t lanes: define SIMD_VEC_LANES before including this file, the generated
+// function is then named ubc_check_vec<lanes>. The compiler lowers the vectors to the instruction
+// set of the target flags, splitting vectors wider than its registers.
+// deliberately without include guard: a translation unit may include this once per lane count,
+// each time with the generated code inside its own namespace
+#ifndef SIMD_VEC_LANES
+#error "define SIMD_VEC_LANES before including simd_vec.h"
+#endif
+#include <stdint.h>
+
+#undef SIMD_VECSIZE
+#undef SIMD_WORD
+#undef SIMD_WTOV
+#undef SIMD_AND_VV
+#undef SIMD_AND_VW
+#undef SIMD_OR_VV
+#undef SIMD_OR_VW
+#undef SIMD_XOR_VV
+#undef SIMD_XOR_VW
+#undef SIMD_NOT_V
+#undef SIMD_SHL_V
+#undef SIMD_SHR_V
+#undef SIMD_SUB_VV
+#undef SIMD_SUB_VW
+#undef SIMD_NEG_V
+#undef UBC_CHECK_SIMD
+
+#define SIMD_VEC_PASTE2(a,b) a##b
+#define SIMD_VEC_PASTE(a,b) SIMD_VEC_PASTE2(a,b)
+
+// aligned to the vector size up to a cache line, so that aligned_arena storage suffices
+typedef uint32_t SIMD_VEC_PASTE(simd_vec_word, SIMD_VEC_LANES) __attribute__((vector_size(4 * SIMD_VEC_LANES), aligned(4 * SIMD_VEC_LANES < 64 ? 4 * SIMD_VEC_LANES : 64)));
+
+#define SIMD_VECSIZE SIMD_VEC_LANES
+#define SIMD_WORD SIMD_VEC_PASTE(simd_vec_word, SIMD_VEC_LANES)
+#define SIMD_WTOV(l) ((SIMD_WORD){} + (uint32_t)(l))
+#define SIMD_AND_VV(l,r) ((l) & (r))
+#define SIMD_AND_VW(l,r) ((l) & (uint32_t)(r))
+#define SIMD_OR_VV(l,r) ((l) | (r))
+#define SIMD_OR_VW(l,r) ((l) | (uint32_t)(r))
+#define SIMD_XOR_VV(l,r) ((l) ^ (r))
+#define SIMD_XOR_VW(l,r) ((l) ^ (uint32_t)(r))
+#define SIMD_NOT_V(l) (~(l))
+#define SIMD_SHL_V(l,i) ((l) << (i))
+#define SIMD_SHR_V(l,i) ((l) >> (i))
+#define SIMD_SUB_VV(l,r) ((l) - (r))
+#define SIMD_SUB_VW(l,r) ((l) - (uint32_t)(r))
+#define SIMD_NEG_V(l) (-(l))
+#define UBC_CHECK_SIMD SIMD_VEC_PASTE(ubc_check_vec, SIMD_VEC_LANES)
@@ -0,0 +1,162 @@
+/***
+* Copyright 2017 Marc Stevens <marc@marc-stevens.nl>, Dan Shumow <danshu@microsoft.com>
+* Distributed under the MIT Software License.
+* See accompanying file LICENSE.txt or copy at
+* https://opensource.org/licenses/MIT
+***/
+
+#ifndef TRANSPOSE_LANES_HPP
+#define TRANSPOSE_LANES_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include "cpu_features.hpp"
+
+// gathers the (expanded) messages of independent hashing contexts, each an AoS array of words,
+// into the SoA layout of the SIMD kernels: word i of in[j] goes to out[i * lanes + j].
+// the SIMD transposes are unpack/permute networks on square tiles of lanes x lanes words,
+// compiled with target attributes like sha1_baselines.hpp and selected at runtime
+
+// words must be a multiple of the kernel's lanes (80 and 16 are for 4, 8 and 16 lanes)
+typedef void (*transpose_lanes_fn)(const uint32_t* const* in, uint32_t* out, unsigned words);
+
+struct transpose_kernel
+{
+	const char* name;
+	unsigned lanes;
+	transpose_lanes_fn transpose;
+};
+
+// any number of lanes and words, word by word
+inline void transpose_lanes(const uint32_t* const* in, unsigned lanes, uint32_t* out, unsigned words)
+{
+	for (unsigned i = 0; i < words; ++i)
+		for (unsigned j = 0; j < lanes; ++j)
+			out[i * lanes + j] = in[j][i];
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_TRANSPOSE_LANES_X86
+#include <immintrin.h>
+
+// SSE2: 4x4 tiles in two rounds of unpacks
+__attribute__((target("sse2"))) inline void transpose_lanes_sse2_x4(const uint32_t* const* in, uint32_t* out, unsigned words)
+{
+	for (unsigned i = 0; i < words; i += 4)
+	{
+		__m128i r0 = _mm_loadu_si128((const __m128i*)(in[0] + i)), r1 = _mm_loadu_si128((const __m128i*)(in[1] + i));
+		__m128i r2 = _mm_loadu_si128((const __m128i*)(in[2] + i)), r3 = _mm_loadu_si128((const __m128i*)(in[3] + i));
+		__m128i t0 = _mm_unpacklo_epi32(r0, r1), t1 = _mm_unpackhi_epi32(r0, r1);
+		__m128i t2 = _mm_unpacklo_epi32(r2, r3), t3 = _mm_unpackhi_epi32(r2, r3);
+		_mm_storeu_si128((__m128i*)(out + i * 4), _mm_unpacklo_epi64(t0, t2));
+		_mm_storeu_si128((__m128i*)(out + i * 4 + 4), _mm_unpackhi_epi64(t0, t2));
+		_mm_storeu_si128((__m128i*)(out + i * 4 + 8), _mm_unpacklo_epi64(t1, t3));
+		_mm_storeu_si128((__m128i*)(out + i * 4 + 12), _mm_unpackhi_epi64(t1, t3));
+	}
+}
+
+// AVX2: 8x8 tiles, the unpacks transpose the 4x4 quarters within 128-bit halves and
+// permute2x128 swaps the off-diagonal quarters
+__attribute__((target("avx2"))) inline void transpose_lanes_avx2_x8(const uint32_t* const* in, uint32_t* out, unsigned words)
+{
+	for (unsigned i = 0; i < words; i += 8)
+	{
+		__m256i r[8], a[8], b[8];
+		for (unsigned j = 0; j < 8; ++j)
+			r[j] = _mm256_loadu_si256((const __m256i*)(in[j] + i));
+		for (unsigned k = 0; k < 4; ++k)
+		{
+			a[2 * k] = _mm256_unpacklo_epi32(r[2 * k], r[2 * k + 1]);
+			a[2 * k + 1] = _mm256_unpackhi_epi32(r[2 * k], r[2 * k + 1]);
+		}
+		// b[4k + m] holds word 4h + m of rows 4k..4k+3 in half h
+		for (unsigned k = 0; k < 2; ++k)
+		{
+			b[4 * k] = _mm256_unpacklo_epi64(a[4 * k], a[4 * k + 2]);
+			b[4 * k + 1] = _mm256_unpackhi_epi64(a[4 * k], a[4 * k + 2]);
+			b[4 * k + 2] = _mm256_unpacklo_epi64(a[4 * k + 1], a[4 * k + 3]);
+			b[4 * k + 3] = _mm256_unpackhi_epi64(a[4 * k + 1], a[4 * k + 3]);
+		}
+		for (unsigned m = 0; m < 4; ++m)
+		{
+			_mm256_storeu_si256((__m256i*)(out + (i + m) * 8), _mm256_permute2x128_si256(b[m], b[4 + m], 0x20));
+			_mm256_storeu_si256((__m256i*)(out + (i + 4 + m) * 8), _mm256_permute2x128_si256(b[m], b[4 + m], 0x31));
+		}
+	}
+}
+
+// AVX-512: 16x16 tiles, the unpacks as for AVX2 within 128-bit quarters, then two rounds of
+// shuffle_i32x4 gather quarter q of the four rows b[m], b[4 + m], b[8 + m] and b[12 + m]
+__attribute__((target("avx512f"))) inline void transpose_lanes_avx512_x16(const uint32_t* const* in, uint32_t* out, unsigned words)
+{
+	for (unsigned i = 0; i < words; i += 16)
+	{
+		__m512i r[16], a[16], b[16];
+		for (unsigned j = 0; j < 16; ++j)
+			r[j] = _mm512_loadu_si512((const void*)(in[j] + i));
+		for (unsigned k = 0; k < 8; ++k)
+		{
+			a[2 * k] = _mm512_unpacklo_epi32(r[2 * k], r[2 * k + 1]);
+			a[2 * k + 1] = _mm512_unpackhi_epi32(r[2 * k], r[2 * k + 1]);
+		}
+		// b[4k + m] holds word 4q + m of rows 4k..4k+3 in quarter q
+		for (unsigned k = 0; k < 4; ++k)
+		{
+			b[4 * k] = _mm512_unpacklo_epi64(a[4 * k], a[4 * k + 2]);
+			b[4 * k + 1] = _mm512_unpackhi_epi64(a[4 * k], a[4 * k + 2]);
+			b[4 * k + 2] = _mm512_unpacklo_epi64(a[4 * k + 1], a[4 * k + 3]);
+			b[4 * k + 3] = _mm512_unpackhi_epi64(a[4 * k + 1], a[4 * k + 3]);
+		}
+		for (unsigned m = 0; m < 4; ++m)
+		{
+			// the even and odd quarters of rows 0..7 and 8..15
+			__m512i c0 = _mm512_shuffle_i32x4(b[m], b[4 + m], 0x88), c1 = _mm512_shuffle_i32x4(b[m], b[4 + m], 0xdd);
+			__m512i d0 = _mm512_shuffle_i32x4(b[8 + m], b[12 + m], 0x88), d1 = _mm512_shuffle_i32x4(b[8 + m], b[12 + m], 0xdd);
+			_mm512_storeu_si512((void*)(out + (i + m) * 16), _mm512_shuffle_i32x4(c0, d0, 0x88));
+			_mm512_storeu_si512((void*)(out + (i + 4 + m) * 16), _mm512_shuffle_i32x4(c1, d1, 0x88));
+			_mm512_storeu_si512((void*)(out + (i + 8 + m) * 16), _mm512_shuffle_i32x4(c0, d0, 0xdd));
+			_mm512_storeu_si512((void*)(out + (i + 12 + m) * 16), _mm512_shuffle_i32x4(c1, d1, 0xdd));
+		}
+	}
+}
+#endif // x86
+
+// the SIMD transposes the running cpu supports, widest first
+inline std::vector<transpose_kernel> available_transpose_kernels(const cpu_features& cpu = detect_cpu_features())
+{
+	std::vector<transpose_kernel> ret;
+#ifdef HAVE_TRANSPOSE_LANES_X86
+	if (cpu.avx512f)
+	{
+		transpose_kernel k = { "avx512x16", 16, transpose_lanes_avx512_x16 };
+		ret.push_back(k);
+	}
+	if (cpu.avx2)
+	{
+		transpose_kernel k = { "avx2x8", 8, transpose_lanes_avx2_x8 };
+		ret.push_back(k);
+	}
+	if (cpu.sse2)
+	{
+		transpose_kernel k = { "sse2x4", 4, transpose_lanes_sse2_x4 };
+		ret.push_back(k);
+	}
+#else
+	(void)cpu;
+#endif
+	return ret;
+}
+
+// the SIMD transpose for 'lanes' the cpu supports, or 0 if there is none and transpose_lanes()
+// has to do
+inline transpose_lanes_fn find_transpose_kernel(unsigned lanes, const cpu_features& cpu = detect_cpu_features())
+{
+	std::vector<transpose_kernel> kernels = available_transpose_kernels(cpu);
+	for (size_t i = 0; i < kernels.size(); ++i)
+		if (kernels[i].lanes == lanes)
+			return kernels[i].transpose;
+	return 0;
+}
+
+#endif // TRANSPOSE_LANES_HPP
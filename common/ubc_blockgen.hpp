@@ -0,0 +1,198 @@
+/***
+* Copyright 2017 Marc Stevens <marc@marc-stevens.nl>, Dan Shumow <danshu@microsoft.com>
+* Distributed under the MIT Software License.
+* See accompanying file LICENSE.txt or copy at
+* https://opensource.org/licenses/MIT
+***/
+
+#ifndef UBC_BLOCKGEN_HPP
+#define UBC_BLOCKGEN_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+
+#include <boost/filesystem.hpp>
+
+// generates message blocks that satisfy all unavoidable bit relations of a disturbance vector,
+// i.e. blocks for which ubc_check() sets that DV's bit and the library performs a recompression.
+// the relations are read from the ubcdatafiles logs that parse_bitrel uses to generate ubc_check.
+
+// the relations of one DV: each is 80 word masks over W[0..79] followed by its parity
+struct ubc_dv_relations
+{
+	int dvType, dvK, dvB; // as in dv_info_t: I(43,0) is dvType 1, dvK 43, dvB 0
+	std::vector< std::vector<uint32_t> > relations;
+
+	std::string name() const
+	{
+		return std::string(dvType == 1 ? "I" : "II") + "(" + std::to_string(dvK) + "," + std::to_string(dvB) + ")";
+	}
+};
+
+// parses "- W37[4] ^ W39[4] = 1" into 80 word masks plus parity
+inline std::vector<uint32_t> parse_ubc_relation(const std::string& line)
+{
+	std::vector<uint32_t> rel(81, 0);
+	size_t pos = line.find("=");
+	if (pos == std::string::npos || (pos = line.find_first_of("01", pos)) == std::string::npos)
+		throw std::runtime_error("Invalid bit relation: " + line);
+	rel[80] = (line[pos] == '1') ? 1 : 0;
+	for (size_t w = line.find('W'); w < pos; w = line.find('W', w + 1))
+	{
+		size_t open = line.find('[', w), close = line.find(']', w);
+		if (open == std::string::npos || close == std::string::npos || close > pos)
+			throw std::runtime_error("Invalid bit relation: " + line);
+		unsigned t = std::stoul(line.substr(w + 1, open - w - 1));
+		unsigned b = std::stoul(line.substr(open + 1, close - open - 1));
+		if (t >= 80 || b >= 32)
+			throw std::runtime_error("t or b out of bounds: " + line);
+		rel[t] ^= uint32_t(1) << b;
+	}
+	return rel;
+}
+
+// loads all DVs of a ubcdatafiles directory, files are named like I_43_0-3565.log
+inline std::vector<ubc_dv_relations> load_ubc_relations(const std::string& dir)
+{
+	namespace fs = boost::filesystem;
+	std::vector<ubc_dv_relations> ret;
+	if (!fs::is_directory(dir))
+		throw std::runtime_error("Not a directory: " + dir);
+	for (fs::directory_iterator it(dir); it != fs::directory_iterator(); ++it)
+	{
+		if (!fs::is_regular_file(it->path()) || it->path().extension() != ".log")
+			continue;
+		std::string stem = it->path().stem().string();
+		size_t u1 = stem.find('_'), u2 = stem.find('_', u1 + 1), dash = stem.find('-', u2 + 1);
+		if (u1 == std::string::npos || u2 == std::string::npos || dash == std::string::npos)
+			continue;
+		ubc_dv_relations dv;
+		std::string type = stem.substr(0, u1);
+		if (type != "I" && type != "II")
+			continue;
+		dv.dvType = (type == "I") ? 1 : 2;
+		dv.dvK = std::stoi(stem.substr(u1 + 1, u2 - u1 - 1));
+		dv.dvB = std::stoi(stem.substr(u2 + 1, dash - u2 - 1));
+		std::ifstream ifs(it->path().string().c_str());
+		std::string line;
+		while (std::getline(ifs, line))
+			if (line.find('=') != std::string::npos)
+				dv.relations.push_back(parse_ubc_relation(line));
+		ret.push_back(dv);
+	}
+	std::sort(ret.begin(), ret.end(), [](const ubc_dv_relations& l, const ubc_dv_relations& r)
+		{ return l.dvType != r.dvType ? l.dvType < r.dvType : (l.dvK != r.dvK ? l.dvK < r.dvK : l.dvB < r.dvB); });
+	return ret;
+}
+
+// the relations are linear over GF(2) in the 512 message bits: each expanded bit W[t][b]
+// is expressed as a 512-bit vector, the relations are reduced to row echelon form and
+// a block is generated by fixing the pivot bits of a random block
+class ubc_block_generator
+{
+public:
+	typedef std::vector<uint64_t> bitvector; // 512 bits: bit 32*t+b is message bit m[t][b]
+
+	explicit ubc_block_generator(const ubc_dv_relations& dv)
+	{
+		std::vector<bitvector> Wbits(80 * 32, bitvector(8, 0));
+		for (unsigned t = 0; t < 16; ++t)
+			for (unsigned b = 0; b < 32; ++b)
+				setbit(Wbits[t * 32 + b], t * 32 + b);
+		// W[t] = rotl(W[t-3] ^ W[t-8] ^ W[t-14] ^ W[t-16], 1)
+		for (unsigned t = 16; t < 80; ++t)
+			for (unsigned b = 0; b < 32; ++b)
+			{
+				unsigned b1 = (b + 31) & 31;
+				for (unsigned k = 0; k < 8; ++k)
+					Wbits[t * 32 + b][k] = Wbits[(t - 3) * 32 + b1][k] ^ Wbits[(t - 8) * 32 + b1][k]
+						^ Wbits[(t - 14) * 32 + b1][k] ^ Wbits[(t - 16) * 32 + b1][k];
+			}
+
+		for (size_t r = 0; r < dv.relations.size(); ++r)
+		{
+			bitvector row(8, 0);
+			for (unsigned t = 0; t < 80; ++t)
+				for (unsigned b = 0; b < 32; ++b)
+					if ((dv.relations[r][t] >> b) & 1)
+						for (unsigned k = 0; k < 8; ++k)
+							row[k] ^= Wbits[t * 32 + b][k];
+			add_row(row, dv.relations[r][80] & 1);
+		}
+	}
+
+	// number of independent relations: a random block passes with probability 2^-rank()
+	size_t rank() const { return rows.size(); }
+
+	// generates a block m[0..15] that satisfies all relations
+	template<typename RNG>
+	void generate(RNG& rng, uint32_t m[16]) const
+	{
+		for (unsigned i = 0; i < 16; ++i)
+			m[i] = rng();
+		fix(m);
+	}
+
+	// flips pivot bits of m so that all relations hold; each pivot occurs in exactly one row
+	void fix(uint32_t m[16]) const
+	{
+		for (size_t r = 0; r < rows.size(); ++r)
+		{
+			uint32_t acc = 0;
+			for (unsigned t = 0; t < 16; ++t)
+				acc ^= m[t] & uint32_t(rows[r][t >> 1] >> (32 * (t & 1)));
+			if (parity(acc) != parities[r])
+				m[pivots[r] >> 5] ^= uint32_t(1) << (pivots[r] & 31);
+		}
+	}
+
+private:
+	std::vector<bitvector> rows;
+	std::vector<unsigned> parities;
+	std::vector<unsigned> pivots;
+
+	static void setbit(bitvector& v, unsigned i) { v[i >> 6] |= uint64_t(1) << (i & 63); }
+	static bool getbit(const bitvector& v, unsigned i) { return (v[i >> 6] >> (i & 63)) & 1; }
+	static unsigned parity(uint32_t x)
+	{
+		x ^= x >> 16; x ^= x >> 8; x ^= x >> 4; x ^= x >> 2; x ^= x >> 1;
+		return x & 1;
+	}
+
+	// reduces a new row against the current rows and, if independent, eliminates its pivot from all others
+	void add_row(bitvector row, unsigned par)
+	{
+		for (size_t r = 0; r < rows.size(); ++r)
+			if (getbit(row, pivots[r]))
+			{
+				for (unsigned k = 0; k < 8; ++k)
+					row[k] ^= rows[r][k];
+				par ^= parities[r];
+			}
+		unsigned pivot = 0;
+		while (pivot < 512 && !getbit(row, pivot))
+			++pivot;
+		if (pivot == 512)
+		{
+			if (par)
+				throw std::runtime_error("Inconsistent bit relations");
+			return;
+		}
+		for (size_t r = 0; r < rows.size(); ++r)
+			if (getbit(rows[r], pivot))
+			{
+				for (unsigned k = 0; k < 8; ++k)
+					rows[r][k] ^= row[k];
+				parities[r] ^= par;
+			}
+		rows.push_back(row);
+		parities.push_back(par);
+		pivots.push_back(pivot);
+	}
+};
+
+#endif // UBC_BLOCKGEN_HPP
@@ -0,0 +1,199 @@
+/***
+* Copyright 2017 Marc Stevens <marc@marc-stevens.nl>, Dan Shumow <danshu@microsoft.com>
+* Distributed under the MIT Software License.
+* See accompanying file LICENSE.txt or copy at
+* https://opensource.org/licenses/MIT
+***/
+
+#ifndef UBC_CHECK_DISPATCH_HPP
+#define UBC_CHECK_DISPATCH_HPP
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "aligned_arena.hpp"
+#include "cpu_features.hpp"
+#include "fast_rng.hpp"
+#include "sha1_expand.hpp"
+
+extern "C"
+{
+#include "ubc_check.h"
+}
+
+// runtime selection of the ubc_check variants, so that one binary runs on every cpu of a fleet.
+// each SIMD variant is compiled with #pragma GCC target for its own instruction set, whatever the
+// target flags of the build (see TARGET=x86-portable in Makefile.local), and is only offered
+// when the running cpu supports it. A tool that uses this links the ubc_check_lanes_* wrappers
+// of common/_ubc_check_simd_*.cpp (or its own), next to the library's generated kernels.
+// The SIMD wrappers are kept free of C++ library headers: inline functions compiled there with
+// the SIMD flags could be picked by the linker for the rest of the program, which would then
+// fault on cpus without that instruction set.
+
+// W[80 * lanes] and dvmask[DVMASKSIZE * lanes] are SoA arrays aligned to the vector size:
+// word t of block j is W[t * lanes + j]
+typedef void (*ubc_check_lanes_fn)(const uint32_t* W, uint32_t* dvmask);
+
+#if defined(HAVE_MMX)
+void ubc_check_lanes_mmx64(const uint32_t* W, uint32_t* dvmask);
+#endif
+#if defined(HAVE_SSE)
+void ubc_check_lanes_sse128(const uint32_t* W, uint32_t* dvmask);
+#endif
+#if defined(HAVE_AVX)
+void ubc_check_lanes_avx256(const uint32_t* W, uint32_t* dvmask);
+#endif
+#if defined(HAVE_AVX512)
+void ubc_check_lanes_avx512(const uint32_t* W, uint32_t* dvmask);
+#endif
+#if defined(HAVE_NEON)
+void ubc_check_lanes_neon128(const uint32_t* W, uint32_t* dvmask);
+#endif
+// the vector extension variants of simd_vec.h, compiled for the target flags, in tools built with UBC_CHECK_VEC
+#if defined(UBC_CHECK_VEC)
+void ubc_check_lanes_vec4(const uint32_t* W, uint32_t* dvmask);
+void ubc_check_lanes_vec8(const uint32_t* W, uint32_t* dvmask);
+void ubc_check_lanes_vec16(const uint32_t* W, uint32_t* dvmask);
+void ubc_check_lanes_vec32(const uint32_t* W, uint32_t* dvmask);
+#endif
+
+struct ubc_check_kernel
+{
+	const char* name;
+	unsigned lanes;
+	ubc_check_lanes_fn check;
+	bool supported; // by the running cpu
+};
+
+inline void ubc_check_lanes_scalar(const uint32_t* W, uint32_t* dvmask)
+{
+	ubc_check(W, dvmask);
+}
+
+// all variants compiled in: the intrinsics ones widest first, then the vector extension ones and
+// the library's scalar ubc_check last
+inline std::vector<ubc_check_kernel> compiled_ubc_check_kernels()
+{
+	std::vector<ubc_check_kernel> ret;
+	cpu_features cpu = detect_cpu_features();
+	(void)cpu;
+#if defined(HAVE_AVX512)
+	ubc_check_kernel avx512 = { "avx512", 16, ubc_check_lanes_avx512, cpu.avx512f };
+	ret.push_back(avx512);
+#endif
+#if defined(HAVE_AVX)
+	ubc_check_kernel avx256 = { "avx256", 8, ubc_check_lanes_avx256, cpu.avx2 };
+	ret.push_back(avx256);
+#endif
+#if defined(HAVE_SSE)
+	ubc_check_kernel sse128 = { "sse128", 4, ubc_check_lanes_sse128, cpu.sse2 };
+	ret.push_back(sse128);
+#endif
+#if defined(HAVE_NEON)
+	// NEON is part of the target flags on arm, there is no runtime detection
+	ubc_check_kernel neon128 = { "neon128", 4, ubc_check_lanes_neon128, true };
+	ret.push_back(neon128);
+#endif
+#if defined(HAVE_MMX)
+	ubc_check_kernel mmx64 = { "mmx64", 2, ubc_check_lanes_mmx64, cpu.mmx };
+	ret.push_back(mmx64);
+#endif
+#if defined(UBC_CHECK_VEC)
+	ubc_check_kernel vec[4] = {
+		{ "vec32", 32, ubc_check_lanes_vec32, true }, { "vec16", 16, ubc_check_lanes_vec16, true },
+		{ "vec8", 8, ubc_check_lanes_vec8, true }, { "vec4", 4, ubc_check_lanes_vec4, true } };
+	ret.insert(ret.end(), vec, vec + 4);
+#endif
+	ubc_check_kernel scalar = { "scalar", 1, ubc_check_lanes_scalar, true };
+	ret.push_back(scalar);
+	return ret;
+}
+
+// the variants the running cpu supports, in the same order
+inline std::vector<ubc_check_kernel> available_ubc_check_kernels()
+{
+	std::vector<ubc_check_kernel> all = compiled_ubc_check_kernels(), ret;
+	for (size_t i = 0; i < all.size(); ++i)
+		if (all[i].supported)
+			ret.push_back(all[i]);
+	return ret;
+}
+
+// returns false if there is no available variant of that name
+inline bool find_ubc_check_kernel(const std::string& name, ubc_check_kernel& kernel)
+{
+	std::vector<ubc_check_kernel> kernels = available_ubc_check_kernels();
+	for (size_t i = 0; i < kernels.size(); ++i)
+		if (name == kernels[i].name)
+		{
+			kernel = kernels[i];
+			return true;
+		}
+	return false;
+}
+
+// the time per block of a variant on 'blocks' random expanded blocks, the best of 'reps' runs
+inline double time_ubc_check_kernel(const ubc_check_kernel& kernel, size_t blocks, unsigned reps, uint32_t& x)
+{
+	const size_t calls = std::max<size_t>(1, blocks / kernel.lanes), lanes = kernel.lanes;
+	aligned_arena<uint32_t> W(calls * 80 * lanes), dvmask(DVMASKSIZE * lanes);
+	fast_rng rng(0x75626363);
+	for (size_t c = 0; c < calls; ++c)
+	{
+		uint32_t* Wc = &W[c * 80 * lanes];
+		rng.fill(Wc, 16 * lanes * sizeof(uint32_t));
+		sha1_expand_soa(Wc, lanes);
+	}
+	double best = 0;
+	for (unsigned r = 0; r < reps; ++r)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (size_t c = 0; c < calls; ++c)
+		{
+			kernel.check(&W[c * 80 * lanes], &dvmask[0]);
+			x += dvmask[0];
+		}
+		double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / double(calls * lanes);
+		if (r == 0 || sec < best)
+			best = sec;
+	}
+	return best;
+}
+
+// the fastest available variant, measured once on first use (a few milliseconds);
+// the environment variable UBC_CHECK_KERNEL forces one by name
+inline const ubc_check_kernel& dispatch_ubc_check_kernel()
+{
+	struct selector
+	{
+		ubc_check_kernel kernel;
+		selector()
+		{
+			std::vector<ubc_check_kernel> kernels = available_ubc_check_kernels();
+			kernel = kernels.back();
+			const char* forced = std::getenv("UBC_CHECK_KERNEL");
+			if (forced && find_ubc_check_kernel(forced, kernel))
+				return;
+			uint32_t x = 0;
+			double best = 0;
+			for (size_t k = 0; k < kernels.size(); ++k)
+			{
+				double sec = time_ubc_check_kernel(kernels[k], 4096, 3, x);
+				if (k == 0 || sec < best)
+				{
+					best = sec;
+					kernel = kernels[k];
+				}
+			}
+		}
+	};
+	static const selector selected;
+	return selected.kernel;
+}
+
+#endif // UBC_CHECK_DISPATCH_HPP
@@ -0,0 +1,136 @@
+/***
+* Copyright 2017 Marc Stevens <marc@marc-stevens.nl>, Dan Shumow <danshu@microsoft.com>
+* Distributed under the MIT Software License.
+* See accompanying file LICENSE.txt or copy at
+* https://opensource.org/licenses/MIT
+***/
+
+#ifndef UBC_VERIFY_BATCH_HPP
+#define UBC_VERIFY_BATCH_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "ubc_blockgen.hpp"
+
+extern "C"
+{
+#include "ubc_check.h"
+}
+
+// a reference ubc_check for many blocks at once: the unavoidable bit relations of every DV in
+// sha1_dvs are evaluated branch free over a batch of blocks in SoA layout, one relation at a time
+// over 16 lanes, so that the compiler vectorizes the lane loops. ubc_check_verify instead checks
+// one block with a chain of data dependent branches that mispredict on random input.
+// verify() is const, one instance can be shared by threads.
+// the relations come from the ubcdatafiles logs parse_bitrel generates ubc_check from; whether they
+// describe the same ubc_check as the compiled in ubc_check_verify is for the caller to check.
+class ubc_verify_batch
+{
+public:
+	// returns false if some DV of sha1_dvs has no relations in 'dvs'
+	bool init(const std::vector<ubc_dv_relations>& dvs)
+	{
+		checks.clear();
+		for (unsigned i = 0; sha1_dvs[i].dvType != 0; ++i)
+		{
+			size_t d = 0;
+			while (d < dvs.size() && !(dvs[d].dvType == sha1_dvs[i].dvType && dvs[d].dvK == sha1_dvs[i].dvK && dvs[d].dvB == sha1_dvs[i].dvB))
+				++d;
+			if (d == dvs.size())
+				return false;
+			dv_check c;
+			c.maski = unsigned(sha1_dvs[i].maski);
+			c.maskb = unsigned(sha1_dvs[i].maskb);
+			for (size_t r = 0; r < dvs[d].relations.size(); ++r)
+			{
+				relation rel;
+				rel.parity = dvs[d].relations[r][80] & 1;
+				for (unsigned t = 0; t < 80; ++t)
+					for (unsigned b = 0; b < 32; ++b)
+						if ((dvs[d].relations[r][t] >> b) & 1)
+							rel.terms.push_back(term(t, b));
+				c.relations.push_back(rel);
+			}
+			checks.push_back(c);
+		}
+		return !checks.empty();
+	}
+
+	size_t dvs() const { return checks.size(); }
+
+	// W[t * lanes + j] is word t of block j, sets dvmask[i * lanes + j] as ubc_check does for block j
+	void verify(const uint32_t* W, size_t lanes, uint32_t* dvmask) const
+	{
+		memset(dvmask, 0, DVMASKSIZE * lanes * sizeof(uint32_t));
+		size_t j = 0;
+		for (; j + chunk <= lanes; j += chunk)
+			verify_lanes<chunk>(W + j, lanes, dvmask + j);
+		for (; j < lanes; ++j)
+			verify_lanes<1>(W + j, lanes, dvmask + j);
+	}
+
+private:
+	struct term
+	{
+		unsigned t, b;
+		term(unsigned t, unsigned b) : t(t), b(b) {}
+	};
+	struct relation
+	{
+		uint32_t parity;
+		std::vector<term> terms;
+	};
+	struct dv_check
+	{
+		unsigned maski, maskb;
+		std::vector<relation> relations;
+	};
+
+	// lanes per vectorized step: fixed trip counts over local arrays let -O2 vectorize without
+	// alias checks or scalar epilogues
+	static const size_t chunk = 16;
+
+	std::vector<dv_check> checks;
+
+	template<size_t N>
+	void verify_lanes(const uint32_t* W, size_t lanes, uint32_t* dvmask) const
+	{
+		for (size_t c = 0; c < checks.size(); ++c)
+		{
+			uint32_t ok[N], acc[N];
+			for (size_t j = 0; j < N; ++j)
+				ok[j] = 1;
+			const std::vector<relation>& rels = checks[c].relations;
+			for (size_t r = 0; r < rels.size(); ++r)
+			{
+				for (size_t j = 0; j < N; ++j)
+					acc[j] = rels[r].parity;
+				for (size_t k = 0; k < rels[r].terms.size(); ++k)
+				{
+					const uint32_t* Wt = W + rels[r].terms[k].t * lanes;
+					const unsigned b = rels[r].terms[k].b;
+					for (size_t j = 0; j < N; ++j)
+						acc[j] ^= Wt[j] >> b;
+				}
+				// bit 0 of acc is set where the relation does not hold
+				uint32_t any = 0;
+				for (size_t j = 0; j < N; ++j)
+				{
+					ok[j] &= ~acc[j];
+					any |= ok[j];
+				}
+				// random blocks fail a relation with probability 1/2, most DVs are done after a few
+				if (!(any & 1))
+					break;
+			}
+			uint32_t* mask = dvmask + checks[c].maski * lanes;
+			const unsigned maskb = checks[c].maskb;
+			for (size_t j = 0; j < N; ++j)
+				mask[j] |= (ok[j] & 1) << maskb;
+		}
+	}
+};
+
+#endif // UBC_VERIFY_BATCH_HPP
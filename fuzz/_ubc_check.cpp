@@ -0,0 +1,12 @@
+/***
+* Copyright 2017 Marc Stevens <marc@marc-stevens.nl>, Dan Shumow <danshu@microsoft.com>
+* Distributed under the MIT Software License.
+* See accompanying file LICENSE.txt or copy at
+* https://opensource.org/licenses/MIT
+***/
+
+
+// the scalar ubc_check, which ../common/ubc_check_dispatch.hpp wraps as ubc_check_lanes_scalar
+extern "C" {
+#include "../../lib/ubc_check.c"
+}
@@ -0,0 +1,167 @@
+/***
+* Copyright 2017 Marc Stevens <marc@marc-stevens.nl>, Dan Shumow <danshu@microsoft.com>
+* Distributed under the MIT Software License.
+* See accompanying file LICENSE.txt or copy at
+* https://opensource.org/licenses/MIT
+***/
+
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <ctime>
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+
+#include "ubc_check_fuzz.h"
+#include "../common/fast_rng.hpp"
+#include "../common/ubc_blockgen.hpp"
+
+using namespace std;
+
+namespace po = boost::program_options;
+namespace fs = boost::filesystem;
+
+// driver for the fuzz target without libFuzzer: replays corpus files and crash reproducers, runs
+// random inputs in which blocks crafted to satisfy all unavoidable bit conditions of a DV (and
+// near misses one bit away) are mixed in, and writes such blocks as a seed corpus for libFuzzer
+
+bool run_file(const string& path)
+{
+	ifstream ifs(path.c_str(), ios::binary);
+	if (!ifs)
+	{
+		cerr << "Could not open " << path << endl;
+		return false;
+	}
+	vector<uint8_t> data((istreambuf_iterator<char>(ifs)), istreambuf_iterator<char>());
+	LLVMFuzzerTestOneInput(data.empty() ? 0 : &data[0], data.size());
+	return true;
+}
+
+void store_block_be(const uint32_t m[16], uint8_t* out)
+{
+	for (unsigned i = 0; i < 16; ++i)
+		for (unsigned j = 0; j < 4; ++j)
+			out[4 * i + j] = uint8_t(m[i] >> (24 - 8 * j));
+}
+
+int main(int argc, char** argv)
+{
+	vector<string> inputs;
+	string ubcdir, seedsdir;
+	uint64_t rounds, seed;
+
+	po::options_description desc("Allowed options");
+	desc.add_options()
+		("help,h", "Show options")
+		("input", po::value<vector<string>>(&inputs), "Files or directories of inputs to replay")
+		("random,r", po::value<uint64_t>(&rounds)->default_value(0), "Run this many random inputs of 1 to 32 blocks")
+		("seed,s", po::value<uint64_t>(&seed), "Seed for --random (default: time)")
+		("ubcdir", po::value<string>(&ubcdir), "Directory with the unavoidable bit relations of the DVs, mixes crafted blocks into --random")
+		("seeds", po::value<string>(&seedsdir), "Write a seed corpus of crafted blocks per DV to this directory (requires --ubcdir)")
+		;
+	po::positional_options_description pos;
+	pos.add("input", -1);
+	po::variables_map vm;
+	po::store(po::command_line_parser(argc, argv).options(desc).positional(pos).run(), vm);
+	po::notify(vm);
+
+	if (vm.count("help") || (inputs.empty() && rounds == 0 && seedsdir.empty()))
+	{
+		cout << "Usage: " << argv[0] << " [options] [<corpus file or directory>...]" << endl << desc << endl;
+		return vm.count("help") ? 0 : 2;
+	}
+
+	const vector<ubc_check_kernel>& impls = ubc_check_impls();
+	cout << "Checking";
+	for (size_t k = 0; k < impls.size(); ++k)
+		cout << " " << impls[k].name;
+	cout << " against ubc_check_verify." << endl;
+
+	vector<ubc_dv_relations> dvs;
+	vector<ubc_block_generator> generators;
+	if (!ubcdir.empty())
+	{
+		dvs = load_ubc_relations(ubcdir);
+		if (dvs.empty())
+		{
+			cerr << "No unavoidable bit relations found in " << ubcdir << endl;
+			return 2;
+		}
+		for (size_t d = 0; d < dvs.size(); ++d)
+			generators.push_back(ubc_block_generator(dvs[d]));
+	}
+	if (!vm.count("seed"))
+		seed = uint64_t(time(0));
+	fast_rng rng(seed);
+
+	if (!seedsdir.empty())
+	{
+		if (generators.empty())
+		{
+			cerr << "--seeds requires --ubcdir" << endl;
+			return 2;
+		}
+		fs::create_directories(seedsdir);
+		// per DV a block that passes its conditions and one that misses a single bit
+		for (size_t d = 0; d < generators.size(); ++d)
+			for (unsigned variant = 0; variant < 2; ++variant)
+			{
+				uint32_t m[16];
+				uint8_t block[64];
+				generators[d].generate(rng, m);
+				if (variant)
+					m[rng() % 16] ^= uint32_t(1) << (rng() % 32);
+				store_block_be(m, block);
+				string name = dvs[d].name();
+				for (size_t i = 0; i < name.size(); ++i)
+					if (name[i] == '(' || name[i] == ')' || name[i] == ',')
+						name[i] = '_';
+				ofstream ofs((seedsdir + "/" + name + (variant ? "near" : "pass")).c_str(), ios::binary);
+				ofs.write(reinterpret_cast<const char*>(block), sizeof(block));
+			}
+		cout << "Wrote " << 2 * generators.size() << " seeds to " << seedsdir << "." << endl;
+	}
+
+	uint64_t files = 0;
+	for (size_t i = 0; i < inputs.size(); ++i)
+	{
+		if (fs::is_directory(inputs[i]))
+		{
+			for (fs::recursive_directory_iterator it(inputs[i]), end; it != end; ++it)
+				if (fs::is_regular_file(it->status()))
+					files += run_file(it->path().string()) ? 1 : 0;
+		}
+		else
+			files += run_file(inputs[i]) ? 1 : 0;
+	}
+	if (files)
+		cout << "Replayed " << files << " inputs without discrepancies." << endl;
+
+	if (rounds)
+	{
+		uint64_t crafted = 0;
+		vector<uint8_t> data(64 * ubc_fuzz_max_blocks);
+		for (uint64_t r = 0; r < rounds; ++r)
+		{
+			size_t blocks = 1 + rng() % ubc_fuzz_max_blocks;
+			rng.fill(&data[0], 64 * blocks);
+			for (size_t b = 0; b < blocks && !generators.empty(); ++b)
+				if (rng() & 1)
+				{
+					uint32_t m[16];
+					generators[rng() % generators.size()].generate(rng, m);
+					if (rng() & 1)
+						m[rng() % 16] ^= uint32_t(1) << (rng() % 32);
+					store_block_be(m, &data[64 * b]);
+					++crafted;
+				}
+			LLVMFuzzerTestOneInput(&data[0], 64 * blocks);
+		}
+		cout << "Ran " << rounds << " random inputs (" << crafted << " crafted blocks, seed " << seed << ") without discrepancies." << endl;
+	}
+	return 0;
+}
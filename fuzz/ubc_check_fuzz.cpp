@@ -0,0 +1,110 @@
+/***
+* Copyright 2017 Marc Stevens <marc@marc-stevens.nl>, Dan Shumow <danshu@microsoft.com>
+* Distributed under the MIT Software License.
+* See accompanying file LICENSE.txt or copy at
+* https://opensource.org/licenses/MIT
+***/
+
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+
+#include "ubc_check_fuzz.h"
+
+// differential fuzz target: every input is split into 64-byte message blocks (big endian words, the
+// last one zero padded), each block is expanded and checked by ubc_check, every SIMD ubc_check and
+// ubc_check_verify; any disagreement in any lane aborts with the offending block
+// ubc_check_verify tests the unavoidable bit conditions of each DV with a chain of branches, so the
+// coverage feedback guides the fuzzer towards blocks satisfying more and more conditions of a DV
+
+static std::vector<ubc_check_kernel> make_ubc_check_impls()
+{
+	std::vector<ubc_check_kernel> impls = available_ubc_check_kernels();
+	// the dispatcher lists the scalar ubc_check last
+	std::rotate(impls.begin(), impls.end() - 1, impls.end());
+	return impls;
+}
+
+const std::vector<ubc_check_kernel>& ubc_check_impls()
+{
+	static const std::vector<ubc_check_kernel> impls = make_ubc_check_impls();
+	return impls;
+}
+
+namespace {
+
+	inline uint32_t rotate_left(const uint32_t x, const unsigned n)
+	{
+		return (x << n) | (x >> (32 - n));
+	}
+
+	void load_expand_block(const uint8_t* data, size_t size, uint32_t W[80])
+	{
+		uint8_t block[64] = { 0 };
+		memcpy(block, data, std::min<size_t>(size, 64));
+		for (unsigned i = 0; i < 16; ++i)
+			W[i] = (uint32_t(block[4 * i]) << 24) | (uint32_t(block[4 * i + 1]) << 16) | (uint32_t(block[4 * i + 2]) << 8) | uint32_t(block[4 * i + 3]);
+		for (unsigned i = 16; i < 80; ++i)
+			W[i] = rotate_left(W[i - 3] ^ W[i - 8] ^ W[i - 14] ^ W[i - 16], 1);
+	}
+
+	void print_dvs(const char* label, uint32_t mask, unsigned maski)
+	{
+		fprintf(stderr, "%s = 0x%08x:", label, mask);
+		for (int i = 0; sha1_dvs[i].dvType != 0; ++i)
+			if (unsigned(sha1_dvs[i].maski) == maski && ((mask >> sha1_dvs[i].maskb) & 1))
+				fprintf(stderr, " %s(%d,%d)", sha1_dvs[i].dvType == 1 ? "I" : "II", sha1_dvs[i].dvK, sha1_dvs[i].dvB);
+		fprintf(stderr, "\n");
+	}
+
+	void report_mismatch(const ubc_check_kernel& impl, unsigned lane, size_t block, const uint32_t W[80], unsigned maski, uint32_t got, uint32_t expected)
+	{
+		fprintf(stderr, "%s lane %u disagrees with ubc_check_verify on input block %u:\n", impl.name, lane, unsigned(block));
+		fprintf(stderr, "MSGBLK = { 0x%08x", W[0]);
+		for (unsigned i = 1; i < 16; ++i)
+			fprintf(stderr, ", 0x%08x", W[i]);
+		fprintf(stderr, " };\n");
+		print_dvs("dvmask       ", got, maski);
+		print_dvs("dvmask_verify", expected, maski);
+	}
+
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+	const std::vector<ubc_check_kernel>& impls = ubc_check_impls();
+
+	size_t blocks = std::min(ubc_fuzz_max_blocks, std::max<size_t>(1, (size + 63) / 64));
+	std::vector<uint32_t> W(blocks * 80), expected(blocks * DVMASKSIZE);
+	for (size_t b = 0; b < blocks; ++b)
+	{
+		load_expand_block(data + 64 * b, (size > 64 * b) ? size - 64 * b : 0, &W[b * 80]);
+		ubc_check_verify(&W[b * 80], &expected[b * DVMASKSIZE]);
+	}
+
+	for (size_t k = 0; k < impls.size(); ++k)
+	{
+		const unsigned lanes = impls[k].lanes;
+		// the SIMD variants load and store whole aligned vectors
+		aligned_arena<uint32_t> laneW(80 * lanes), lanemask(DVMASKSIZE * lanes);
+		// every block is checked in lane 0 once and the other lanes carry the following blocks
+		for (size_t b = 0; b < blocks; ++b)
+		{
+			for (unsigned j = 0; j < lanes; ++j)
+				for (unsigned i = 0; i < 80; ++i)
+					laneW[i * lanes + j] = W[((b + j) % blocks) * 80 + i];
+			impls[k].check(&laneW[0], &lanemask[0]);
+			for (unsigned j = 0; j < lanes; ++j)
+			{
+				size_t lb = (b + j) % blocks;
+				for (unsigned i = 0; i < DVMASKSIZE; ++i)
+					if (lanemask[i * lanes + j] != expected[lb * DVMASKSIZE + i])
+					{
+						report_mismatch(impls[k], j, lb, &W[lb * 80], i, lanemask[i * lanes + j], expected[lb * DVMASKSIZE + i]);
+						abort();
+					}
+			}
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,33 @@
+/***
+* Copyright 2017 Marc Stevens <marc@marc-stevens.nl>, Dan Shumow <danshu@microsoft.com>
+* Distributed under the MIT Software License.
+* See accompanying file LICENSE.txt or copy at
+* https://opensource.org/licenses/MIT
+***/
+
+#ifndef UBC_CHECK_FUZZ_H
+#define UBC_CHECK_FUZZ_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "../common/ubc_check_dispatch.hpp"
+
+extern "C"
+{
+	void ubc_check_verify(const uint32_t W[80], uint32_t dvmask[DVMASKSIZE]);
+
+	int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+}
+
+// every implementation is one of the ubc_check variants of ../common/ubc_check_dispatch.hpp,
+// called on 'lanes' expanded messages in aligned SoA arrays
+
+// the variants compiled in that the running cpu supports, the scalar ubc_check first
+const std::vector<ubc_check_kernel>& ubc_check_impls();
+
+// input blocks beyond this are ignored, the widest implementation gets distinct blocks in every lane
+const size_t ubc_fuzz_max_blocks = 32;
+
+#endif // UBC_CHECK_FUZZ_H
@@ -11,11 +11,23 @@
 #include <vector>
 #include <iomanip>
 #include <array>
+#include <string>
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <stdexcept>
+#include <map>
+#include <sstream>
 
 #include <boost/nondet_random.hpp>
 #include <boost/random.hpp>
 #include <boost/timer.hpp>
 #include <boost/progress.hpp>
+#include <boost/program_options.hpp>
 
 #include <boost/accumulators/accumulators.hpp>
 #include <boost/accumulators/statistics/stats.hpp>
@@ -23,6 +35,24 @@
 #include <boost/accumulators/statistics/median.hpp>
 #include <boost/accumulators/statistics/variance.hpp>
 
+#ifdef __linux__
+#include <unistd.h>
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+#include "../common/cycle_counter.hpp"
+#include "../common/perf_counters.hpp"
+#include "../common/aligned_arena.hpp"
+#include "../common/ubc_blockgen.hpp"
+#include "../common/sha1_baselines.hpp"
+#include "../common/sha1_expand.hpp"
+#include "../common/bench_results.hpp"
+#include "../common/fast_rng.hpp"
+#include "../common/git_workload.hpp"
+#include "recompress_bench.hpp"
+
 extern "C"
 {
 #include "sha1.h"
@@ -396,40 +426,49 @@ void sha1_compression_W(uint32_t ihv[5], const uint32_t W[80])
 using namespace std;
 using namespace boost::accumulators;
 
+namespace po = boost::program_options;
+
 inline double LogBase2(double x)
 {
 	return (log(x) / log(2.0));
 }
 
-inline uint32_t rotate_left(const uint32_t x, const unsigned n)
-{
-	return (x << n) | (x >> (32 - n));
-}
-
-template<typename RNG>
-void gen_W(RNG& rng, uint32_t W[80])
+void gen_W(fast_rng& rng, uint32_t W[80])
 {
-	for (unsigned i = 0; i < 16; ++i)
-		W[i] = rng();
-	for (unsigned i = 16; i < 80; ++i)
-		W[i] = rotate_left(W[i - 3] ^ W[i - 8] ^ W[i - 14] ^ W[i - 16], 1);
+	rng.fill(W, 16 * sizeof(uint32_t));
+	sha1_expand(W);
 }
 
-int main(int argc, char** argv)
-{
-	boost::random::random_device seeder;
-	boost::random::mt19937 rng(seeder);
-
-	SHA1_CTX ctx;
-	SHA1reg_CTX ctxreg;
-	unsigned char hash[20];
 
-	vector<char> buffer;
+typedef accumulator_set<double, stats<tag::mean, tag::variance, tag::median> > perf_accumulator;
 
-	boost::timer timer;
+// the three ways libcheck hashes messages: SHA-1 without collision detection,
+// collision detection without unavoidable bit conditions and full collision detection
+enum hash_mode { HASH_REGULAR = 0, HASH_DC_NOUBC = 1, HASH_DC_UBC = 2 };
 
+inline void SHA1DCInit_mode(SHA1_CTX* ctx, int mode)
+{
+	SHA1DCInit(ctx);
+	SHA1DCSetCallback(ctx, nc_callback);
+	if (mode == HASH_REGULAR)
+		SHA1DCSetUseDetectColl(ctx, 0);
+	else if (mode == HASH_DC_NOUBC)
+		SHA1DCSetUseUBC(ctx, 0);
+}
 
+double median_of(vector<double> samples)
+{
+	if (samples.empty())
+		return 0;
+	std::sort(samples.begin(), samples.end());
+	size_t n = samples.size();
+	if (n & 1)
+		return samples[n / 2];
+	return (samples[n / 2 - 1] + samples[n / 2]) / 2;
+}
 
+int verify_ubc_check(fast_rng& rng)
+{
 	uint32_t dvmask[DVMASKSIZE], dvmask_test[DVMASKSIZE];
 
 	cout << "Verifying ubc_check() against ubc_check_verify():" << endl;
@@ -460,41 +499,152 @@ int main(int argc, char** argv)
 			}
 	}
 	cout << "Found no discrepancies between ubc_check() and ubc_check_verify()." << endl << endl;
+	return 0;
+}
+
+// adds the counter values of one measured section to a running total
+void add_counters(perf_counter_values& total, const perf_counter_values& section)
+{
+	for (unsigned i = 0; i < PERF_COUNTER_COUNT; ++i)
+	{
+		total.value[i] += section.value[i];
+		total.valid[i] = section.valid[i];
+	}
+}
+
+// the fastest SHA-1 compression without collision detection, the reference for overhead ratios
+struct baseline_result
+{
+	string name;
+	unsigned lanes;
+	double blocks_per_sec;
+	double cycles_per_block;
+};
+
+// verifies each optimized SHA-1 baseline the cpu supports against sha1_compression and
+// measures its throughput; the naive sha1_compression is always included as fallback
+baseline_result measure_sha1_baselines(fast_rng& rng, unsigned reps, bench_results& results, uint32_t& x)
+{
+	const size_t groups = 1024;
+	const size_t blocks = size_t(1) << 22;
+	vector<sha1_baseline> kernels = available_sha1_baselines();
+	sha1_baseline naive = { "naive", 1, sha1_compression };
+	kernels.push_back(naive);
+
+	cout << "Measuring SHA-1 baselines without collision detection (cpu features: " << detect_cpu_features().describe() << "):" << endl;
+	cout << "kernel\tlanes\t" << cycle_counter_unit() << "/block\tblocks/s\tratio to naive" << endl;
+
+	baseline_result fastest;
+	fastest.blocks_per_sec = 0;
+	double naive_per_block = 0;
+	vector<baseline_result> measured;
+	for (size_t k = 0; k < kernels.size(); ++k)
+	{
+		const unsigned lanes = kernels[k].lanes;
+		vector<uint32_t> ihv(5 * lanes), m(16 * lanes);
+		bool ok = true;
+		for (unsigned test = 0; test < 256 && ok; ++test)
+		{
+			for (size_t i = 0; i < ihv.size(); ++i)
+				ihv[i] = rng();
+			for (size_t i = 0; i < m.size(); ++i)
+				m[i] = rng();
+			vector<uint32_t> ref(ihv);
+			kernels[k].compress(&ihv[0], &m[0]);
+			for (unsigned j = 0; j < lanes; ++j)
+			{
+				uint32_t IHV[5], M[16];
+				for (unsigned i = 0; i < 5; ++i)
+					IHV[i] = ref[i * lanes + j];
+				for (unsigned i = 0; i < 16; ++i)
+					M[i] = m[i * lanes + j];
+				sha1_compression(IHV, M);
+				for (unsigned i = 0; i < 5; ++i)
+					ok = ok && (IHV[i] == ihv[i * lanes + j]);
+			}
+		}
+		if (!ok)
+		{
+			cerr << "SHA-1 baseline " << kernels[k].name << " does not match sha1_compression, skipped" << endl;
+			continue;
+		}
+
+		aligned_arena<uint32_t> msgs(groups * 16 * lanes);
+		rng.fill(msgs.data(), msgs.size() * sizeof(uint32_t));
+		vector<double> cycles, seconds;
+		for (unsigned r = 0; r < reps; ++r)
+		{
+			std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+			uint64_t start = cycle_counter();
+			for (size_t i = 0, g = 0; i < blocks; i += lanes)
+			{
+				kernels[k].compress(&ihv[0], &msgs[g * 16 * lanes]);
+				if (++g == groups)
+					g = 0;
+			}
+			uint64_t end = cycle_counter();
+			seconds.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count());
+			cycles.push_back(double(end - start) / double(blocks));
+			x += ihv[0];
+		}
+
+		results.record(string("baseline/") + kernels[k].name, "per_block", cycle_counter_unit(), false, cycles);
+
+		baseline_result res;
+		res.name = kernels[k].name;
+		res.lanes = lanes;
+		res.cycles_per_block = median_of(cycles);
+		res.blocks_per_sec = double(blocks) / median_of(seconds);
+		measured.push_back(res);
+		if (res.blocks_per_sec > fastest.blocks_per_sec)
+			fastest = res;
+		if (res.name == "naive")
+			naive_per_block = res.cycles_per_block;
+	}
+	for (size_t k = 0; k < measured.size(); ++k)
+		cout << measured[k].name << "\t" << measured[k].lanes << "\t" << measured[k].cycles_per_block << "\t2^" << LogBase2(measured[k].blocks_per_sec)
+			<< "\t" << naive_per_block / measured[k].cycles_per_block << endl;
+	cout << "Fastest baseline: " << fastest.name << endl << endl;
+	return fastest;
+}
 
+void measure_compression(fast_rng& rng, const baseline_result& fastest, bench_results& results, uint32_t& x, perf_counters* counters)
+{
 	const size_t testCnt = 17;
 	size_t iterCnt = 1 << 24;
+	uint32_t dvmask[DVMASKSIZE];
+	boost::timer timer;
 
-	accumulator_set<double, stats<tag::mean, tag::variance, tag::median> > acc_ubc;
-	accumulator_set<double, stats<tag::mean, tag::variance, tag::median> > acc_sha;
-	accumulator_set<double, stats<tag::mean, tag::variance, tag::median> > acc_shawnome;
+	perf_accumulator acc_ubc;
+	perf_accumulator acc_sha;
+	perf_accumulator acc_shawnome;
+	perf_counter_values cnt_ubc, cnt_sha, cnt_shawnome;
+	vector<double> samples_ubc, samples_sha, samples_shawnome;
 
 	cout << "Measuring performance of ubc_check, SHA-1 Compress and SHA-1 Compress w/out message expansion." << endl;
 
-	uint32_t x = 0; // variable that accumulates results from inner loops to prevent them from being optimized away
-
 	boost::progress_display perf_pd(testCnt);
 
 	for (size_t k = 0; k < testCnt; k++, ++perf_pd)
 	{
-		vector< vector<uint32_t> > Wlist;
-		for (size_t i = 0; i < (1 << 20); ++i)
-		{
-			vector<uint32_t> W(80);
-			for (unsigned j = 0; j < 80; ++j)
-				W[j] = rng();
-			Wlist.push_back(W);
-		}
+		aligned_arena<uint32_t> Wlist(size_t(80) << 20);
+		rng.fill(Wlist.data(), Wlist.size() * sizeof(uint32_t));
 
+		if (counters)
+			counters->start();
 		timer.restart();
 		for (size_t j = 0; j < (iterCnt >> 20); ++j)
 			for (size_t i = 0; i < (1 << 20); ++i)
 			{
-				ubc_check(&Wlist[i][0], dvmask);
+				ubc_check(&Wlist[i * 80], dvmask);
 				x += dvmask[0];
 			}
 		double ubcchecktime = timer.elapsed();
+		if (counters)
+			add_counters(cnt_ubc, counters->stop());
 
 		acc_ubc(iterCnt/ubcchecktime);
+		samples_ubc.push_back(iterCnt/ubcchecktime);
 
 		uint32_t IHV[5], M[80];
 		for (unsigned i = 0; i < 5; ++i)
@@ -502,20 +652,30 @@ int main(int argc, char** argv)
 		for (unsigned i = 0; i < 80; ++i)
 			M[i] = rng();
 
+		if (counters)
+			counters->start();
 		timer.restart();
 		for (size_t i = 0; i < iterCnt; ++i)
 			sha1_compression(IHV, M);
 		double shatime = timer.elapsed();
+		if (counters)
+			add_counters(cnt_sha, counters->stop());
 
 		acc_sha(iterCnt/shatime);
+		samples_sha.push_back(iterCnt/shatime);
 
+		if (counters)
+			counters->start();
 		timer.restart();
 		for (size_t i = 0; i < (iterCnt); ++i)
 			sha1_compression_W(IHV, M);
 		double shawometime = timer.elapsed();
+		if (counters)
+			add_counters(cnt_shawnome, counters->stop());
 
 		x += IHV[0] + IHV[1] + IHV[2] + IHV[3] + IHV[4]; // prevent l
 		acc_shawnome(iterCnt/shawometime);
+		samples_shawnome.push_back(iterCnt/shawometime);
 	}
 
 	cout << "SHA-1 compress performance: ";
@@ -533,109 +693,777 @@ int main(int argc, char** argv)
 	cout << "mean 2^" << LogBase2(mean(acc_shawnome)) << " sha1 compress no ME/s (" << mean(acc_shawnome) / mean(acc_sha) << ") ";
 	cout << "variance " << variance(acc_shawnome) << endl;
 
-	size_t testcount = 128;
-	size_t mindata = 1 << 20;
+	results.record("compress/sha1", "rate", "blocks/s", true, samples_sha);
+	results.record("compress/ubc_check", "rate", "calls/s", true, samples_ubc);
+	results.record("compress/sha1_no_msgexp", "rate", "blocks/s", true, samples_shawnome);
 
-	for (size_t i = 11; i < 12; ++i)
-	{
-		buffer.resize(mindata);
+	cout << "Relative to the fastest SHA-1 baseline (" << fastest.name << ", 2^" << LogBase2(fastest.blocks_per_sec) << " blocks/s): ";
+	cout << "sha1 compress " << fastest.blocks_per_sec / median(acc_sha) << " baseline blocks, ";
+	cout << "ubc_check " << fastest.blocks_per_sec / median(acc_ubc) << " baseline blocks" << endl;
 
-		size_t minloop = mindata / (1<<i);
-		if (minloop == 0)
-			minloop = 1;
+	if (counters)
+	{
+		const double calls = double(testCnt) * double(iterCnt);
+		cout << "SHA-1 compress counters ";
+		cnt_sha.print(cout, calls, "sha1 compress");
+		cout << endl << "UBC Check counters ";
+		cnt_ubc.print(cout, calls, "ubc_check");
+		cout << endl << "SHA-1 compress w/o msgexp counters ";
+		cnt_shawnome.print(cout, calls, "sha1 compress no ME");
+		cout << endl;
+	}
+	cout << endl;
+}
 
-		double elap_noubc = 0;
-		double elap_ubc = 0;
-		double elap_reg = 0;
+// measures ubc_check over contiguous arenas of expanded messages with working set sizes
+// chosen to sit in L1, L2 and the last level cache, and one that streams from DRAM
+void cache_benchmark(fast_rng& rng, bool hugepages, unsigned reps, bench_results& results, uint32_t& x, perf_counters* counters)
+{
+	const size_t calls = size_t(1) << 24;
+	uint32_t dvmask[DVMASKSIZE];
+	cache_sizes cs = detect_cache_sizes();
+	vector<working_set> sets = cache_working_sets(cs);
 
-		accumulator_set<double, stats<tag::mean, tag::variance, tag::median> > acc_shafullcd;
-		accumulator_set<double, stats<tag::mean, tag::variance, tag::median> > acc_shaubc;
-		accumulator_set<double, stats<tag::mean, tag::variance, tag::median> > acc_shareg;
+	cout << "Measuring ubc_check per working set (L1d " << (cs.l1d >> 10) << " KiB, L2 " << (cs.l2 >> 10) << " KiB, LLC " << (cs.llc >> 10) << " KiB):" << endl;
+	cout << "set\tbytes\tblocks\thugepages\t" << cycle_counter_unit() << "/ubc_check\tratio to " << sets.front().name << endl;
 
-		for (size_t n = 0; n < testCnt; n++)
+	double hot = 0;
+	for (size_t s = 0; s < sets.size(); ++s)
+	{
+		size_t blocks = sets[s].bytes / (80 * sizeof(uint32_t));
+		if (blocks == 0)
+			blocks = 1;
+		aligned_arena<uint32_t> arena(blocks * 80, hugepages);
+		for (size_t b = 0; b < blocks; ++b)
+			gen_W(rng, &arena[b * 80]);
+
+		vector<double> samples;
+		perf_counter_values cnt;
+		for (unsigned r = 0; r < reps; ++r)
 		{
-			for (size_t r = 0; r < testcount; ++r)
+			if (counters)
+				counters->start();
+			uint64_t start = cycle_counter();
+			for (size_t i = 0, b = 0; i < calls; ++i)
 			{
-				for (size_t j = 0; j < buffer.size(); ++j)
-					buffer[j] = rng();
+				ubc_check(&arena[b * 80], dvmask);
+				x += dvmask[0];
+				if (++b == blocks)
+					b = 0;
+			}
+			uint64_t end = cycle_counter();
+			if (counters)
+				add_counters(cnt, counters->stop());
+			samples.push_back(double(end - start) / double(calls));
+		}
 
-				timer.restart();
-				for (size_t k = 0; k < minloop; ++k)
-				{
-					SHA1DCInit(&ctx);
-					SHA1DCSetCallback(&ctx, nc_callback);
-					SHA1DCSetUseDetectColl(&ctx, 0);
-					SHA1DCUpdate(&ctx, &buffer[k * (1<<i)], 1<<i);
-					SHA1DCFinal(hash, &ctx);
-					x += hash[0];
-				}
-				elap_reg += timer.elapsed();
+		double percall = median_of(samples);
+		if (s == 0)
+			hot = percall;
+		results.record("cache/" + sets[s].name, "per_call", cycle_counter_unit(), false, samples);
+		cout << sets[s].name << "\t" << blocks * 80 * sizeof(uint32_t) << "\t" << blocks << "\t" << (arena.hugepages() ? "yes" : "no") << "\t" << percall << "\t" << percall / hot << endl;
+		if (counters)
+		{
+			cout << "\tcounters ";
+			cnt.print(cout, double(reps) * double(calls), "ubc_check");
+			cout << endl;
+		}
+	}
+	cout << endl;
+}
+
+// message sizes for the sweep: 0 (if in range) followed by 'steps' log-spaced sizes per doubling
+vector<size_t> sweep_sizes(size_t minsize, size_t maxsize, unsigned steps)
+{
+	vector<size_t> sizes;
+	if (steps == 0)
+		steps = 1;
+	if (minsize == 0)
+		sizes.push_back(0);
+	for (unsigned k = 0; ; ++k)
+	{
+		double size = std::floor(std::pow(2.0, double(k) / double(steps)) + 0.5);
+		if (size > double(maxsize))
+			break;
+		if (size < double(minsize) || (!sizes.empty() && sizes.back() >= size_t(size)))
+			continue;
+		sizes.push_back(size_t(size));
+	}
+	return sizes;
+}
+
+// hashes 'sweepdata' bytes (at least one message) per message size in each hash mode
+// and reports the median over 'reps' repetitions as cycles per hash and cycles per byte
+void message_size_sweep(const vector<size_t>& sizes, const vector<char>& buffer, size_t sweepdata, unsigned reps, const baseline_result& fastest, bench_results& results, ostream* csv, uint32_t& x, perf_counters* counters)
+{
+	SHA1_CTX ctx;
+	unsigned char hash[20];
 
-				timer.restart();
-				for (size_t k = 0; k < minloop; ++k)
+	cout << "Measuring SHA-1 regular, collision detection w/out UBC and w/ UBC for " << sizes.size() << " message sizes (" << cycle_counter_unit() << "):" << endl;
+	cout << "bytes\thashes\treg/hash\tnoubc/hash\tubc/hash\treg/byte\tnoubc/byte\tubc/byte\tnoubc/reg\tubc/reg\tubc/" << fastest.name << endl;
+	if (csv)
+		*csv << "bytes,hashes,reg_per_hash,noubc_per_hash,ubc_per_hash,reg_per_byte,noubc_per_byte,ubc_per_byte,noubc_over_reg,ubc_over_reg,ubc_over_fastest" << endl;
+	const double fastest_per_byte = fastest.cycles_per_block / 64;
+
+	for (size_t s = 0; s < sizes.size(); ++s)
+	{
+		const size_t size = sizes[s];
+		// the empty message is as costly as a 64-byte one: one compression
+		size_t hashes = sweepdata / (size == 0 ? 64 : size);
+		if (hashes == 0)
+			hashes = 1;
+		// successive messages are taken from successive positions in the buffer
+		size_t slots = (size == 0) ? 1 : buffer.size() / size;
+
+		vector<double> samples[3];
+		perf_counter_values cnt[3];
+		for (unsigned r = 0; r < reps; ++r)
+		{
+			for (int mode = HASH_REGULAR; mode <= HASH_DC_UBC; ++mode)
+			{
+				if (counters)
+					counters->start();
+				uint64_t start = cycle_counter();
+				for (size_t k = 0; k < hashes; ++k)
 				{
-					SHA1DCInit(&ctx);
-					SHA1DCSetCallback(&ctx, nc_callback);
-					SHA1DCSetUseUBC(&ctx, 0);
-					SHA1DCUpdate(&ctx, &buffer[k * (1<<i)], 1<<i);
+					SHA1DCInit_mode(&ctx, mode);
+					SHA1DCUpdate(&ctx, &buffer[(k % slots) * size], size);
 					SHA1DCFinal(hash, &ctx);
 					x += hash[0];
 				}
-				elap_noubc += timer.elapsed();
+				uint64_t end = cycle_counter();
+				if (counters)
+					add_counters(cnt[mode], counters->stop());
+				samples[mode].push_back(double(end - start) / double(hashes));
+			}
+		}
+
+		static const char* mode_name[3] = { "reg", "noubc", "ubc" };
+		double perhash[3], perbyte[3];
+		for (int mode = HASH_REGULAR; mode <= HASH_DC_UBC; ++mode)
+		{
+			results.record("sweep/" + to_string(size) + "/" + mode_name[mode], "per_hash", cycle_counter_unit(), false, samples[mode]);
+			perhash[mode] = median_of(samples[mode]);
+			perbyte[mode] = (size == 0) ? 0 : perhash[mode] / double(size);
+		}
+		double noubc_ratio = perhash[HASH_DC_NOUBC] / perhash[HASH_REGULAR];
+		double ubc_ratio = perhash[HASH_DC_UBC] / perhash[HASH_REGULAR];
+		double fastest_ratio = perbyte[HASH_DC_UBC] / fastest_per_byte;
+
+		cout << size << "\t" << hashes << "\t"
+			<< perhash[HASH_REGULAR] << "\t" << perhash[HASH_DC_NOUBC] << "\t" << perhash[HASH_DC_UBC] << "\t"
+			<< perbyte[HASH_REGULAR] << "\t" << perbyte[HASH_DC_NOUBC] << "\t" << perbyte[HASH_DC_UBC] << "\t"
+			<< noubc_ratio << "\t" << ubc_ratio << "\t" << fastest_ratio << endl;
+		if (csv)
+			*csv << size << "," << hashes << ","
+				<< perhash[HASH_REGULAR] << "," << perhash[HASH_DC_NOUBC] << "," << perhash[HASH_DC_UBC] << ","
+				<< perbyte[HASH_REGULAR] << "," << perbyte[HASH_DC_NOUBC] << "," << perbyte[HASH_DC_UBC] << ","
+				<< noubc_ratio << "," << ubc_ratio << "," << fastest_ratio << endl;
+		if (counters)
+		{
+			double units = double(reps) * double(hashes) * double(size == 0 ? 1 : size);
+			for (int mode = HASH_REGULAR; mode <= HASH_DC_UBC; ++mode)
+			{
+				cout << "\t" << mode_name[mode] << " counters ";
+				cnt[mode].print(cout, units, size == 0 ? "hash" : "SHA1DCUpdate byte");
+				cout << endl;
+			}
+		}
+	}
+	cout << endl;
+}
+
+// stores a block of host order words as the big-endian bytes SHA1DCUpdate reads
+inline void store_block_be(unsigned char* p, const uint32_t m[16])
+{
+	for (unsigned i = 0; i < 16; ++i)
+	{
+		p[4 * i] = (unsigned char)(m[i] >> 24);
+		p[4 * i + 1] = (unsigned char)(m[i] >> 16);
+		p[4 * i + 2] = (unsigned char)(m[i] >> 8);
+		p[4 * i + 3] = (unsigned char)(m[i]);
+	}
+}
+
+// hashes 'bytes' bytes as one message with full collision detection, returns the cycles taken
+// and (through 'seconds') the elapsed time
+uint64_t time_ubc_hashing(const unsigned char* data, size_t bytes, double& seconds, uint32_t& x)
+{
+	SHA1_CTX ctx;
+	unsigned char hash[20];
+	std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+	uint64_t start = cycle_counter();
+	SHA1DCInit_mode(&ctx, HASH_DC_UBC);
+	SHA1DCUpdate(&ctx, (const char*)(data), bytes);
+	SHA1DCFinal(hash, &ctx);
+	uint64_t end = cycle_counter();
+	seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+	x += hash[0];
+	return end - start;
+}
+
+// parses a comma separated list of unsigned integers such as "10,16,20"
+vector<unsigned> parse_unsigned_list(const string& str)
+{
+	vector<unsigned> ret;
+	stringstream ss(str);
+	string item;
+	while (getline(ss, item, ','))
+		if (!item.empty())
+			ret.push_back(unsigned(std::stoul(item)));
+	return ret;
+}
+
+// measures the cost of the recompression path: every 2^rate-th block of the hashed data is crafted
+// to pass the unavoidable bit conditions of one DV, all other blocks pass those of no DV at all,
+// so each crafted block costs exactly one recompression for that DV on top of the baseline
+int ubc_rate_benchmark(const vector<ubc_dv_relations>& dvs, const vector<unsigned>& rates, size_t bytes, unsigned reps, fast_rng& rng, bench_results& results, uint32_t& x)
+{
+	const size_t blocks = std::max(bytes / 64, size_t(1));
+	bytes = blocks * 64;
+	uint32_t m[16], W[80], dvmask[DVMASKSIZE];
+
+	cout << "Generating " << (bytes >> 20) << " MiB of filler blocks that pass no DV's unavoidable bit conditions..." << endl;
+	aligned_arena<unsigned char> filler(bytes), data(bytes);
+	for (size_t b = 0; b < blocks; ++b)
+	{
+		do
+		{
+			gen_W(rng, W);
+			for (unsigned i = 0; i < DVMASKSIZE; ++i)
+				dvmask[i] = 0;
+			ubc_check(W, dvmask);
+		} while (std::count(dvmask, dvmask + DVMASKSIZE, 0u) != DVMASKSIZE);
+		store_block_be(&filler[b * 64], W);
+	}
+
+	double seconds;
+	vector<double> basesamples;
+	for (unsigned r = 0; r < reps; ++r)
+		basesamples.push_back(double(time_ubc_hashing(filler.data(), bytes, seconds, x)) / double(bytes));
+	const double base = median_of(basesamples);
+	results.record("ubcrate/filler", "per_byte", cycle_counter_unit(), false, basesamples);
+	cout << "Baseline without recompressions: " << base << " " << cycle_counter_unit() << "/byte" << endl << endl;
+
+	cout << "DV\ttestt\trank\trate\thits\t" << cycle_counter_unit() << "/byte\tMB/s\tslowdown\t" << cycle_counter_unit() << "/hit\tblocks/hit" << endl;
+	// the cost per hit at the highest rate is the least noisy and is used for the per testt summary
+	map<int, vector<double> > testt_costs;
+	for (size_t d = 0; d < dvs.size(); ++d)
+	{
+		const ubc_dv_relations& dv = dvs[d];
+		int idx = -1;
+		for (int i = 0; sha1_dvs[i].dvType != 0; ++i)
+			if (sha1_dvs[i].dvType == dv.dvType && sha1_dvs[i].dvK == dv.dvK && sha1_dvs[i].dvB == dv.dvB)
+				idx = i;
+		if (idx < 0)
+		{
+			cout << dv.name() << " is not checked by this library, skipped" << endl;
+			continue;
+		}
+		const dv_info_t& info = sha1_dvs[idx];
+
+		ubc_block_generator gen(dv);
+		// the crafted blocks must trigger this DV in the library's ubc_check
+		for (unsigned k = 0; k < 64; ++k)
+		{
+			gen.generate(rng, m);
+			memcpy(W, m, sizeof(m));
+			sha1_expand(W);
+			for (unsigned i = 0; i < DVMASKSIZE; ++i)
+				dvmask[i] = 0;
+			ubc_check(W, dvmask);
+			if (0 == (dvmask[info.maski] & (uint32_t(1) << info.maskb)))
+			{
+				cerr << "Crafted block for " << dv.name() << " does not pass ubc_check(), are the ubcdatafiles those the library was generated from?" << endl;
+				return 1;
+			}
+		}
+
+		double besthits = 0;
+		for (size_t r = 0; r < rates.size(); ++r)
+		{
+			const size_t period = size_t(1) << rates[r];
+			const size_t hits = blocks / period;
+			if (hits == 0)
+			{
+				cout << dv.name() << "\t" << info.testt << "\t" << gen.rank() << "\t2^-" << rates[r] << "\tno hits in " << bytes << " bytes, increase --ubcdata" << endl;
+				continue;
+			}
+			memcpy(data.data(), filler.data(), bytes);
+			for (size_t b = period - 1; b < blocks; b += period)
+			{
+				gen.generate(rng, m);
+				store_block_be(&data[b * 64], m);
+			}
+
+			// each repetition hashes the filler right before the crafted data, so that the
+			// difference is not swamped by frequency changes or noise between repetitions
+			vector<double> samples, fillersamples, diffs, secs;
+			for (unsigned rep = 0; rep < reps; ++rep)
+			{
+				double filler_cycles = double(time_ubc_hashing(filler.data(), bytes, seconds, x));
+				double data_cycles = double(time_ubc_hashing(data.data(), bytes, seconds, x));
+				samples.push_back(data_cycles / double(bytes));
+				fillersamples.push_back(filler_cycles / double(bytes));
+				diffs.push_back(data_cycles - filler_cycles);
+				secs.push_back(seconds);
+			}
+			results.record("ubcrate/" + dv.name() + "/2^-" + to_string(rates[r]), "per_byte", cycle_counter_unit(), false, samples);
+			double perbyte = median_of(samples);
+			double mbps = double(bytes) / median_of(secs) / double(1 << 20);
+			double perhit = median_of(diffs) / double(hits);
+			cout << dv.name() << "\t" << info.testt << "\t" << gen.rank() << "\t2^-" << rates[r] << "\t" << hits << "\t"
+				<< perbyte << "\t" << mbps << "\t" << perbyte / median_of(fillersamples) << "\t" << perhit << "\t" << perhit / (base * 64) << endl;
+			if (double(hits) > besthits)
+			{
+				if (besthits > 0)
+					testt_costs[info.testt].pop_back();
+				testt_costs[info.testt].push_back(perhit);
+				besthits = double(hits);
+			}
+		}
+	}
+
+	cout << endl << "Recompression cost per testt (median over DVs at their highest rate):" << endl;
+	cout << "testt\tDVs\t" << cycle_counter_unit() << "/hit\tblocks/hit" << endl;
+	for (map<int, vector<double> >::const_iterator it = testt_costs.begin(); it != testt_costs.end(); ++it)
+	{
+		double perhit = median_of(it->second);
+		cout << it->first << "\t" << it->second.size() << "\t" << perhit << "\t" << perhit / (base * 64) << endl;
+	}
+	cout << endl;
+	return 0;
+}
 
-				timer.restart();
-				for (size_t k = 0; k < minloop; ++k)
+// hashes a workload of git objects the way git does, "<type> <size>\0" header and content in one
+// context per object, per object type and hash mode; unlike the sweep this includes the per hash
+// costs that dominate small objects: SHA1DCInit, the header and the padding block of SHA1DCFinal
+void git_object_benchmark(const git_workload_model& model, size_t bytes, unsigned reps, fast_rng& rng, bench_results& results, uint32_t& x)
+{
+	SHA1_CTX ctx;
+	unsigned char hash[20];
+	git_workload workload;
+	workload.generate(model, bytes, rng);
+	const vector<git_object>& objects = workload.objects();
+	uint64_t count[git_object_types], content[git_object_types];
+	workload.type_totals(count, content);
+
+	cout << "Hashing git objects: " << model.describe() << endl;
+	cout << objects.size() << " objects with " << workload.content_bytes() << " content and " << workload.header_bytes() << " header bytes (" << cycle_counter_unit() << "):" << endl;
+	cout << "type\tmode\tobjects\tavg size\tper object\tper byte\tobjects/s\tMB/s" << endl;
+
+	static const char* mode_name[3] = { "reg", "noubc", "ubc" };
+	// each type on its own, then all objects together
+	for (unsigned type = 0; type <= git_object_types; ++type)
+	{
+		const uint64_t n = (type < git_object_types) ? count[type] : uint64_t(objects.size());
+		const uint64_t b = (type < git_object_types) ? content[type] : workload.content_bytes();
+		const string type_name = (type < git_object_types) ? git_object_type_name(type) : "all";
+		if (n == 0)
+			continue;
+		for (int mode = HASH_REGULAR; mode <= HASH_DC_UBC; ++mode)
+		{
+			vector<double> cycles, objects_per_sec, mbps;
+			for (unsigned r = 0; r < reps; ++r)
+			{
+				std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+				uint64_t start = cycle_counter();
+				for (size_t i = 0; i < objects.size(); ++i)
 				{
-					SHA1DCInit(&ctx);
-					SHA1DCSetCallback(&ctx, nc_callback);
-	//				SHA1DCSetUseUBC(&ctx, 1);
-					SHA1DCUpdate(&ctx, &buffer[k*(1<<i)], 1<<i);
+					if (type < git_object_types && objects[i].type != type)
+						continue;
+					SHA1DCInit_mode(&ctx, mode);
+					SHA1DCUpdate(&ctx, workload.header(objects[i]), objects[i].header_size);
+					SHA1DCUpdate(&ctx, workload.contents(objects[i]), objects[i].size);
 					SHA1DCFinal(hash, &ctx);
 					x += hash[0];
 				}
-				elap_ubc += timer.elapsed();
-
+				uint64_t end = cycle_counter();
+				double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+				cycles.push_back(double(end - start) / double(n));
+				objects_per_sec.push_back(double(n) / seconds);
+				mbps.push_back(double(b) / seconds / double(1 << 20));
 			}
+			double perobject = median_of(cycles);
+			cout << type_name << "\t" << mode_name[mode] << "\t" << n << "\t" << b / n << "\t" << perobject << "\t" << (b ? perobject * double(n) / double(b) : 0)
+				<< "\t" << median_of(objects_per_sec) << "\t" << median_of(mbps) << endl;
+			string key = "git/" + type_name + "/" + mode_name[mode];
+			results.record(key, "per_object", cycle_counter_unit(), false, cycles);
+			results.record(key, "objects_per_sec", "objects/s", true, objects_per_sec);
+			results.record(key, "throughput", "MB/s", true, mbps);
+		}
+	}
+	cout << endl;
+}
+
+// parses a duration such as "90", "90s", "15m", "12h" or "3d" into seconds; returns false if
+// it is not a positive number with one of these units
+bool parse_duration(const string& str, double& seconds)
+{
+	const char* begin = str.c_str();
+	char* end = 0;
+	double value = std::strtod(begin, &end);
+	if (end == begin || !(value > 0) || !std::isfinite(value))
+		return false;
+	string unit(end);
+	if (unit.empty() || unit == "s")
+		seconds = value;
+	else if (unit == "m")
+		seconds = value * 60;
+	else if (unit == "h")
+		seconds = value * 3600;
+	else if (unit == "d")
+		seconds = value * 86400;
+	else
+		return false;
+	return true;
+}
+
+uint64_t current_rss_bytes()
+{
+#ifdef __linux__
+	ifstream ifs("/proc/self/statm");
+	uint64_t size = 0, resident = 0;
+	if (ifs >> size >> resident)
+		return resident * uint64_t(sysconf(_SC_PAGESIZE));
+#endif
+	return 0;
+}
+
+// voluntary and involuntary context switches summed over all threads of this process
+void current_context_switches(uint64_t& voluntary, uint64_t& involuntary)
+{
+	voluntary = involuntary = 0;
+#if defined(__unix__) || defined(__APPLE__)
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == 0)
+	{
+		voluntary = usage.ru_nvcsw;
+		involuntary = usage.ru_nivcsw;
+	}
+#endif
+}
 
-			elap_noubc /= double(minloop)*double(testcount);
-			elap_ubc /= double(minloop)*double(testcount);
-			elap_reg /= double(minloop)*double(testcount);
+// each soak thread owns a context and a buffer and publishes its hashed byte count;
+// counters are padded to a cache line so the sampling thread causes no false sharing
+struct soak_counter
+{
+	std::atomic<uint64_t> bytes;
+	char padding[64 - sizeof(std::atomic<uint64_t>)];
+};
 
-			acc_shafullcd(elap_noubc);
-			acc_shaubc(elap_ubc);
-			acc_shareg(elap_reg);
+void soak_worker(uint32_t seed, unsigned stream, size_t buffersize, soak_counter* counter, const std::atomic<bool>* stop)
+{
+	const size_t chunk = 1 << 20;
+	fast_rng rng(seed, stream);
+	vector<char> buffer(std::max(buffersize, chunk));
+	rng.fill(&buffer[0], buffer.size());
 
+	SHA1_CTX ctx;
+	unsigned char hash[20];
+	SHA1DCInit_mode(&ctx, HASH_DC_UBC);
+	size_t pos = 0;
+	while (!stop->load(std::memory_order_relaxed))
+	{
+		SHA1DCUpdate(&ctx, &buffer[pos], chunk);
+		counter->bytes.fetch_add(chunk, std::memory_order_relaxed);
+		pos += chunk;
+		if (pos + chunk > buffer.size())
+		{
+			// vary the data between passes over the buffer
+			pos = 0;
+			(*reinterpret_cast<uint32_t*>(&buffer[0])) += 1;
 		}
+	}
+	SHA1DCFinal(hash, &ctx);
+}
 
-		cout << (1 << i) << "\t : SHA Regular Median: " << median(acc_shareg) << "s \tMean: " << mean(acc_shareg) << "s \t Variance: " << variance(acc_shareg) << "s" << endl;
-		cout << (1 << i) << "\t : SHA Collision Detection w/out UBC Median: " << median(acc_shafullcd) << "s " << median(acc_shafullcd) / median(acc_shareg) << "(no ubc/reg) \tMean: " << mean(acc_shafullcd) << "s " << mean(acc_shafullcd) / mean(acc_shareg) << "(no ubc/reg) \t Variance: " << variance(acc_shafullcd) << "s" << endl;
-		cout << (1 << i) << "\t : SHA Collision Detection w/ UBC Median: " << median(acc_shaubc) << "s " << median(acc_shaubc) / median(acc_shareg) << "(no ubc/reg) \tMean: " << mean(acc_shaubc) << "s " << mean(acc_shaubc) / mean(acc_shareg) << "(no ubc/reg) \t Variance: " << variance(acc_shaubc) << "s" << endl;
+// hashes with full collision detection on 'threads' threads for 'duration' seconds,
+// samples throughput, RSS and context switches every second into a CSV time series and
+// flags stalls (a thread made no progress) and drift (the throughput over the last 'window'
+// seconds dropped more than 'maxdrift' below that of the first 'window' seconds)
+int soak_test(double duration, unsigned threads, size_t buffersize, unsigned window, double maxdrift, ostream& csv, fast_rng& rng)
+{
+	if (threads == 0)
+		threads = 1;
+	if (window == 0)
+		window = 1;
+
+	cout << "Performing soak test for " << duration << "s on " << threads << " threads (buffer " << (buffersize >> 20) << " MiB per thread)..." << endl;
+	csv << "time,total_MBps,min_thread_MBps,max_thread_MBps,window_MBps,rss_bytes,voluntary_ctxsw,involuntary_ctxsw,stall,drift" << endl;
+
+	vector<soak_counter> counters(threads);
+	for (unsigned t = 0; t < threads; ++t)
+		counters[t].bytes.store(0);
+	std::atomic<bool> stop(false);
+	vector<std::thread> workers;
+	// one seed, an independent stream per thread
+	uint32_t seed = rng();
+	for (unsigned t = 0; t < threads; ++t)
+		workers.push_back(std::thread(soak_worker, seed, t, buffersize, &counters[t], &stop));
+
+	vector<uint64_t> lastbytes(threads, 0);
+	deque<double> recent;
+	double baseline = 0, baselinesum = 0, recentsum = 0;
+	uint64_t lastvcsw, lastivcsw, rss_max = 0;
+	current_context_switches(lastvcsw, lastivcsw);
+	unsigned stalls = 0, drifts = 0;
+
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::time_point last = start;
+	for (unsigned sec = 1; sec <= unsigned(duration); ++sec)
+	{
+		std::this_thread::sleep_until(start + std::chrono::seconds(sec));
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		double elapsed = std::chrono::duration<double>(now - last).count();
+		last = now;
+
+		double total = 0, minthread = 0, maxthread = 0;
+		bool stall = false;
+		for (unsigned t = 0; t < threads; ++t)
+		{
+			uint64_t bytes = counters[t].bytes.load(std::memory_order_relaxed);
+			double mbps = double(bytes - lastbytes[t]) / elapsed / double(1 << 20);
+			if (bytes == lastbytes[t])
+				stall = true;
+			lastbytes[t] = bytes;
+			total += mbps;
+			if (t == 0 || mbps < minthread)
+				minthread = mbps;
+			if (t == 0 || mbps > maxthread)
+				maxthread = mbps;
+		}
+
+		recent.push_back(total);
+		recentsum += total;
+		if (recent.size() > window)
+		{
+			recentsum -= recent.front();
+			recent.pop_front();
+		}
+		if (sec <= window)
+		{
+			baselinesum += total;
+			baseline = baselinesum / sec;
+		}
+		double windowmbps = recentsum / recent.size();
+		bool drift = sec > window && windowmbps < baseline * (1 - maxdrift);
+
+		uint64_t rss = current_rss_bytes(), vcsw, ivcsw;
+		current_context_switches(vcsw, ivcsw);
+		rss_max = std::max(rss_max, rss);
+
+		stalls += stall;
+		drifts += drift;
+		csv << sec << "," << total << "," << minthread << "," << maxthread << "," << windowmbps << "," << rss << ","
+			<< (vcsw - lastvcsw) << "," << (ivcsw - lastivcsw) << "," << int(stall) << "," << int(drift) << endl;
+		lastvcsw = vcsw;
+		lastivcsw = ivcsw;
+
+		if (stall)
+			cout << sec << "s: stall, at least one thread made no progress" << endl;
+		if (sec % window == 0)
+			cout << sec << "s: " << windowmbps << " MB/s over the last " << recent.size() << "s (baseline " << baseline << " MB/s) RSS " << (rss >> 20) << " MiB" << (drift ? " DRIFT" : "") << endl;
 	}
-	// finally act on x to prevent this variable to be optimized away
-	if (x)
-		cout << " " << flush;
-	else
-		cout << " ";
-	return 0;
 
-	cout << "Performing endurance test..." << endl;
+	stop = true;
+	for (unsigned t = 0; t < threads; ++t)
+		workers[t].join();
+
 	uint64_t total = 0;
-	SHA1DCInit(&ctx);
-	SHA1DCSetCallback(&ctx, nc_callback);
-	buffer.resize(1 << 30);
-	timer.restart();
-	while (true)
+	for (unsigned t = 0; t < threads; ++t)
+		total += counters[t].bytes.load();
+	cout << "Hashed " << (total >> 30) << " GiB in " << unsigned(duration) << "s, "
+		<< stalls << " stalled seconds, " << drifts << " seconds with throughput drift, maximum RSS " << (rss_max >> 20) << " MiB." << endl;
+	return (stalls || drifts) ? 1 : 0;
+}
+
+int main(int argc, char** argv)
+{
+	size_t sweepmin, sweepmax, sweepdata;
+	unsigned sweepsteps, reps;
+	string sweepcsv;
+	string soakduration, soakcsv;
+	unsigned soakthreads, soakwindow;
+	size_t soakbuffer;
+	double soakdrift;
+	string ubcdir, ubcrates;
+	string resultspath;
+	vector<string> ubcdvs;
+	size_t ubcdata;
+	string gitfit;
+	size_t gitdata;
+	git_workload_model gitmodel;
+
+	po::options_description desc("Allowed options");
+	desc.add_options()
+		("help,h", "Show options")
+		("noverify", "Skip verification of ubc_check() against ubc_check_verify()")
+		("nocompress", "Skip ubc_check and SHA-1 compression performance measurements")
+		("nosweep", "Skip the message size sweep")
+		("counters", "Report hardware performance counters per measured section")
+		("cachebench", "Measure ubc_check with inputs resident in L1, L2, LLC and DRAM")
+		("hugepages", "Request transparent huge pages for the cache benchmark inputs")
+		("sweepmin", po::value<size_t>(&sweepmin)->default_value(0), "Smallest message size in bytes of the sweep")
+		("sweepmax", po::value<size_t>(&sweepmax)->default_value(size_t(1) << 30), "Largest message size in bytes of the sweep")
+		("sweepsteps", po::value<unsigned>(&sweepsteps)->default_value(1), "Number of message sizes per doubling in the sweep")
+		("sweepdata", po::value<size_t>(&sweepdata)->default_value(size_t(1) << 24), "Bytes to hash per message size and mode (at least one message)")
+		("reps", po::value<unsigned>(&reps)->default_value(5), "Repetitions per sweep message size and mode, cache benchmark working set and UBC rate (the median is reported)")
+		("sweepcsv", po::value<string>(&sweepcsv), "Also write the sweep results as CSV to this file")
+		("ubcrate", "Measure collision detection on data with blocks crafted to pass a DV's unavoidable bit conditions")
+		("ubcdir", po::value<string>(&ubcdir)->default_value("../ubcdatafiles/3565"), "Directory with the unavoidable bit relations of the DVs")
+		("ubcdv", po::value<vector<string> >(&ubcdvs)->multitoken(), "DVs to craft blocks for, e.g. I(43,0) or II_52_0 (default: all)")
+		("ubcrates", po::value<string>(&ubcrates)->default_value("10,16,20"), "Comma separated rates r at which 1 in 2^r blocks is crafted")
+		("ubcdata", po::value<size_t>(&ubcdata)->default_value(size_t(1) << 28), "Bytes to hash per DV and rate")
+		("recompressbench", "Compare the generic recompression per DV with the one generated in sha1_recompress.cinc")
+		("dvtablebench", "Compare the detection per hit on the legacy sha1_dvs table and on its hot/cold split")
+		("gitobjects", "Measure hashing git objects as git does, per object type")
+		("gitdata", po::value<size_t>(&gitdata)->default_value(size_t(1) << 26), "Content bytes of the git object workload")
+		("gitfit", po::value<string>(&gitfit), "Fit the git object sizes to the output of git cat-file --batch-all-objects --batch-check='%(objecttype) %(objectsize)' in this file")
+		("compressibility", po::value<double>(&gitmodel.compressibility)->default_value(gitmodel.compressibility), "Fraction of git blobs with text instead of random content")
+		("results", po::value<string>(&resultspath), "Append results as JSON lines to this file, or to <host>_<cpu>.jsonl in this directory")
+		("soak", po::value<string>(&soakduration), "Only perform a soak test for this duration (e.g. 3600, 90m, 12h, 3d)")
+		("threads", po::value<unsigned>(&soakthreads)->default_value(std::thread::hardware_concurrency()), "Number of soak test threads")
+		("soakbuffer", po::value<size_t>(&soakbuffer)->default_value(size_t(1) << 26), "Buffer size in bytes per soak test thread")
+		("soakcsv", po::value<string>(&soakcsv)->default_value("soak.csv"), "Soak test time series CSV file")
+		("soakwindow", po::value<unsigned>(&soakwindow)->default_value(60), "Soak test window in seconds for baseline and drift throughput")
+		("soakdrift", po::value<double>(&soakdrift)->default_value(0.05), "Flag drift when the window throughput drops this fraction below the baseline")
+		;
+	po::variables_map vm;
+	po::store(po::command_line_parser(argc, argv).options(desc).run(), vm);
+	po::notify(vm);
+
+	if (vm.count("help"))
+	{
+		cout << desc << endl;
+		return 0;
+	}
+
+	boost::random::random_device seeder;
+	fast_rng rng((uint64_t(seeder()) << 32) | seeder());
+
+	if (vm.count("soak"))
 	{
-		for (size_t i = 0; i < buffer.size(); i += 4)
-			(*reinterpret_cast<uint32_t*>(&buffer[i])) = rng();
-		SHA1DCUpdate(&ctx, &buffer[0], buffer.size());
-		total += buffer.size();
-		if (timer.elapsed() > 60)
+		// before the CSV file is truncated
+		double duration = 0;
+		if (!parse_duration(soakduration, duration))
+		{
+			cerr << "Invalid soak duration: " << soakduration << " (e.g. 3600, 90m, 12h, 3d)" << endl;
+			return 2;
+		}
+		ofstream ofs_csv(soakcsv.c_str(), ios::out | ios::trunc);
+		if (!ofs_csv)
 		{
-			cout << "Hashed " << (total >> 30) << " GB..." << endl;
-			timer.restart();
+			cerr << "Could not open " << soakcsv << endl;
+			return 1;
 		}
+		return soak_test(duration, soakthreads, soakbuffer, soakwindow, soakdrift, ofs_csv, rng);
 	}
 
+	bench_results results;
+	if (vm.count("results") && !results.open(resultspath, "libcheck"))
+	{
+		cerr << "Could not open " << results.filename() << endl;
+		return 1;
+	}
+
+	vector<char> buffer;
+	perf_counters counters;
+	perf_counters* pcounters = 0;
+	if (vm.count("counters"))
+	{
+		if (counters.available())
+			pcounters = &counters;
+		else
+			cout << "Hardware performance counters are not available (see /proc/sys/kernel/perf_event_paranoid)." << endl;
+	}
+
+	uint32_t x = 0; // variable that accumulates results from inner loops to prevent them from being optimized away
+
+	if (!vm.count("noverify"))
+		if (verify_ubc_check(rng))
+			return 1;
+
+	baseline_result fastest;
+	if (!vm.count("nocompress") || !vm.count("nosweep"))
+		fastest = measure_sha1_baselines(rng, reps, results, x);
+
+	if (!vm.count("nocompress"))
+		measure_compression(rng, fastest, results, x, pcounters);
+
+	if (vm.count("cachebench"))
+		cache_benchmark(rng, vm.count("hugepages") != 0, reps, results, x, pcounters);
+
+	if (vm.count("ubcrate"))
+	{
+		vector<ubc_dv_relations> dvs = load_ubc_relations(ubcdir), selected;
+		for (size_t d = 0; d < dvs.size(); ++d)
+		{
+			string name = dvs[d].name();
+			string stem = string(dvs[d].dvType == 1 ? "I" : "II") + "_" + to_string(dvs[d].dvK) + "_" + to_string(dvs[d].dvB);
+			if (ubcdvs.empty() || std::find(ubcdvs.begin(), ubcdvs.end(), name) != ubcdvs.end() || std::find(ubcdvs.begin(), ubcdvs.end(), stem) != ubcdvs.end())
+				selected.push_back(dvs[d]);
+		}
+		if (selected.empty())
+		{
+			cerr << "No DVs selected from " << ubcdir << endl;
+			return 1;
+		}
+		if (ubc_rate_benchmark(selected, parse_unsigned_list(ubcrates), ubcdata, reps, rng, results, x))
+			return 1;
+	}
 
+	if (vm.count("recompressbench"))
+	{
+		if (recompress_benchmark(reps, rng, results, x))
+			return 1;
+	}
+
+	if (vm.count("dvtablebench"))
+	{
+		if (dv_table_benchmark(reps, rng, results, x))
+			return 1;
+	}
+
+	if (vm.count("gitobjects"))
+	{
+		if (vm.count("gitfit"))
+		{
+			ifstream ifs(gitfit.c_str());
+			string error;
+			if (!ifs || !gitmodel.fit(ifs, error))
+			{
+				cerr << "Could not fit the git object sizes to " << gitfit << (error.empty() ? "" : ": ") << error << endl;
+				return 1;
+			}
+		}
+		git_object_benchmark(gitmodel, gitdata, reps, rng, results, x);
+	}
+
+	if (!vm.count("nosweep"))
+	{
+		ofstream ofs_csv;
+		if (vm.count("sweepcsv"))
+		{
+			ofs_csv.open(sweepcsv.c_str(), ios::out | ios::trunc);
+			if (!ofs_csv)
+			{
+				cerr << "Could not open " << sweepcsv << endl;
+				return 1;
+			}
+		}
+
+		vector<size_t> sizes = sweep_sizes(sweepmin, sweepmax, sweepsteps);
+		buffer.resize(std::max(sweepmax, size_t(1) << 20));
+		rng.fill(&buffer[0], buffer.size());
+
+		message_size_sweep(sizes, buffer, sweepdata, reps, fastest, results, vm.count("sweepcsv") ? &ofs_csv : 0, x, pcounters);
+	}
+
+	// finally act on x to prevent this variable to be optimized away
+	if (x)
+		cout << " " << flush;
+	else
+		cout << " ";
+	return 0;
 }
@@ -0,0 +1,272 @@
+/***
+* Copyright 2017 Marc Stevens <marc@marc-stevens.nl>, Dan Shumow <danshu@microsoft.com>
+* Distributed under the MIT Software License.
+* See accompanying file LICENSE.txt or copy at
+* https://opensource.org/licenses/MIT
+***/
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../common/aligned_arena.hpp"
+#include "../common/cycle_counter.hpp"
+#include "../common/sha1_expand.hpp"
+#include "../common/sha1dc_recompress.hpp"
+#include "recompress_bench.hpp"
+
+using namespace std;
+
+#if defined(HAVE_SHA1_RECOMPRESS) || defined(SHA1_DVS_HOT)
+namespace {
+
+	double median_of(vector<double> samples)
+	{
+		std::sort(samples.begin(), samples.end());
+		size_t n = samples.size();
+		if (n == 0)
+			return 0;
+		return (n & 1) ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+	}
+
+}
+#endif
+
+#ifdef HAVE_SHA1_RECOMPRESS
+// the generic recompression xors all 80 difference words into the message and replays the steps
+// in loops, the generated one is unrolled with the differences as constants. Both are first
+// checked to agree on the input ihv, and to detect the collision when given the output ihv of the
+// message with the differences
+int recompress_benchmark(unsigned reps, fast_rng& rng, bench_results& results, uint32_t& x)
+{
+	const unsigned blocks = 64, calls = 1 << 14;
+	aligned_arena<uint32_t> W(blocks * 80), states(blocks * 80 * 5), ihvout(blocks * 5);
+	for (unsigned b = 0; b < blocks; ++b)
+	{
+		rng.fill(&W[b * 80], 16 * sizeof(uint32_t));
+		sha1_expand(&W[b * 80]);
+		rng.fill(&ihvout[b * 5], 5 * sizeof(uint32_t));
+		sha1_compression_states(&ihvout[b * 5], &W[b * 80], reinterpret_cast<uint32_t(*)[5]>(&states[b * 80 * 5]));
+	}
+
+	cout << "Recompression per DV (" << cycle_counter_unit() << "/call):" << endl;
+	cout << "DV\ttestt\twords\tgeneric\tspecialized\tspeedup" << endl;
+	vector<double> allgeneric, allspecialized;
+	for (unsigned i = 0; sha1_dvs[i].dvType != 0; ++i)
+	{
+		const dv_info_t& dv = sha1_dvs[i];
+		const unsigned t = unsigned(dv.testt);
+		const string name = string(dv.dvType == 1 ? "I" : "II") + "(" + to_string(dv.dvK) + "," + to_string(dv.dvB) + ")";
+		const unsigned words = unsigned(80 - std::count(dv.dm, dv.dm + 80, 0u));
+
+		for (unsigned b = 0; b < blocks; ++b)
+		{
+			uint32_t W2[80], ihvin2[5], ihvout2[5], ihvin3[5];
+			for (unsigned j = 0; j < 80; ++j)
+				W2[j] = W[b * 80 + j] ^ dv.dm[j];
+			const uint32_t* state = &states[(b * 80 + t) * 5];
+			sha1_recompression_step(t, ihvin2, ihvout2, W2, state);
+			bool nocollision = sha1_recompress_dvs[i](&W[b * 80], state, &ihvout[b * 5], ihvin3) == 0;
+			bool sameihvin = std::equal(ihvin2, ihvin2 + 5, ihvin3);
+			if (!nocollision || !sameihvin || !sha1_recompress_dvs[i](&W[b * 80], state, ihvout2, ihvin3))
+			{
+				cerr << "The generated recompression of " << name << " does not agree with sha1_recompression_step()" << endl;
+				return 1;
+			}
+		}
+
+		vector<double> generic, specialized;
+		for (unsigned r = 0; r < reps; ++r)
+		{
+			uint64_t start = cycle_counter();
+			for (unsigned c = 0, b = 0; c < calls; ++c)
+			{
+				uint32_t W2[80], ihvin2[5], ihvout2[5];
+				for (unsigned j = 0; j < 80; ++j)
+					W2[j] = W[b * 80 + j] ^ dv.dm[j];
+				sha1_recompression_step(t, ihvin2, ihvout2, W2, &states[(b * 80 + t) * 5]);
+				x += ihvin2[0] + (0 == ((ihvout2[0] ^ ihvout[b * 5]) | (ihvout2[1] ^ ihvout[b * 5 + 1]) | (ihvout2[2] ^ ihvout[b * 5 + 2])
+					| (ihvout2[3] ^ ihvout[b * 5 + 3]) | (ihvout2[4] ^ ihvout[b * 5 + 4])));
+				if (++b == blocks)
+					b = 0;
+			}
+			uint64_t mid = cycle_counter();
+			for (unsigned c = 0, b = 0; c < calls; ++c)
+			{
+				uint32_t ihvin2[5];
+				x += sha1_recompress_dvs[i](&W[b * 80], &states[(b * 80 + t) * 5], &ihvout[b * 5], ihvin2);
+				x += ihvin2[0];
+				if (++b == blocks)
+					b = 0;
+			}
+			uint64_t end = cycle_counter();
+			generic.push_back(double(mid - start) / double(calls));
+			specialized.push_back(double(end - mid) / double(calls));
+		}
+		results.record("recompress/" + name + "/generic", "per_call", cycle_counter_unit(), false, generic);
+		results.record("recompress/" + name + "/specialized", "per_call", cycle_counter_unit(), false, specialized);
+		double g = median_of(generic), sp = median_of(specialized);
+		allgeneric.push_back(g);
+		allspecialized.push_back(sp);
+		cout << name << "\t" << t << "\t" << words << "\t" << g << "\t" << sp << "\t" << g / sp << endl;
+	}
+	double g = median_of(allgeneric), sp = median_of(allspecialized);
+	cout << "median\t\t\t" << g << "\t" << sp << "\t" << g / sp << endl << endl;
+	return 0;
+}
+#else
+int recompress_benchmark(unsigned, fast_rng&, bench_results&, uint32_t&)
+{
+	cout << "The library has no sha1_recompress.cinc, regenerate it with parse_bitrel for the recompression benchmark." << endl;
+	return 0;
+}
+#endif
+
+#ifdef SHA1_DVS_HOT
+namespace {
+
+	// the detection loop of sha1dc_check_block() on either table, with the generic recompression
+	template<typename DV>
+	bool detect_block(const DV& dv, const uint32_t W[80], const uint32_t states[80][5], const uint32_t ihvout[5])
+	{
+		uint32_t W2[80], ihvin2[5], ihvout2[5];
+		sha1dc_detail::apply_dv(dv, W, W2);
+		sha1_recompression_step(unsigned(dv.testt), ihvin2, ihvout2, W2, states[dv.testt]);
+		return 0 == ((ihvout2[0] ^ ihvout[0]) | (ihvout2[1] ^ ihvout[1]) | (ihvout2[2] ^ ihvout[2]) | (ihvout2[3] ^ ihvout[3]) | (ihvout2[4] ^ ihvout[4]));
+	}
+
+	bool detect_legacy(const uint32_t W[80], const uint32_t states[80][5], const uint32_t dvmask[DVMASKSIZE], const uint32_t ihvout[5])
+	{
+		for (unsigned i = 0; sha1_dvs[i].dvType != 0; ++i)
+			if (((dvmask[sha1_dvs[i].maski] >> sha1_dvs[i].maskb) & 1) && detect_block(sha1_dvs[i], W, states, ihvout))
+				return true;
+		return false;
+	}
+
+	bool detect_hot(const uint32_t W[80], const uint32_t states[80][5], const uint32_t dvmask[DVMASKSIZE], const uint32_t ihvout[5])
+	{
+		for (unsigned h = 0; h < DVCOUNT; ++h)
+			if (((dvmask[sha1_dvs_hot[h].maski] >> sha1_dvs_hot[h].maskb) & 1) && detect_block(sha1_dvs_hot[h], W, states, ihvout))
+				return true;
+		return false;
+	}
+
+}
+
+// the detection path of a block that passed the ubc_check of one DV, on the legacy sha1_dvs table and
+// on its hot/cold split; both with the generic recompression, so that only the table layout differs.
+// Measured with all data in cache, and per call after evicting L1 and L2 as between the rare hits
+// of real data, which is where the 344 bytes per DV of the legacy table cost
+int dv_table_benchmark(unsigned reps, fast_rng& rng, bench_results& results, uint32_t& x)
+{
+	const unsigned blocks = 64, calls = 1 << 12, coldcalls = 64;
+	aligned_arena<uint32_t> W(blocks * 80), states(blocks * 80 * 5), ihvout(blocks * 5);
+	for (unsigned b = 0; b < blocks; ++b)
+	{
+		rng.fill(&W[b * 80], 16 * sizeof(uint32_t));
+		sha1_expand(&W[b * 80]);
+		rng.fill(&ihvout[b * 5], 5 * sizeof(uint32_t));
+		sha1_compression_states(&ihvout[b * 5], &W[b * 80], reinterpret_cast<uint32_t(*)[5]>(&states[b * 80 * 5]));
+	}
+	auto block_states = [&](unsigned b) { return reinterpret_cast<const uint32_t(*)[5]>(&states[b * 80 * 5]); };
+
+	// reading twice the L2 size evicts both L1 and L2
+	cache_sizes cs = detect_cache_sizes();
+	aligned_arena<uint64_t> evict(2 * cs.l2 / sizeof(uint64_t));
+	rng.fill(&evict[0], evict.size() * sizeof(uint64_t));
+	auto evict_caches = [&]()
+	{
+		uint64_t sum = 0;
+		for (size_t i = 0; i < evict.size(); i += 8)
+			sum += evict[i];
+		x += uint32_t(sum);
+	};
+
+	cout << "Detection per hit on the legacy sha1_dvs (" << DVCOUNT * sizeof(dv_info_t) << " bytes) and the hot table (" << DVCOUNT * sizeof(dv_hot_t)
+		<< " bytes) with sparse differences (" << cycle_counter_unit() << "/hit):" << endl;
+	cout << "DV\ttestt\tlegacy\thot\tlegacy cold\thot cold\tcold speedup" << endl;
+	vector<double> alllegacy, allhot, allcoldlegacy, allcoldhot;
+	for (unsigned h = 0; h < DVCOUNT; ++h)
+	{
+		const dv_hot_t& dv = sha1_dvs_hot[h];
+		const dv_info_t& info = sha1_dvs[dv.dv];
+		const string name = string(info.dvType == 1 ? "I" : "II") + "(" + to_string(info.dvK) + "," + to_string(info.dvB) + ")";
+		uint32_t dvmask[DVMASKSIZE] = {};
+		dvmask[dv.maski] = uint32_t(1) << dv.maskb;
+
+		// both find the collision with the output ihv of the message with the differences, and
+		// nothing with that of a random one
+		for (unsigned b = 0; b < blocks; ++b)
+		{
+			uint32_t W2[80], ihvin2[5], ihvout2[5];
+			sha1dc_detail::apply_dv(info, &W[b * 80], W2);
+			sha1_recompression_step(unsigned(info.testt), ihvin2, ihvout2, W2, block_states(b)[info.testt]);
+			if (info.testt != dv.testt || info.maski != dv.maski || info.maskb != dv.maskb
+				|| !detect_legacy(&W[b * 80], block_states(b), dvmask, ihvout2) || !detect_hot(&W[b * 80], block_states(b), dvmask, ihvout2)
+				|| detect_legacy(&W[b * 80], block_states(b), dvmask, &ihvout[b * 5]) || detect_hot(&W[b * 80], block_states(b), dvmask, &ihvout[b * 5]))
+			{
+				cerr << "The hot table entry of " << name << " does not agree with sha1_dvs" << endl;
+				return 1;
+			}
+		}
+
+		vector<double> legacy, hot, coldlegacy, coldhot;
+		for (unsigned r = 0; r < reps; ++r)
+		{
+			uint64_t start = cycle_counter();
+			for (unsigned c = 0, b = 0; c < calls; ++c)
+			{
+				x += detect_legacy(&W[b * 80], block_states(b), dvmask, &ihvout[b * 5]);
+				if (++b == blocks)
+					b = 0;
+			}
+			uint64_t mid = cycle_counter();
+			for (unsigned c = 0, b = 0; c < calls; ++c)
+			{
+				x += detect_hot(&W[b * 80], block_states(b), dvmask, &ihvout[b * 5]);
+				if (++b == blocks)
+					b = 0;
+			}
+			uint64_t end = cycle_counter();
+			legacy.push_back(double(mid - start) / double(calls));
+			hot.push_back(double(end - mid) / double(calls));
+
+			uint64_t cyclelegacy = 0, cyclehot = 0;
+			for (unsigned c = 0; c < coldcalls; ++c)
+			{
+				const unsigned b = c % blocks;
+				evict_caches();
+				start = cycle_counter();
+				x += detect_legacy(&W[b * 80], block_states(b), dvmask, &ihvout[b * 5]);
+				cyclelegacy += cycle_counter() - start;
+				evict_caches();
+				start = cycle_counter();
+				x += detect_hot(&W[b * 80], block_states(b), dvmask, &ihvout[b * 5]);
+				cyclehot += cycle_counter() - start;
+			}
+			coldlegacy.push_back(double(cyclelegacy) / double(coldcalls));
+			coldhot.push_back(double(cyclehot) / double(coldcalls));
+		}
+		results.record("dvtable/" + name + "/legacy", "per_hit", cycle_counter_unit(), false, legacy);
+		results.record("dvtable/" + name + "/hot", "per_hit", cycle_counter_unit(), false, hot);
+		results.record("dvtable/" + name + "/legacy", "per_hit_cold", cycle_counter_unit(), false, coldlegacy);
+		results.record("dvtable/" + name + "/hot", "per_hit_cold", cycle_counter_unit(), false, coldhot);
+		alllegacy.push_back(median_of(legacy));
+		allhot.push_back(median_of(hot));
+		allcoldlegacy.push_back(median_of(coldlegacy));
+		allcoldhot.push_back(median_of(coldhot));
+		cout << name << "\t" << int(dv.testt) << "\t" << alllegacy.back() << "\t" << allhot.back() << "\t"
+			<< allcoldlegacy.back() << "\t" << allcoldhot.back() << "\t" << allcoldlegacy.back() / allcoldhot.back() << endl;
+	}
+	cout << "median\t\t" << median_of(alllegacy) << "\t" << median_of(allhot) << "\t" << median_of(allcoldlegacy) << "\t" << median_of(allcoldhot)
+		<< "\t" << median_of(allcoldlegacy) / median_of(allcoldhot) << endl << endl;
+	return 0;
+}
+#else
+int dv_table_benchmark(unsigned, fast_rng&, bench_results&, uint32_t&)
+{
+	cout << "The library has no hot/cold sha1_dvs tables, regenerate it with parse_bitrel for the DV table benchmark." << endl;
+	return 0;
+}
+#endif
@@ -0,0 +1,26 @@
+/***
+* Copyright 2017 Marc Stevens <marc@marc-stevens.nl>, Dan Shumow <danshu@microsoft.com>
+* Distributed under the MIT Software License.
+* See accompanying file LICENSE.txt or copy at
+* https://opensource.org/licenses/MIT
+***/
+
+#ifndef LIBCHECK_RECOMPRESS_BENCH_HPP
+#define LIBCHECK_RECOMPRESS_BENCH_HPP
+
+#include <cstdint>
+
+#include "../common/bench_results.hpp"
+#include "../common/fast_rng.hpp"
+
+// compares per DV the generic recompression of sha1dc_recompress.hpp with the one parse_bitrel
+// generates in sha1_recompress.cinc, after checking that they agree; in its own translation unit
+// as main.cpp has its own SHA-1 compression functions. Returns non-zero if they do not agree, and
+// only reports that the library has no sha1_recompress.cinc if it was built without it
+int recompress_benchmark(unsigned reps, fast_rng& rng, bench_results& results, uint32_t& x);
+
+// compares the detection path of a block that passed one DV's ubc_check on the legacy sha1_dvs
+// table and on the hot table sorted by testt with sparse differences, with warm and cold caches
+int dv_table_benchmark(unsigned reps, fast_rng& rng, bench_results& results, uint32_t& x);
+
+#endif // LIBCHECK_RECOMPRESS_BENCH_HPP
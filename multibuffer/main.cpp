@@ -0,0 +1,254 @@
+/***
+* Copyright 2017 Marc Stevens <marc@marc-stevens.nl>, Dan Shumow <danshu@microsoft.com>
+* Distributed under the MIT Software License.
+* See accompanying file LICENSE.txt or copy at
+* https://opensource.org/licenses/MIT
+***/
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+
+#include <boost/program_options.hpp>
+
+#include "sha1dc_mb.hpp"
+#include "../common/aligned_arena.hpp"
+#include "../common/bench_results.hpp"
+#include "../common/fast_rng.hpp"
+#include "../common/ubc_blockgen.hpp"
+
+extern "C"
+{
+#include "sha1.h"
+}
+
+using namespace std;
+
+namespace po = boost::program_options;
+
+// benchmarks the multi-buffer engine against hashing every message of the batch with
+// SHA1DCInit/SHA1DCUpdate/SHA1DCFinal, after checking that both give the same hashes
+
+vector<size_t> parse_sizes(const string& list)
+{
+	vector<size_t> ret;
+	size_t pos = 0;
+	while (pos < list.size())
+	{
+		size_t end = list.find(',', pos);
+		if (end == string::npos)
+			end = list.size();
+		ret.push_back(size_t(strtoull(list.substr(pos, end - pos).c_str(), 0, 0)));
+		pos = end + 1;
+	}
+	return ret;
+}
+
+double median(vector<double> v)
+{
+	sort(v.begin(), v.end());
+	return v.empty() ? 0 : v[v.size() / 2];
+}
+
+void hash_sha1dc(vector<sha1dc_mb_job>& jobs, bool ubc)
+{
+	SHA1_CTX ctx;
+	for (size_t i = 0; i < jobs.size(); ++i)
+	{
+		SHA1DCInit(&ctx);
+		SHA1DCSetUseUBC(&ctx, ubc ? 1 : 0);
+		SHA1DCUpdate(&ctx, jobs[i].data, jobs[i].size);
+		jobs[i].collision = SHA1DCFinal(jobs[i].hash, &ctx) != 0;
+	}
+}
+
+// overwrites a random block of one in every 2^rate messages with a block that passes the
+// unavoidable bit conditions of a random DV, so that the engine takes its scalar fallback
+uint64_t craft_blocks(char* data, size_t size, size_t count, unsigned rate, vector<ubc_block_generator>& generators, fast_rng& rng)
+{
+	uint64_t crafted = 0;
+	if (generators.empty() || size < 64)
+		return 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (rng() & ((uint32_t(1) << rate) - 1))
+			continue;
+		uint32_t m[16];
+		generators[rng() % generators.size()].generate(rng, m);
+		unsigned char* block = reinterpret_cast<unsigned char*>(data + i * size + 64 * (rng() % (size / 64)));
+		for (unsigned w = 0; w < 16; ++w)
+			for (unsigned b = 0; b < 4; ++b)
+				block[4 * w + b] = (unsigned char)(m[w] >> (24 - 8 * b));
+		++crafted;
+	}
+	return crafted;
+}
+
+int main(int argc, char** argv)
+{
+	string sizelist, resultspath, ubcdir;
+	vector<string> kernelnames;
+	size_t batchdata;
+	unsigned reps, rate;
+	uint64_t seed;
+
+	po::options_description desc("Allowed options");
+	desc.add_options()
+		("help,h", "Show options")
+		("list", "List the kernels the cpu supports")
+		("sizes", po::value<string>(&sizelist)->default_value("0,64,256,1024,4096,16384"), "Comma separated message sizes in bytes")
+		("batchdata", po::value<size_t>(&batchdata)->default_value(size_t(1) << 24), "Bytes per batch of messages of one size (at least 4096 messages)")
+		("kernel,k", po::value<vector<string> >(&kernelnames)->multitoken(), "Kernels to benchmark (default: all available)")
+		("reps", po::value<unsigned>(&reps)->default_value(5), "Repetitions per size and kernel (the median is reported)")
+		("noubc", "Check every block by recompression instead of only those passing ubc_check")
+		("ubcdir", po::value<string>(&ubcdir), "Directory with the unavoidable bit relations of the DVs, enables --ubcrate")
+		("ubcrate", po::value<unsigned>(&rate)->default_value(6), "Craft a block passing a DV's unavoidable bit conditions into 1 in 2^r messages")
+		("seed", po::value<uint64_t>(&seed), "Seed for the message contents (default: time)")
+		("results", po::value<string>(&resultspath), "Append results as JSON lines to this file, or to <host>_<cpu>.jsonl in this directory")
+		;
+	po::variables_map vm;
+	po::store(po::command_line_parser(argc, argv).options(desc).run(), vm);
+	po::notify(vm);
+
+	if (vm.count("help"))
+	{
+		cout << desc << endl;
+		return 0;
+	}
+
+	vector<sha1dc_mb_kernel> kernels = available_sha1dc_mb_kernels(), selected;
+	if (vm.count("list"))
+	{
+		for (size_t i = 0; i < kernels.size(); ++i)
+			cout << kernels[i].name << "\t" << kernels[i].lanes << " lanes" << endl;
+		cout << "dispatched ubc_check variant: " << dispatch_ubc_check_kernel().name << endl;
+		return 0;
+	}
+	if (kernelnames.empty())
+		selected = kernels;
+	for (size_t i = 0; i < kernelnames.size(); ++i)
+	{
+		sha1dc_mb_kernel k;
+		if (!find_sha1dc_mb_kernel(kernelnames[i], k))
+		{
+			cerr << "Kernel '" << kernelnames[i] << "' is not available (see --list)" << endl;
+			return 2;
+		}
+		selected.push_back(k);
+	}
+	vector<size_t> sizes = parse_sizes(sizelist);
+	if (sizes.empty() || reps == 0 || rate > 31)
+	{
+		cerr << "--sizes must not be empty, --reps must be positive and --ubcrate at most 31" << endl;
+		return 2;
+	}
+	const bool ubc = vm.count("noubc") == 0;
+
+	bench_results results;
+	if (vm.count("results") && !results.open(resultspath, "mbbench"))
+	{
+		cerr << "Could not open " << results.filename() << endl;
+		return 2;
+	}
+
+	vector<ubc_block_generator> generators;
+	if (!ubcdir.empty())
+	{
+		vector<ubc_dv_relations> dvs = load_ubc_relations(ubcdir);
+		if (dvs.empty())
+		{
+			cerr << "No unavoidable bit relations found in " << ubcdir << endl;
+			return 2;
+		}
+		for (size_t d = 0; d < dvs.size(); ++d)
+			generators.push_back(ubc_block_generator(dvs[d]));
+	}
+	if (!vm.count("seed"))
+		seed = uint64_t(time(0));
+	fast_rng rng(seed);
+
+	cout << "Multi-buffer SHA-1 collision detection (" << (ubc ? "with" : "without") << " ubc_check, seed " << seed << ")" << endl;
+	cout << "size\tmessages\tkernel\tGB/s\tMmsg/s\tspeedup\tlanes used\tfallbacks" << endl;
+
+	for (size_t s = 0; s < sizes.size(); ++s)
+	{
+		const size_t size = sizes[s];
+		const size_t count = std::max<size_t>(4096, batchdata / std::max<size_t>(size, 1));
+		aligned_arena<char> data(std::max<size_t>(count * size, 1));
+		rng.fill(data.data(), count * size);
+		uint64_t crafted = craft_blocks(data.data(), size, count, rate, generators, rng);
+
+		vector<sha1dc_mb_job> ref(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			ref[i].data = data.data() + i * size;
+			ref[i].size = size;
+		}
+		vector<sha1dc_mb_job> jobs = ref;
+
+		vector<double> seconds;
+		for (unsigned r = 0; r < reps; ++r)
+		{
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			hash_sha1dc(ref, ubc);
+			seconds.push_back(chrono::duration<double>(chrono::steady_clock::now() - start).count());
+		}
+		const double base = median(seconds);
+
+		string prefix = string(ubc ? "mb/" : "mb_noubc/") + to_string(size) + "/";
+		vector<double> gbps, msgps;
+		for (unsigned r = 0; r < reps; ++r)
+		{
+			gbps.push_back(double(count * size) / seconds[r] / 1e9);
+			msgps.push_back(double(count) / seconds[r] / 1e6);
+		}
+		cout << size << "\t" << count << "\tsha1dc\t" << fixed << setprecision(3) << median(gbps) << "\t" << median(msgps) << "\t1.00" << endl;
+		cout.unsetf(ios::floatfield);
+		results.record(prefix + "sha1dc", "throughput", "GB/s", true, gbps);
+		results.record(prefix + "sha1dc", "messages_per_sec", "Mmsg/s", true, msgps);
+
+		for (size_t k = 0; k < selected.size(); ++k)
+		{
+			sha1dc_multibuffer engine(selected[k], true, ubc);
+			seconds.clear();
+			for (unsigned r = 0; r < reps; ++r)
+			{
+				engine.reset_stats();
+				chrono::steady_clock::time_point start = chrono::steady_clock::now();
+				engine.hash(&jobs[0], count);
+				seconds.push_back(chrono::duration<double>(chrono::steady_clock::now() - start).count());
+				if (r > 0)
+					continue;
+				for (size_t i = 0; i < count; ++i)
+					if (memcmp(jobs[i].hash, ref[i].hash, 20) != 0 || jobs[i].collision != ref[i].collision)
+					{
+						cerr << selected[k].name << " disagrees with SHA1DCUpdate on message " << i << " of " << size << " bytes" << endl;
+						return 1;
+					}
+			}
+			gbps.clear();
+			msgps.clear();
+			for (unsigned r = 0; r < reps; ++r)
+			{
+				gbps.push_back(double(count * size) / seconds[r] / 1e9);
+				msgps.push_back(double(count) / seconds[r] / 1e6);
+			}
+			const sha1dc_mb_stats& st = engine.stats();
+			cout << size << "\t" << count << "\t" << selected[k].name << "\t" << fixed << setprecision(3) << median(gbps) << "\t" << median(msgps)
+				<< "\t" << setprecision(2) << base / median(seconds) << "\t" << setprecision(1) << 100.0 * st.utilization(selected[k].lanes) << "%"
+				<< "\t" << st.recompressed << endl;
+			cout.unsetf(ios::floatfield);
+			results.record(prefix + selected[k].name, "throughput", "GB/s", true, gbps);
+			results.record(prefix + selected[k].name, "messages_per_sec", "Mmsg/s", true, msgps);
+		}
+		if (crafted)
+			cout << crafted << " messages contained a crafted block." << endl;
+	}
+	return 0;
+}
@@ -0,0 +1,206 @@
+/***
+* Copyright 2017 Marc Stevens <marc@marc-stevens.nl>, Dan Shumow <danshu@microsoft.com>
+* Distributed under the MIT Software License.
+* See accompanying file LICENSE.txt or copy at
+* https://opensource.org/licenses/MIT
+***/
+
+#include <cstring>
+
+#include "sha1dc_mb.hpp"
+#include "../common/cpu_features.hpp"
+#include "../common/sha1_baselines.hpp"
+#include "../common/sha1dc_recompress.hpp"
+#include "../common/sha1dc_stream.hpp"
+
+namespace {
+
+	// the one lane kernel on the library's scalar ubc_check, for cpus without SIMD support
+	void expand_scalar(uint32_t* W)
+	{
+		for (unsigned t = 16; t < 80; ++t)
+			W[t] = sha1dc_detail::rotl(W[t - 3] ^ W[t - 8] ^ W[t - 14] ^ W[t - 16], 1);
+	}
+
+}
+
+std::vector<sha1dc_mb_kernel> available_sha1dc_mb_kernels()
+{
+	std::vector<sha1dc_mb_kernel> ret;
+	cpu_features cpu = detect_cpu_features();
+	(void)cpu;
+#if defined(HAVE_SHA1_BASELINES_X86) && defined(HAVE_AVX512)
+	if (cpu.avx512f)
+	{
+		sha1dc_mb_kernel k = { "avx512x16", 16, sha1_expand_avx512_x16, sha1_compress_w_avx512_x16, ubc_check_lanes_avx512 };
+		ret.push_back(k);
+	}
+#endif
+#if defined(HAVE_SHA1_BASELINES_X86) && defined(HAVE_AVX)
+	if (cpu.avx2)
+	{
+		sha1dc_mb_kernel k = { "avx2x8", 8, sha1_expand_avx2_x8, sha1_compress_w_avx2_x8, ubc_check_lanes_avx256 };
+		ret.push_back(k);
+	}
+#endif
+#if defined(HAVE_SHA1_BASELINES_X86) && defined(HAVE_SSE)
+	if (cpu.sse2)
+	{
+		sha1dc_mb_kernel k = { "sse2x4", 4, sha1_expand_sse2_x4, sha1_compress_w_sse2_x4, ubc_check_lanes_sse128 };
+		ret.push_back(k);
+	}
+#endif
+	sha1dc_mb_kernel scalar = { "scalar", 1, expand_scalar, sha1_compression_W, ubc_check_lanes_scalar };
+	ret.push_back(scalar);
+	return ret;
+}
+
+bool find_sha1dc_mb_kernel(const std::string& name, sha1dc_mb_kernel& kernel)
+{
+	std::vector<sha1dc_mb_kernel> kernels = available_sha1dc_mb_kernels();
+	for (size_t i = 0; i < kernels.size(); ++i)
+		if (name == kernels[i].name)
+		{
+			kernel = kernels[i];
+			return true;
+		}
+	return false;
+}
+
+sha1dc_multibuffer::sha1dc_multibuffer(const sha1dc_mb_kernel& kernel, bool detect, bool ubc, bool safe_hash)
+	: k(kernel), detect(detect), ubc(ubc), safe_hash(safe_hash), lanes(kernel.lanes),
+	W(80 * kernel.lanes), ihv(5 * kernel.lanes), ihvin(5 * kernel.lanes), dvmask(DVMASKSIZE * kernel.lanes)
+{
+}
+
+void sha1dc_multibuffer::start(unsigned j, sha1dc_mb_job* job)
+{
+	lane& l = lanes[j];
+	l.job = job;
+	l.offset = 0;
+	l.tailblocks = 0;
+	if (job)
+	{
+		job->collision = false;
+		for (unsigned i = 0; i < 5; ++i)
+			ihv[i * k.lanes + j] = sha1dc_iv[i];
+	}
+}
+
+// the next block of the lane's message, building the padded final block(s) when reaching them
+const unsigned char* sha1dc_multibuffer::next_block(lane& l)
+{
+	const uint64_t size = l.job->size;
+	if (l.offset + 64 <= size)
+		return reinterpret_cast<const unsigned char*>(l.job->data) + l.offset;
+	if (l.tailblocks == 0)
+	{
+		size_t rest = size_t(size - l.offset);
+		if (rest)
+			memcpy(l.tail, l.job->data + l.offset, rest);
+		l.tailblocks = unsigned(sha1dc_pad(l.tail, rest, size));
+	}
+	return l.tail + size_t(l.offset - (size - size % 64));
+}
+
+// the scalar fallback for a lane with a non-zero dvmask
+void sha1dc_multibuffer::check_lane(unsigned j, const uint32_t mask[DVMASKSIZE])
+{
+	const unsigned L = k.lanes;
+	uint32_t Wj[80], in[5], out[5];
+	++st.recompressed;
+	sha1dc_lane_words(W.data(), L, j, Wj);
+	for (unsigned i = 0; i < 5; ++i)
+	{
+		in[i] = ihvin[i * L + j];
+		out[i] = ihv[i * L + j];
+	}
+	if (!sha1dc_check_block(in, Wj, mask, out))
+		return;
+	lanes[j].job->collision = true;
+	++st.collisions;
+	if (safe_hash)
+	{
+		// as the library does: compress the colliding block twice more so that the
+		// colliding messages get different hashes
+		sha1_compression_W(out, Wj);
+		sha1_compression_W(out, Wj);
+		for (unsigned i = 0; i < 5; ++i)
+			ihv[i * L + j] = out[i];
+	}
+}
+
+void sha1dc_multibuffer::finish(unsigned j)
+{
+	sha1dc_mb_job* job = lanes[j].job;
+	for (unsigned i = 0; i < 5; ++i)
+	{
+		uint32_t h = ihv[i * k.lanes + j];
+		job->hash[4 * i] = (unsigned char)(h >> 24);
+		job->hash[4 * i + 1] = (unsigned char)(h >> 16);
+		job->hash[4 * i + 2] = (unsigned char)(h >> 8);
+		job->hash[4 * i + 3] = (unsigned char)(h);
+	}
+	++st.messages;
+}
+
+void sha1dc_multibuffer::hash(sha1dc_mb_job* jobs, size_t count)
+{
+	const unsigned L = k.lanes;
+	size_t next = 0;
+	unsigned active = 0;
+	for (unsigned j = 0; j < L; ++j)
+	{
+		start(j, next < count ? &jobs[next++] : 0);
+		active += lanes[j].job ? 1 : 0;
+	}
+
+	while (active)
+	{
+		// idle lanes keep their stale words, their results are ignored
+		for (unsigned j = 0; j < L; ++j)
+		{
+			if (!lanes[j].job)
+				continue;
+			const unsigned char* block = next_block(lanes[j]);
+			for (unsigned i = 0; i < 16; ++i)
+				W[i * L + j] = sha1dc_load_be32(block + 4 * i);
+		}
+		k.expand(W.data());
+		if (detect)
+			memcpy(ihvin.data(), ihv.data(), 5 * L * sizeof(uint32_t));
+		k.compress(ihv.data(), W.data());
+		++st.rounds;
+		st.blocks += active;
+
+		if (detect)
+		{
+			if (ubc)
+				k.ubc_check(W.data(), dvmask.data());
+			for (unsigned j = 0; j < L; ++j)
+			{
+				if (!lanes[j].job)
+					continue;
+				uint32_t mask[DVMASKSIZE];
+				if (sha1dc_lane_dvmask(dvmask.data(), L, j, ubc, mask))
+					check_lane(j, mask);
+			}
+		}
+
+		for (unsigned j = 0; j < L; ++j)
+		{
+			lane& l = lanes[j];
+			if (!l.job)
+				continue;
+			l.offset += 64;
+			// done after the last tail block
+			if (l.tailblocks && l.offset >= (l.job->size - l.job->size % 64) + 64 * l.tailblocks)
+			{
+				finish(j);
+				start(j, next < count ? &jobs[next++] : 0);
+				if (!l.job)
+					--active;
+			}
+		}
+	}
+}
@@ -0,0 +1,102 @@
+/***
+* Copyright 2017 Marc Stevens <marc@marc-stevens.nl>, Dan Shumow <danshu@microsoft.com>
+* Distributed under the MIT Software License.
+* See accompanying file LICENSE.txt or copy at
+* https://opensource.org/licenses/MIT
+***/
+
+#ifndef SHA1DC_MB_HPP
+#define SHA1DC_MB_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../common/aligned_arena.hpp"
+#include "../common/ubc_check_dispatch.hpp"
+
+// multi-buffer SHA-1 with collision detection: hashes a batch of independent messages with one
+// message per SIMD lane. Per round every lane loads its next block, then the whole vector of
+// blocks is expanded, compressed and checked by the SIMD ubc_check generated by parse_bitrel at
+// once; only lanes whose dvmask is non-zero fall back to the scalar recompressions of
+// sha1dc_recompress.hpp. A lane that finishes its message immediately takes the next one of the
+// batch, so messages of different lengths keep all lanes busy.
+// results are the same as SHA1DCInit/SHA1DCUpdate/SHA1DCFinal with the default settings, i.e.
+// including the safe hash of colliding blocks
+
+// a message of a batch and its results
+struct sha1dc_mb_job
+{
+	const char* data;
+	size_t size;
+	unsigned char hash[20];
+	bool collision;
+};
+
+// all kernels work on 'lanes' blocks in SoA layout: word i of lane j is at [i * lanes + j]
+typedef void (*sha1dc_mb_expand_fn)(uint32_t* W);
+typedef void (*sha1dc_mb_compress_fn)(uint32_t* ihv, const uint32_t* W);
+
+struct sha1dc_mb_kernel
+{
+	const char* name;
+	unsigned lanes;
+	sha1dc_mb_expand_fn expand;
+	sha1dc_mb_compress_fn compress;
+	ubc_check_lanes_fn ubc_check;
+};
+
+// the kernels compiled in that the running cpu supports, widest first and the scalar one last
+std::vector<sha1dc_mb_kernel> available_sha1dc_mb_kernels();
+
+// returns false if there is no available kernel of that name
+bool find_sha1dc_mb_kernel(const std::string& name, sha1dc_mb_kernel& kernel);
+
+struct sha1dc_mb_stats
+{
+	uint64_t messages, rounds, blocks, recompressed, collisions;
+
+	sha1dc_mb_stats() : messages(0), rounds(0), blocks(0), recompressed(0), collisions(0) {}
+
+	// the fraction of lanes doing useful work
+	double utilization(unsigned lanes) const { return rounds ? double(blocks) / double(rounds * lanes) : 0; }
+};
+
+class sha1dc_multibuffer
+{
+public:
+	explicit sha1dc_multibuffer(const sha1dc_mb_kernel& kernel, bool detect = true, bool ubc = true, bool safe_hash = true);
+
+	// hashes all jobs, filling in their hash and collision fields
+	void hash(sha1dc_mb_job* jobs, size_t count);
+
+	const sha1dc_mb_kernel& kernel() const { return k; }
+	const sha1dc_mb_stats& stats() const { return st; }
+	void reset_stats() { st = sha1dc_mb_stats(); }
+
+private:
+	struct lane
+	{
+		sha1dc_mb_job* job;
+		uint64_t offset; // bytes of the message consumed
+		unsigned tailblocks; // the padded final 1 or 2 blocks, once built
+		unsigned char tail[128];
+	};
+
+	sha1dc_mb_kernel k;
+	bool detect, ubc, safe_hash;
+	sha1dc_mb_stats st;
+	std::vector<lane> lanes;
+	aligned_arena<uint32_t> W, ihv, ihvin, dvmask;
+
+	void start(unsigned j, sha1dc_mb_job* job);
+	const unsigned char* next_block(lane& l);
+	void check_lane(unsigned j, const uint32_t mask[DVMASKSIZE]);
+	void finish(unsigned j);
+
+	sha1dc_multibuffer(const sha1dc_multibuffer&);
+	sha1dc_multibuffer& operator=(const sha1dc_multibuffer&);
+};
+
+#endif // SHA1DC_MB_HPP
@@ -16,6 +16,7 @@
 #include <stdexcept>
 #include <algorithm>
 #include <iomanip>
+#include <sstream>
 
 #include <boost/cstdint.hpp>
 #include <boost/lexical_cast.hpp>
@@ -700,6 +701,10 @@ void output_code_header(map<string, unsigned>& DV_to_bitpos, const map<vector<ui
 	for (auto it = DV_testt.begin(); it != DV_testt.end(); ++it)
 		testt.insert(it->second);
 
+	// dv_hot_t holds the index in sha1_dvs in a uint8_t and the offsets in the cold tables in uint16_t
+	if (DVs.size() > 256)
+		throw std::runtime_error("output_code_header(): the hot table supports at most 256 DVs");
+
 	out_h << "#ifndef UBC_CHECK_H" << endl;
 	out_h << "#define UBC_CHECK_H" << endl << endl;
 	out_h << "#include <stdint.h>" << endl << endl;
@@ -707,6 +712,16 @@ void output_code_header(map<string, unsigned>& DV_to_bitpos, const map<vector<ui
 	out_h << "typedef struct { int dvType; int dvK; int dvB; int testt; int maski; int maskb; uint32_t dm[80]; } dv_info_t;" << endl;
 	out_h << "extern dv_info_t sha1_dvs[];" << endl;
 	out_h << "void ubc_check(const uint32_t W[80], uint32_t dvmask[DVMASKSIZE]);" << endl;
+	out_h << endl;
+	out_h << "/* the fields of sha1_dvs that the detection loop reads for every DV, sorted by testt, in a few cache lines:" << endl;
+	out_h << "   dv is the index in sha1_dvs, its dm is sparse in runs of consecutive non-zero words, sha1_dvs_dmrun[dmrun..]" << endl;
+	out_h << "   holds the first step and the number of words of each run until one of 0 words, the words are sha1_dvs_dmword[dmword..] */" << endl;
+	out_h << "#define SHA1_DVS_HOT" << endl;
+	out_h << "#define DVCOUNT " << DVs.size() << endl;
+	out_h << "typedef struct { uint8_t testt; uint8_t maski; uint8_t maskb; uint8_t dv; uint16_t dmrun; uint16_t dmword; } dv_hot_t;" << endl;
+	out_h << "extern const dv_hot_t sha1_dvs_hot[DVCOUNT];" << endl;
+	out_h << "extern const uint8_t sha1_dvs_dmrun[][2];" << endl;
+	out_h << "extern const uint32_t sha1_dvs_dmword[];" << endl;
 
 	out_h << endl;
 	for (auto it = testt.begin(); it != testt.end(); ++it)
@@ -738,6 +753,59 @@ void output_code_header(map<string, unsigned>& DV_to_bitpos, const map<vector<ui
 	for (int i = 1; i < 80; ++i)
 		out_c << ",0";
 	out_c << "}}\n};" << endl;
+	out_c << endl;
+
+	// the hot/cold split of sha1_dvs: DVs sharing a testt are contiguous, the runs and words of a DV
+	// follow those of the DV before it in the hot table
+	vector<pair<int, string> > sorted;
+	map<string, unsigned> DV_index;
+	unsigned index = 0;
+	for (auto it = DVs.begin(); it != DVs.end(); ++it, ++index)
+	{
+		sorted.push_back(make_pair(DV_testt[it->first], it->first));
+		DV_index[it->first] = index;
+	}
+	std::sort(sorted.begin(), sorted.end());
+	ostringstream hot, runs, words;
+	unsigned dmrun = 0, dmword = 0;
+	for (auto it = sorted.begin(); it != sorted.end(); ++it)
+	{
+		const uint32* DW = DVs.find(it->second)->second.DW;
+		hot << ((it == sorted.begin()) ? "  " : ", ");
+		hot << "{" << it->first << "," << (DV_to_bitpos[it->second]/32) << "," << (DV_to_bitpos[it->second]%32) << "," << DV_index[it->second] << "," << dmrun << "," << dmword << "} /* " << it->second << " */" << endl;
+		runs << ((it == sorted.begin()) ? "  " : ", ");
+		words << ((it == sorted.begin()) ? "  " : ", ");
+		const unsigned first = dmword;
+		for (int t = 0; t < 80; )
+		{
+			if (DW[t] == 0)
+			{
+				++t;
+				continue;
+			}
+			int len = 0;
+			for (; t + len < 80 && DW[t + len] != 0; ++len)
+				words << (dmword + len != first ? "," : "") << "0x" << std::hex << std::setfill('0') << std::setw(8) << DW[t + len] << std::dec;
+			runs << "{" << t << "," << len << "},";
+			dmword += len;
+			++dmrun;
+			t += len;
+		}
+		runs << "{0,0}" << endl;
+		++dmrun;
+		words << endl;
+	}
+	if (dmrun > 65535 || dmword > 65535)
+		throw std::runtime_error("output_code_header(): the hot table supports at most 65535 difference runs and words");
+	out_c << "#if defined(_MSC_VER)" << endl;
+	out_c << "#define DV_ALIGN64 __declspec(align(64))" << endl;
+	out_c << "#else" << endl;
+	out_c << "#define DV_ALIGN64 __attribute__((aligned(64)))" << endl;
+	out_c << "#endif" << endl;
+	out_c << endl;
+	out_c << "DV_ALIGN64 const dv_hot_t sha1_dvs_hot[DVCOUNT] = \n{" << endl << hot.str() << "};" << endl << endl;
+	out_c << "const uint8_t sha1_dvs_dmrun[][2] = \n{" << endl << runs.str() << "};" << endl << endl;
+	out_c << "const uint32_t sha1_dvs_dmword[] = \n{" << endl << words.str() << "};" << endl;
   
 
 
@@ -824,6 +892,98 @@ void output_code_simd(const map<vector<uint32>, vector<string> >& bitrel_to_DV,
 	out_c << "}" << endl;;
 }
 
+// one recompression function per DV, in the order of sha1_dvs: the steps are unrolled from the DV's
+// testt backwards to 0 and forwards to 79, the message differences are immediate constants and
+// words without difference are used as they are. The working state rotates through five variables,
+// so step t uses x[(r - (t - testt)) mod 5] for the state word r = 0..4 (a..e) before it.
+void output_code_recompress(const map<vector<uint32>, vector<string> >& bitrel_to_DV, ostream& out_c)
+{
+	map<string, disturbancevector> DVs;
+	for (auto it = bitrel_to_DV.begin(); it != bitrel_to_DV.end(); ++it)
+		for (auto it2 = it->second.begin(); it2 != it->second.end(); ++it2)
+			if (DVs.find(*it2) == DVs.end())
+				DVs.emplace(*it2, disturbancevector(*it2));
+	map<string, int> DV_testt = find_testt(DVs, bitrel_to_DV);
+
+	auto fname = [](const string& DV)
+	{
+		string ret = DVvariablename(DV, "", "sha1_recompress_");
+		while (ret.back() == '_')
+			ret.pop_back();
+		return ret;
+	};
+	auto x = [](int r, int j) { return "x" + boost::lexical_cast<string>(((r - j) % 5 + 5) % 5); };
+	auto f = [](int t) { return string(t < 20 ? "F1" : t < 40 ? "F2" : t < 60 ? "F3" : "F4"); };
+	auto k = [](int t) { return string(t < 20 ? "K1" : t < 40 ? "K2" : t < 60 ? "K3" : "K4"); };
+
+	out_c << "#include \"ubc_check.h\"" << endl;
+	out_c << endl;
+	out_c << "#define SHA1RC_ROTL(x,n) (((x)<<(n))|((x)>>(32-(n))))" << endl;
+	out_c << "#define SHA1RC_ROTR(x,n) (((x)>>(n))|((x)<<(32-(n))))" << endl;
+	out_c << "#define SHA1RC_F1(b,c,d) ((d)^((b)&((c)^(d))))" << endl;
+	out_c << "#define SHA1RC_F2(b,c,d) ((b)^(c)^(d))" << endl;
+	out_c << "#define SHA1RC_F3(b,c,d) (((b)&((c)|(d)))|((c)&(d)))" << endl;
+	out_c << "#define SHA1RC_F4(b,c,d) ((b)^(c)^(d))" << endl;
+	out_c << "#define SHA1RC_K1 0x5A827999" << endl;
+	out_c << "#define SHA1RC_K2 0x6ED9EBA1" << endl;
+	out_c << "#define SHA1RC_K3 0x8F1BBCDC" << endl;
+	out_c << "#define SHA1RC_K4 0xCA62C1D6" << endl;
+	out_c << endl;
+	out_c << "/* W is the expanded message without the differences, state the working state before step testt of its compression;" << endl;
+	out_c << "   returns 1 if the message with the DV's differences from that state leads to ihvout, its input ihv is stored in ihvin2 */" << endl;
+	out_c << "typedef int (*sha1_recompress_fn)(const uint32_t W[80], const uint32_t state[5], const uint32_t ihvout[5], uint32_t ihvin2[5]);" << endl;
+	out_c << endl;
+
+	for (auto it = DVs.begin(); it != DVs.end(); ++it)
+	{
+		const int testt = DV_testt[it->first];
+		const uint32* DW = it->second.DW;
+		unsigned words = 0;
+		for (int t = 0; t < 80; ++t)
+			if (DW[t] != 0)
+				++words;
+		auto w = [DW](int t)
+		{
+			ostringstream ret;
+			if (DW[t] == 0)
+				ret << "W[" << t << "]";
+			else
+				ret << "(W[" << t << "]^0x" << std::hex << std::setfill('0') << std::setw(8) << DW[t] << ")";
+			return ret.str();
+		};
+
+		out_c << "/* " << it->first << ": testt " << testt << ", differences in " << words << " of 80 words */" << endl;
+		out_c << "static int " << fname(it->first) << "(const uint32_t W[80], const uint32_t state[5], const uint32_t ihvout[5], uint32_t ihvin2[5])" << endl;
+		out_c << "{" << endl;
+		out_c << "\tuint32_t x0 = state[0], x1 = state[1], x2 = state[2], x3 = state[3], x4 = state[4];" << endl;
+		for (int t = testt - 1; t >= 0; --t)
+		{
+			int j = t + 1 - testt;
+			out_c << "\t" << x(2, j) << " = SHA1RC_ROTR(" << x(2, j) << ",30); "
+				<< x(0, j) << " -= SHA1RC_ROTL(" << x(1, j) << ",5) + SHA1RC_" << f(t) << "(" << x(2, j) << "," << x(3, j) << "," << x(4, j) << ") + SHA1RC_" << k(t) << " + " << w(t) << ";" << endl;
+		}
+		for (int r = 0; r < 5; ++r)
+			out_c << "\tihvin2[" << r << "] = " << x(r, -testt) << ";" << endl;
+		out_c << "\tx0 = state[0]; x1 = state[1]; x2 = state[2]; x3 = state[3]; x4 = state[4];" << endl;
+		for (int t = testt; t < 80; ++t)
+		{
+			int j = t - testt;
+			out_c << "\t" << x(4, j) << " += SHA1RC_ROTL(" << x(0, j) << ",5) + SHA1RC_" << f(t) << "(" << x(1, j) << "," << x(2, j) << "," << x(3, j) << ") + SHA1RC_" << k(t) << " + " << w(t) << "; "
+				<< x(1, j) << " = SHA1RC_ROTL(" << x(1, j) << ",30);" << endl;
+		}
+		out_c << "\treturn 0 == (";
+		for (int r = 0; r < 5; ++r)
+			out_c << (r ? " | " : "") << "((ihvin2[" << r << "] + " << x(r, 80 - testt) << ") ^ ihvout[" << r << "])";
+		out_c << ");" << endl;
+		out_c << "}" << endl << endl;
+	}
+
+	out_c << "static const sha1_recompress_fn sha1_recompress_dvs[] =\n{" << endl;
+	for (auto it = DVs.begin(); it != DVs.end(); ++it)
+		out_c << ((it == DVs.begin()) ? "  " : ", ") << fname(it->first) << endl;
+	out_c << ", 0\n};" << endl;
+}
+
 
 
 
@@ -1167,6 +1327,7 @@ int main(int argc, char** argv)
 		string h_name = outdir+"/ubc_check.h";
 		string c_test_name = outdir+"/ubc_check_verify.c";
 		string c_simd_name = outdir + "/ubc_check_simd.cinc";
+		string c_recompress_name = outdir + "/sha1_recompress.cinc";
 
 		ofstream ofs_c(c_name.c_str(), ios::out | ios::trunc);
 		if (!ofs_c)
@@ -1180,8 +1341,12 @@ int main(int argc, char** argv)
 		ofstream ofs_c_simd(c_simd_name.c_str(), ios::out | ios::trunc);
 		if (!ofs_c_simd)
 			throw std::runtime_error("Could not open " + c_simd_name);
+		ofstream ofs_c_recompress(c_recompress_name.c_str(), ios::out | ios::trunc);
+		if (!ofs_c_recompress)
+			throw std::runtime_error("Could not open " + c_recompress_name);
 
 		output_code_simd(bitrel_to_DV, ofs_c_simd);
+		output_code_recompress(bitrel_to_DV, ofs_c_recompress);
 
 #if 0
 		//  v3
@@ -0,0 +1,164 @@
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+#include <iostream>
+
+#include "sha1.h"
+
+#include "test_util_lib.h"
+#include "../common/aligned_arena.hpp"
+#include "../common/cycle_counter.hpp"
+
+using namespace std;
+
+// number of distinct messages the timed calls cycle through, so that the same input is not hashed
+// over and over while the messages of all small sizes stay cache resident
+#define LATENCY_MESSAGES	4096
+
+const char* LatencyModeName(
+	int		mode)
+{
+	switch (mode)
+	{
+	case LATENCY_MODE_NODETECT:
+		return "nodetect";
+	case LATENCY_MODE_DC_NOUBC:
+		return "dc_noubc";
+	default:
+		return "dc_ubc";
+	}
+}
+
+// cost of an empty cycle_counter_start()/cycle_counter_stop() pair, subtracted from every call
+uint64_t CycleCounterOverhead()
+{
+	uint64_t minOverhead = ~(uint64_t)0;
+
+	for (size_t i = 0; i < 10000; i++)
+	{
+		uint64_t start = cycle_counter_start();
+		uint64_t end = cycle_counter_stop();
+		minOverhead = min(minOverhead, end - start);
+	}
+
+	return minOverhead;
+}
+
+// times cntCalls separate SHA1DCInit, SHA1DCUpdate, SHA1DCFinal sequences on messages of cbMessage
+// bytes one call at a time; pLatencyRecord->cycles receives the sorted per call counts
+int HashLatencyTimings(
+	size_t			cbMessage,
+	size_t			cntCalls,
+	int				mode,
+	fast_rng		&rng,
+	LatencyRecord	*pLatencyRecord)
+{
+	SHA1_CTX ctx;
+	unsigned char hash[20];
+
+	if (0 == cntCalls)
+	{
+		return -1;
+	}
+
+	aligned_arena<unsigned char> messages(max<size_t>(cbMessage, 1) * LATENCY_MESSAGES);
+	GenRandomBytes(messages.data(), messages.size(), rng);
+
+	pLatencyRecord->cbMessage = cbMessage;
+	pLatencyRecord->mode = mode;
+	pLatencyRecord->overhead = CycleCounterOverhead();
+	pLatencyRecord->cycles.resize(cntCalls);
+
+	// the first pass over the messages warms up caches, branch predictors and clock frequency and is not recorded
+	for (size_t i = 0; i < cntCalls + LATENCY_MESSAGES; i++)
+	{
+		const unsigned char *pb = messages.data() + (i % LATENCY_MESSAGES) * cbMessage;
+
+		uint64_t start = cycle_counter_start();
+
+		SHA1DCInit(&ctx);
+		if (LATENCY_MODE_NODETECT == mode)
+		{
+			SHA1DCSetUseDetectColl(&ctx, 0);
+		}
+		else if (LATENCY_MODE_DC_NOUBC == mode)
+		{
+			SHA1DCSetUseUBC(&ctx, 0);
+		}
+		SHA1DCUpdate(&ctx, (const char*)pb, cbMessage);
+		SHA1DCFinal(hash, &ctx);
+
+		uint64_t end = cycle_counter_stop();
+
+		if (LATENCY_MESSAGES <= i)
+		{
+			uint64_t cycles = end - start;
+			pLatencyRecord->cycles[i - LATENCY_MESSAGES] = (cycles > pLatencyRecord->overhead) ? cycles - pLatencyRecord->overhead : 0;
+		}
+	}
+
+	sort(pLatencyRecord->cycles.begin(), pLatencyRecord->cycles.end());
+
+	return 0;
+}
+
+// nearest-rank percentile of the sorted counts
+uint64_t LatencyPercentile(
+	const vector<uint64_t>	&cycles,
+	double					percentile)
+{
+	if (cycles.empty())
+	{
+		return 0;
+	}
+	size_t rank = (size_t)ceil(percentile / 100.0 * (double)cycles.size());
+	return cycles[min(cycles.size(), max<size_t>(rank, 1)) - 1];
+}
+
+// prints cntBins equal width bins from the minimum up to the 99.9th percentile and one bin
+// for the tail above, each with its count, share and a bar scaled to the fullest bin
+void PrintLatencyHistogram(
+	const LatencyRecord	&record,
+	unsigned int		cntBins)
+{
+	const vector<uint64_t> &cycles = record.cycles;
+	if (cycles.empty() || (0 == cntBins))
+	{
+		return;
+	}
+
+	uint64_t lo = cycles.front();
+	uint64_t hi = LatencyPercentile(cycles, 99.9);
+	uint64_t width = max<uint64_t>(1, (hi - lo + cntBins) / cntBins);
+
+	vector<size_t> bins(cntBins + 1, 0);
+	for (size_t i = 0; i < cycles.size(); i++)
+	{
+		size_t bin = (size_t)((cycles[i] - lo) / width);
+		bins[min<size_t>(bin, cntBins)]++;
+	}
+	size_t cntMax = *max_element(bins.begin(), bins.end());
+
+	printf("%lu bytes, %s (%s per call):\n", record.cbMessage, LatencyModeName(record.mode), cycle_counter_unit());
+	for (unsigned int b = 0; b <= cntBins; b++)
+	{
+		if (b < cntBins)
+		{
+			printf("  %8lu - %-8lu", (unsigned long)(lo + b * width), (unsigned long)(lo + (b + 1) * width - 1));
+		}
+		else
+		{
+			printf("  %8lu +       ", (unsigned long)(lo + b * width));
+		}
+		printf("\t%10lu\t%6.2f%%\t", bins[b], 100.0 * (double)bins[b] / (double)cycles.size());
+		size_t cntBar = (0 == cntMax) ? 0 : (bins[b] * 50 + cntMax - 1) / cntMax;
+		for (size_t i = 0; i < cntBar; i++)
+		{
+			putchar('#');
+		}
+		putchar('\n');
+	}
+}
@@ -1,11 +1,16 @@
 #include <string.h>
 
 #include <iostream>
+#include <fstream>
 #include <vector>
+#include <algorithm>
 
 #include "sha1.h"
 
 #include "test_util_lib.h"
+#include "../common/perf_counters.hpp"
+#include "../common/bench_results.hpp"
+#include "../common/cycle_counter.hpp"
 
 #include <boost/tokenizer.hpp>
 #include <boost/program_options.hpp>
@@ -23,6 +28,7 @@ typedef struct _HashTimingRecord
 	size_t	cntIterations;
 	boost::timer::cpu_times	timesHashing;
 	boost::timer::cpu_times	timesOverhead;
+	perf_counter_values	countersHashing;
 } HashTimingRecord;
 
 void TimeHashing(
@@ -30,7 +36,9 @@ void TimeHashing(
 	size_t			cb,
 	size_t			cntIterations,
 	boost::timer::cpu_times	*pTimeElapsed,
-	bool			fUBCCheck)
+	bool			fUBCCheck,
+	perf_counters	*pCounters,
+	perf_counter_values	*pCounterValues)
 {
 	SHA1_CTX ctx;
 	unsigned char hash[20];
@@ -39,6 +47,11 @@ void TimeHashing(
 
 	unsigned char	*pbLocal = pb;
 
+	if (pCounters)
+	{
+		pCounters->start();
+	}
+
 	t.start();
 
 	for (size_t i = 0; i < cntIterations; i++)
@@ -55,6 +68,11 @@ void TimeHashing(
 
 	t.stop();
 
+	if (pCounters)
+	{
+		*pCounterValues = pCounters->stop();
+	}
+
 	*pTimeElapsed = t.elapsed();
 
 }
@@ -116,7 +134,9 @@ void TimeNoDetectHashing(
     size_t			cb,
     size_t			cntIterations,
     boost::timer::cpu_times	*pTimeElapsed,
-    bool			fUBCCheck)
+    bool			fUBCCheck,
+    perf_counters	*pCounters,
+    perf_counter_values	*pCounterValues)
 {
     SHA1_CTX ctx;
     unsigned char hash[20];
@@ -125,6 +145,11 @@ void TimeNoDetectHashing(
 
     unsigned char	*pbLocal = pb;
 
+    if (pCounters)
+    {
+        pCounters->start();
+    }
+
     t.start();
 
     for (size_t i = 0; i < cntIterations; i++)
@@ -138,6 +163,11 @@ void TimeNoDetectHashing(
 
     t.stop();
 
+    if (pCounters)
+    {
+        *pCounterValues = pCounters->stop();
+    }
+
     *pTimeElapsed = t.elapsed();
 
 }
@@ -145,9 +175,10 @@ void TimeNoDetectHashing(
 int GenRandomAndPerformHashTimings(
 	size_t	cntBytes,
 	size_t	cntIterations,
-	br::mt19937 rng,
+	fast_rng rng,
 	HashTimingRecord *pHashTimingRecord,
-	bool fUBCCheck)
+	bool fUBCCheck,
+	perf_counters *pCounters)
 {
 	unsigned char*	pb = NULL;
 
@@ -166,7 +197,7 @@ int GenRandomAndPerformHashTimings(
 	GenRandomBytes(pb, cntBytes*cntIterations, rng);
 
 	cout << "Hashing " << cntBytes << " bytes of data in " << cntIterations << " iterations " << endl;
-	TimeHashing(pb, cntBytes, cntIterations, &pHashTimingRecord->timesHashing, fUBCCheck);
+	TimeHashing(pb, cntBytes, cntIterations, &pHashTimingRecord->timesHashing, fUBCCheck, pCounters, &pHashTimingRecord->countersHashing);
 	cout << "Loop Overhead of " << cntIterations << "iterations" << endl;
 	TimeLoopOverhead(cntIterations, &pHashTimingRecord->timesOverhead, fUBCCheck);
 
@@ -186,9 +217,10 @@ Cleanup:
 int GenRandomAndPerformHashTimings_NoDetect(
     size_t	cntBytes,
     size_t	cntIterations,
-    br::mt19937 rng,
+    fast_rng rng,
     HashTimingRecord *pHashTimingRecord,
-    bool fUBCCheck)
+    bool fUBCCheck,
+    perf_counters *pCounters)
 {
     unsigned char*	pb = NULL;
 
@@ -207,7 +239,7 @@ int GenRandomAndPerformHashTimings_NoDetect(
     GenRandomBytes(pb, cntBytes*cntIterations, rng);
 
     cout << "Hashing " << cntBytes << " bytes of data in " << cntIterations << " iterations " << endl;
-    TimeNoDetectHashing(pb, cntBytes, cntIterations, &pHashTimingRecord->timesHashing, fUBCCheck);
+    TimeNoDetectHashing(pb, cntBytes, cntIterations, &pHashTimingRecord->timesHashing, fUBCCheck, pCounters, &pHashTimingRecord->countersHashing);
     cout << "Loop Overhead of " << cntIterations << "iterations" << endl;
     TimeLoopOverhead(cntIterations, &pHashTimingRecord->timesOverhead, fUBCCheck);
 
@@ -224,12 +256,279 @@ Cleanup:
 
 }
 
+double NsPerByte(
+	const HashTimingRecord	&record)
+{
+	return double(record.timesHashing.wall) / (double(record.cntBytes) * double(record.cntIterations));
+}
+
+// vecNsPerByte holds the wall time per byte of every repetition of records[i] at [i], so that
+// benchcompare can test a change for significance rather than only against its threshold
+void RecordResults(
+	const vector<HashTimingRecord>	&records,
+	const vector<vector<double> >	&vecNsPerByte,
+	const string	&strMode,
+	bench_results	&results)
+{
+	for (size_t i = 0; i < records.size(); ++i)
+	{
+		results.record("hash/" + to_string(records[i].cntBytes) + "/" + strMode, "wall_per_byte", "ns", false, vecNsPerByte[i]);
+	}
+}
+
+double MedianOf(
+	vector<double>	samples)
+{
+	if (samples.empty())
+	{
+		return 0;
+	}
+	sort(samples.begin(), samples.end());
+	return (samples[(samples.size() - 1) / 2] + samples[samples.size() / 2]) / 2;
+}
+
+int PerformStreamingTimings(
+	boost::tokenizer<boost::char_separator<char> >	&tokens,
+	size_t			cbRing,
+	size_t			cbVolume,
+	unsigned int	cntReps,
+	bool			fUBCCheck,
+	fast_rng		&rng,
+	bench_results	&results)
+{
+	StreamingRecord	record;
+	const string	strMode = fUBCCheck ? "dc_ubc" : "dc_noubc";
+
+	cout << "Streaming " << cbVolume << " bytes per message size and mode through a ring buffer of " << cbRing << " bytes." << endl;
+	printf("bytes\tnodetect GB/s\tdetect GB/s\tdetect/nodetect\n");
+
+	for (boost::tokenizer<boost::char_separator<char> >::iterator cur_token = tokens.begin(); cur_token != tokens.end(); ++cur_token)
+	{
+		size_t cbMessage = (size_t)atoi(cur_token.current_token().c_str());
+
+		if (0 != StreamingHashTimings(cbMessage, cbRing, cbVolume, cntReps, fUBCCheck, rng, &record))
+		{
+			cout << "Streaming timing failed for message size " << cbMessage << "." << endl;
+			return -1;
+		}
+
+		double gbpsNoDetect = MedianOf(record.gbpsNoDetect);
+		double gbpsDetect = MedianOf(record.gbpsDetect);
+		printf("%lu\t%f\t%f\t%f\n", record.cbMessage, gbpsNoDetect, gbpsDetect, gbpsDetect / gbpsNoDetect);
+
+		results.record("stream/" + to_string(cbMessage) + "/nodetect", "throughput", "GB/s", true, record.gbpsNoDetect);
+		results.record("stream/" + to_string(cbMessage) + "/" + strMode, "throughput", "GB/s", true, record.gbpsDetect);
+	}
+
+	return 0;
+}
+
+int PerformScalingTimings(
+	boost::tokenizer<boost::char_separator<char> >	&tokens,
+	const vector<unsigned int>	&vecThreads,
+	size_t			cbRing,
+	size_t			cbVolume,
+	unsigned int	cntReps,
+	bool			fUBCCheck,
+	bool			fPin,
+	fast_rng		&rng,
+	bench_results	&results)
+{
+	ScalingRecord	record;
+	const string	strModes[2] = { "nodetect", fUBCCheck ? "dc_ubc" : "dc_noubc" };
+
+	cout << "Hashing " << cbVolume << " bytes per thread, message size and mode, each thread with its own ring buffer of " << cbRing << " bytes" << (fPin ? ", pinned" : "") << "." << endl;
+	printf("threads\tbytes\tmode\t\taggregate GB/s\tper thread GB/s\tmin thread GB/s\tmax thread GB/s\tefficiency\n");
+
+	for (boost::tokenizer<boost::char_separator<char> >::iterator cur_token = tokens.begin(); cur_token != tokens.end(); ++cur_token)
+	{
+		size_t cbMessage = (size_t)atoi(cur_token.current_token().c_str());
+
+		for (int fDetect = 0; fDetect <= 1; fDetect++)
+		{
+			// efficiency relates the per thread throughput to that of the first (smallest) thread count
+			double gbpsPerThreadFirst = 0;
+
+			for (size_t t = 0; t < vecThreads.size(); t++)
+			{
+				if (0 != ThreadScalingTimings(cbMessage, cbRing, cbVolume, vecThreads[t], cntReps, (0 != fDetect), fUBCCheck, fPin, rng, &record))
+				{
+					cout << "Scaling timing failed for " << vecThreads[t] << " threads and message size " << cbMessage << "." << endl;
+					return -1;
+				}
+
+				double gbps = MedianOf(record.gbpsAggregate);
+				double gbpsPerThread = gbps / record.cntThreads;
+				if (0 == t)
+				{
+					gbpsPerThreadFirst = gbpsPerThread;
+				}
+				printf("%u\t%lu\t%-8s\t%f\t%f\t%f\t%f\t%f\n", record.cntThreads, record.cbMessage, strModes[fDetect].c_str(),
+					gbps, gbpsPerThread, MedianOf(record.gbpsMinThread), MedianOf(record.gbpsMaxThread), gbpsPerThread / gbpsPerThreadFirst);
+
+				results.record("scaling/" + to_string(record.cntThreads) + "/" + to_string(cbMessage) + "/" + strModes[fDetect], "throughput", "GB/s", true, record.gbpsAggregate);
+			}
+		}
+	}
+
+	return 0;
+}
+
+int PerformLatencyTimings(
+	boost::tokenizer<boost::char_separator<char> >	&tokens,
+	size_t			cntCalls,
+	unsigned int	cntBins,
+	fast_rng		&rng,
+	bench_results	&results)
+{
+	const double	percentiles[4] = { 50, 90, 99, 99.9 };
+	const char		*strPercentiles[4] = { "p50", "p90", "p99", "p99.9" };
+	vector<LatencyRecord>	records;
+
+	cout << "Timing " << cntCalls << " separate SHA1DCInit, SHA1DCUpdate, SHA1DCFinal calls per message size and mode (" << cycle_counter_unit() << ")." << endl;
+
+	for (boost::tokenizer<boost::char_separator<char> >::iterator cur_token = tokens.begin(); cur_token != tokens.end(); ++cur_token)
+	{
+		size_t cbMessage = (size_t)atoi(cur_token.current_token().c_str());
+
+		for (int mode = LATENCY_MODE_NODETECT; mode <= LATENCY_MODE_DC_UBC; mode++)
+		{
+			records.push_back(LatencyRecord());
+			if (0 != HashLatencyTimings(cbMessage, cntCalls, mode, rng, &records.back()))
+			{
+				cout << "Latency timing failed for message size " << cbMessage << "." << endl;
+				return -1;
+			}
+		}
+	}
+
+	printf("bytes\tmode\t\tmin\tp50\tp90\tp99\tp99.9\tmax\tmean\n");
+	for (vector<LatencyRecord>::const_iterator rec = records.begin(); rec != records.end(); rec++)
+	{
+		double mean = 0;
+		for (size_t i = 0; i < rec->cycles.size(); i++)
+		{
+			mean += (double)rec->cycles[i];
+		}
+		mean /= (double)rec->cycles.size();
+
+		printf("%lu\t%-8s\t%lu", rec->cbMessage, LatencyModeName(rec->mode), (unsigned long)rec->cycles.front());
+		for (int p = 0; p < 4; p++)
+		{
+			uint64_t cycles = LatencyPercentile(rec->cycles, percentiles[p]);
+			printf("\t%lu", (unsigned long)cycles);
+			results.record("latency/" + to_string(rec->cbMessage) + "/" + LatencyModeName(rec->mode), strPercentiles[p], cycle_counter_unit(), false, (double)cycles);
+		}
+		printf("\t%lu\t%.1f\n", (unsigned long)rec->cycles.back(), mean);
+	}
+	cout << "Timer overhead of " << records.front().overhead << " " << cycle_counter_unit() << " was subtracted from each call." << endl;
+
+	for (vector<LatencyRecord>::const_iterator rec = records.begin(); rec != records.end(); rec++)
+	{
+		cout << endl;
+		PrintLatencyHistogram(*rec, cntBins);
+	}
+
+	return 0;
+}
+
+int PerformGitObjectTimings(
+	const git_workload_model	&model,
+	size_t			cbVolume,
+	unsigned int	cntReps,
+	fast_rng		&rng,
+	bench_results	&results)
+{
+	const char		*strModes[3] = { "nodetect", "dc_noubc", "dc_ubc" };
+	git_workload	workload;
+	GitObjectRecord	record;
+	uint64_t		cntTypes[git_object_types], cbTypes[git_object_types];
+	uint64_t		cntBlocks = 0, cntContentBlocks = 0;
+
+	workload.generate(model, cbVolume, rng);
+	workload.type_totals(cntTypes, cbTypes);
+
+	// compressions per object: header, content and padding, against those of the content alone
+	for (vector<git_object>::const_iterator obj = workload.objects().begin(); obj != workload.objects().end(); obj++)
+	{
+		cntBlocks += (obj->header_size + obj->size + 9 + 63) / 64;
+		cntContentBlocks += (obj->size + 63) / 64;
+	}
+
+	cout << "Git object workload: " << model.describe() << endl;
+	cout << workload.objects().size() << " objects, " << workload.content_bytes() << " content bytes, " << workload.header_bytes() << " header bytes";
+	for (unsigned int t = 0; t < git_object_types; t++)
+	{
+		cout << ", " << cntTypes[t] << " " << git_object_type_name(t) << "s";
+	}
+	cout << "." << endl;
+	printf("%.3f compressions per object, %.1f%% of them for headers and padding.\n",
+		double(cntBlocks) / double(workload.objects().size()), 100.0 * double(cntBlocks - cntContentBlocks) / double(cntBlocks));
+	printf("mode\t\tobjects/s\tcontent GB/s\tstream GB/s\tobjects/stream\tns/object\n");
+
+	for (int mode = 0; mode < 3; mode++)
+	{
+		if (0 != GitObjectTimings(workload, cntReps, (0 != mode), (2 == mode), &record))
+		{
+			cout << "Git object timing failed." << endl;
+			return -1;
+		}
+
+		vector<double> objectsPerSec, gbps;
+		for (size_t i = 0; i < record.secObjects.size(); i++)
+		{
+			objectsPerSec.push_back(double(record.cntObjects) / record.secObjects[i]);
+			gbps.push_back(double(record.cbContent) / record.secObjects[i] / 1e9);
+		}
+		double secObjects = MedianOf(record.secObjects);
+		double secStream = MedianOf(record.secStream);
+		// the cost per object beyond hashing its bytes as part of one long message
+		double nsPerObject = (secObjects - secStream) * 1e9 / double(record.cntObjects);
+
+		printf("%-8s\t%.0f\t%f\t%f\t%f\t%.1f\n", strModes[mode], MedianOf(objectsPerSec), MedianOf(gbps),
+			double(record.cbContent + record.cbHeaders) / secStream / 1e9, secStream / secObjects, nsPerObject);
+
+		results.record(string("git/") + strModes[mode], "objects_per_sec", "objects/s", true, objectsPerSec);
+		results.record(string("git/") + strModes[mode], "throughput", "GB/s", true, gbps);
+		results.record(string("git/") + strModes[mode], "overhead_per_object", "ns", false, nsPerObject);
+	}
+
+	return 0;
+}
+
+void PrintCounterRecords(
+	const vector<HashTimingRecord>	&records,
+	perf_counters	*pCounters)
+{
+	if (NULL == pCounters)
+	{
+		return;
+	}
+
+	for (vector<HashTimingRecord>::const_iterator rec = records.begin(); rec != records.end(); rec++)
+	{
+		cout << rec->cntBytes << "\tcounters ";
+		rec->countersHashing.print(cout, double(rec->cntBytes) * double(rec->cntIterations), "SHA1DCUpdate byte");
+		cout << endl;
+	}
+}
+
 int main(int argc, char** argv)
 {
 	unsigned int uiSeed;
 
 	string strCounts;
 	string strSeed;
+	string strResults;
+	string strRing;
+	size_t cbVolume;
+	unsigned int cntReps;
+	string strThreads;
+	vector<unsigned int> vecThreads;
+	size_t cntCalls;
+	unsigned int cntBins;
+	string strGitFit;
+	git_workload_model gitModel;
 
 	boost::char_separator<char> sep(",;");
 
@@ -237,13 +536,32 @@ int main(int argc, char** argv)
 
 	bool fUBCCheck = false;
 
+	perf_counters counters;
+	perf_counters *pCounters = NULL;
+
+	bench_results results;
+
 	po::options_description desc("Allowed options");
 
 	desc.add_options()
 		("help,h", "Show options")
 		("counts,c", po::value<string>(&strCounts)->default_value("32,64,128,256"), "Count of bytes to hash.")
 		("seed,s", po::value<string>(&strSeed), "Seed to use for rand.")
-		("UBC,u", "Enable Unavoidable Bit Condition checks.");
+		("UBC,u", "Enable Unavoidable Bit Condition checks.")
+		("counters", "Report hardware performance counters per hashed byte.")
+		("results", po::value<string>(&strResults), "Append results as JSON lines to this file, or to <host>_<cpu>.jsonl in this directory.")
+		("stream", "Measure steady-state throughput hashing messages of the given counts of bytes from one ring buffer.")
+		("ring", po::value<string>(&strRing)->default_value("l2"), "Ring buffer size for --stream and --threads: l2, llc, dram or a number of bytes.")
+		("volume", po::value<size_t>(&cbVolume)->default_value((size_t)1 << 30), "Bytes to hash per message size, mode and repetition (and thread) for --stream and --threads.")
+		("reps", po::value<unsigned int>(&cntReps)->default_value(3), "Repetitions per message size, and for --stream and --threads, where the median is reported.")
+		("threads,t", po::value<string>(&strThreads), "Measure scaling over these thread counts, e.g. 1,2,4,8; each thread streams from its own --ring buffer.")
+		("pin", "Pin the --threads threads to one cpu each.")
+		("latency", "Measure the latency distribution of single hash calls on messages of the given counts of bytes, without detection and with detection without and with UBC.")
+		("calls", po::value<size_t>(&cntCalls)->default_value((size_t)1 << 20), "Timed calls per message size and mode for --latency.")
+		("bins", po::value<unsigned int>(&cntBins)->default_value(20), "Histogram bins up to the 99.9th percentile for --latency, 0 for no histograms.")
+		("git", "Measure hashing a workload of git objects as git does, reporting objects/s and bytes/s; --volume sets the content bytes (default 64 MiB here).")
+		("gitfit", po::value<string>(&strGitFit), "Fit the --git object sizes to the output of git cat-file --batch-all-objects --batch-check='%(objecttype) %(objectsize)' in this file.")
+		("compressibility", po::value<double>(&gitModel.compressibility)->default_value(gitModel.compressibility), "Fraction of --git blobs with text instead of random content.");
 	po::variables_map vm;
 	po::store(po::command_line_parser(argc, argv).options(desc).run(), vm);
 	po::notify(vm);
@@ -251,10 +569,12 @@ int main(int argc, char** argv)
 	boost::tokenizer<boost::char_separator<char> > tokens(strCounts, sep);
 	boost::tokenizer<boost::char_separator<char> >::iterator cur_token;
 
-	br::mt19937		rng;
+	fast_rng		rng;
 
 	vector<HashTimingRecord>	records;
 	vector<HashTimingRecord>	records_no_detect;
+	vector<vector<double> >	vecNsPerByte;
+	vector<vector<double> >	vecNsPerByteNoDetect;
 
 	HashTimingRecord	*phash_timing_record = NULL;
 	HashTimingRecord	*phash_timing_record_no_detect = NULL;
@@ -284,7 +604,67 @@ int main(int argc, char** argv)
 		cout << "Performing unavoidable bit condition checks." << endl;
 	}
 
-	rng = br::mt19937(uiSeed);
+	if (0 < vm.count("counters"))
+	{
+		if (counters.available())
+		{
+			pCounters = &counters;
+		}
+		else
+		{
+			cout << "Hardware performance counters are not available." << endl;
+		}
+	}
+
+	if (0 < vm.count("results"))
+	{
+		if (!results.open(strResults, "perftest"))
+		{
+			cout << "Could not open " << results.filename() << "." << endl;
+			goto Cleanup;
+		}
+	}
+
+	rng = fast_rng(uiSeed);
+
+	if (0 < vm.count("git"))
+	{
+		if (0 < vm.count("gitfit"))
+		{
+			ifstream ifsFit(strGitFit.c_str());
+			string strError;
+			if (!ifsFit || !gitModel.fit(ifsFit, strError))
+			{
+				cout << "Could not fit the git object sizes to " << strGitFit << (strError.empty() ? "" : ": ") << strError << "." << endl;
+				goto Cleanup;
+			}
+		}
+		ret = PerformGitObjectTimings(gitModel, vm["volume"].defaulted() ? ((size_t)1 << 26) : cbVolume, cntReps, rng, results);
+		goto Cleanup;
+	}
+
+	if (0 < vm.count("latency"))
+	{
+		ret = PerformLatencyTimings(tokens, cntCalls, cntBins, rng, results);
+		goto Cleanup;
+	}
+
+	if (0 < vm.count("threads"))
+	{
+		boost::tokenizer<boost::char_separator<char> > tokensThreads(strThreads, sep);
+		for (boost::tokenizer<boost::char_separator<char> >::iterator it = tokensThreads.begin(); it != tokensThreads.end(); ++it)
+		{
+			vecThreads.push_back((unsigned int)atoi(it->c_str()));
+		}
+		ret = PerformScalingTimings(tokens, vecThreads, StreamingRingBytes(strRing), cbVolume, cntReps, fUBCCheck, (0 < vm.count("pin")), rng, results);
+		goto Cleanup;
+	}
+
+	if (0 < vm.count("stream"))
+	{
+		ret = PerformStreamingTimings(tokens, StreamingRingBytes(strRing), cbVolume, cntReps, fUBCCheck, rng, results);
+		goto Cleanup;
+	}
 
 	phash_timing_record = (HashTimingRecord*)malloc(sizeof(HashTimingRecord));
 	phash_timing_record_no_detect = (HashTimingRecord*)malloc(sizeof(HashTimingRecord));
@@ -295,8 +675,16 @@ int main(int argc, char** argv)
 		size_t cntIterations = (size_t)ceil((double)(1 << 24) / cntBytes);
 		cout << "Performing timing for: <" << cntBytes << "> ";
 
-		GenRandomAndPerformHashTimings(cntBytes, cntIterations, rng, phash_timing_record, fUBCCheck);
-		GenRandomAndPerformHashTimings_NoDetect(cntBytes, cntIterations, rng, phash_timing_record_no_detect, fUBCCheck);
+		// the tables show the last repetition, the results store gets all of them
+		vecNsPerByte.push_back(vector<double>());
+		vecNsPerByteNoDetect.push_back(vector<double>());
+		for (unsigned int rep = 0; rep < max(1u, cntReps); ++rep)
+		{
+			GenRandomAndPerformHashTimings(cntBytes, cntIterations, rng, phash_timing_record, fUBCCheck, pCounters);
+			GenRandomAndPerformHashTimings_NoDetect(cntBytes, cntIterations, rng, phash_timing_record_no_detect, fUBCCheck, pCounters);
+			vecNsPerByte.back().push_back(NsPerByte(*phash_timing_record));
+			vecNsPerByteNoDetect.back().push_back(NsPerByte(*phash_timing_record_no_detect));
+		}
 
 		records.push_back(*phash_timing_record);
  		records_no_detect.push_back(*phash_timing_record_no_detect);
@@ -313,6 +701,9 @@ int main(int argc, char** argv)
 		printf("%li\t\t%li\t\t%li\t\t%li\n", rec->timesOverhead.wall, rec->timesOverhead.user, rec->timesOverhead.system, (rec->timesOverhead.user + rec->timesOverhead.system));
 	}
 
+	PrintCounterRecords(records, pCounters);
+	RecordResults(records, vecNsPerByte, fUBCCheck ? "dc_ubc" : "dc_noubc", results);
+
 	// top of columns
 	printf("bytes\titerations\thashing wall\thashing user\thashing system\thashing total\toverhead wall\toverhead user\toverhead system\toverhead total\n");
 
@@ -323,6 +714,9 @@ int main(int argc, char** argv)
 		printf("%li\t\t%li\t\t%li\t\t%li\n", rec->timesOverhead.wall, rec->timesOverhead.user, rec->timesOverhead.system, (rec->timesOverhead.user + rec->timesOverhead.system));
 	}
 
+	PrintCounterRecords(records_no_detect, pCounters);
+	RecordResults(records_no_detect, vecNsPerByteNoDetect, "nodetect", results);
+
 	ret = 0;
 
 Cleanup:
@@ -14,16 +14,11 @@ using namespace std;
 int GenRandomBytes(
 	unsigned char*	pb,
 	size_t			cb,
-	br::mt19937		&rng)
+	fast_rng		&rng)
 {
-	size_t i;
+	rng.fill(pb, cb);
 
-	for (i = 0; i < cb; i++)
-	{
-		pb[i] = (unsigned char)rng();
-	}
-
-	return i;
+	return (int)cb;
 
 }
 
@@ -39,7 +34,7 @@ int HashRandomBytes(
 
 	int i = cntBytesToHash;
 
-	br::mt19937 rng(uiSeed);
+	fast_rng rng(uiSeed);
 	cout << "Hashing...";
 	SHA1DCInit(&ctx);
 
@@ -81,7 +76,7 @@ int UBCVerifyRandomBytes(
 
 	int i = cntBytesToHash;
 
-	br::mt19937 rng(uiSeed);
+	fast_rng rng(uiSeed);
 	cout << "Unavoidable bit checking...";
 
 	while (0 < i)
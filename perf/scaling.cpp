@@ -0,0 +1,174 @@
+#include <string.h>
+#include <stdio.h>
+#include <algorithm>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#include <iostream>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "test_util_lib.h"
+#include "../common/aligned_arena.hpp"
+
+using namespace std;
+
+// a reusable barrier: all threads leave Wait() together once the last one arrived
+class ThreadBarrier
+{
+public:
+	explicit ThreadBarrier(unsigned int cntThreads)
+		: cntThreads(cntThreads), cntWaiting(0), generation(0)
+	{
+	}
+
+	void Wait()
+	{
+		unique_lock<mutex> lock(mtx);
+		unsigned int gen = generation;
+		if (++cntWaiting == cntThreads)
+		{
+			cntWaiting = 0;
+			generation++;
+			cv.notify_all();
+			return;
+		}
+		cv.wait(lock, [this, gen] { return gen != generation; });
+	}
+
+private:
+	mutex mtx;
+	condition_variable cv;
+	unsigned int cntThreads;
+	unsigned int cntWaiting;
+	unsigned int generation;
+};
+
+typedef struct _ScalingThreadResult
+{
+	vector<chrono::steady_clock::time_point>	start;
+	vector<chrono::steady_clock::time_point>	end;
+} ScalingThreadResult;
+
+bool PinCurrentThread(
+	unsigned int	uiCpu)
+{
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(uiCpu, &set);
+	return 0 == pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+	(void)uiCpu;
+	return false;
+#endif
+}
+
+// each thread owns its ring buffer (allocated and filled by the thread itself so that it is
+// local to its core), hashes an untimed warm-up pass over it and then cntReps timed
+// repetitions of cntMessages messages that all threads start together
+void ScalingWorker(
+	unsigned int	uiThread,
+	unsigned int	uiSeed,
+	size_t			cbMessage,
+	size_t			cbRing,
+	size_t			cntMessages,
+	unsigned int	cntReps,
+	bool			fDetect,
+	bool			fUBCCheck,
+	bool			fPin,
+	ThreadBarrier	*pBarrier,
+	ScalingThreadResult	*pResult)
+{
+	if (fPin && !PinCurrentThread(uiThread % max(1u, thread::hardware_concurrency())))
+	{
+		cout << "Could not pin thread " << uiThread << "." << endl;
+	}
+
+	fast_rng rng(uiSeed, uiThread);
+	aligned_arena<unsigned char> ring(cbRing);
+	GenRandomBytes(ring.data(), cbRing, rng);
+
+	size_t posRing = 0;
+	HashRingMessages(ring.data(), cbRing, &posRing, cbMessage, (cbRing + cbMessage - 1) / cbMessage, fDetect, fUBCCheck);
+
+	for (unsigned int rep = 0; rep < cntReps; rep++)
+	{
+		pBarrier->Wait();
+		pResult->start[rep] = chrono::steady_clock::now();
+		HashRingMessages(ring.data(), cbRing, &posRing, cbMessage, cntMessages, fDetect, fUBCCheck);
+		pResult->end[rep] = chrono::steady_clock::now();
+	}
+}
+
+// hashes cbVolume bytes per thread on cntThreads threads at once and records for each repetition
+// the aggregate throughput (all bytes over the time from the first start to the last finish)
+// and the throughput of the slowest and fastest thread
+int ThreadScalingTimings(
+	size_t			cbMessage,
+	size_t			cbRing,
+	size_t			cbVolume,
+	unsigned int	cntThreads,
+	unsigned int	cntReps,
+	bool			fDetect,
+	bool			fUBCCheck,
+	bool			fPin,
+	fast_rng		&rng,
+	ScalingRecord	*pScalingRecord)
+{
+	if ((0 == cbMessage) || (0 == cbRing) || (0 == cntThreads) || (0 == cntReps))
+	{
+		return -1;
+	}
+
+	size_t cntMessages = (cbVolume + cbMessage - 1) / cbMessage;
+	double cbThread = (double)(cntMessages * cbMessage);
+
+	ThreadBarrier barrier(cntThreads);
+	vector<ScalingThreadResult> results(cntThreads);
+	vector<thread> threads;
+	// all threads share the seed and each generates its own stream
+	unsigned int uiSeed = rng();
+
+	for (unsigned int i = 0; i < cntThreads; i++)
+	{
+		results[i].start.resize(cntReps);
+		results[i].end.resize(cntReps);
+		threads.push_back(thread(ScalingWorker, i, uiSeed, cbMessage, cbRing, cntMessages, cntReps, fDetect, fUBCCheck, fPin, &barrier, &results[i]));
+	}
+	for (unsigned int i = 0; i < cntThreads; i++)
+	{
+		threads[i].join();
+	}
+
+	pScalingRecord->cntThreads = cntThreads;
+	pScalingRecord->cbMessage = cbMessage;
+	pScalingRecord->gbpsAggregate.clear();
+	pScalingRecord->gbpsMinThread.clear();
+	pScalingRecord->gbpsMaxThread.clear();
+
+	for (unsigned int rep = 0; rep < cntReps; rep++)
+	{
+		chrono::steady_clock::time_point first = results[0].start[rep], last = results[0].end[rep];
+		double gbpsMin = 0, gbpsMax = 0;
+		for (unsigned int i = 0; i < cntThreads; i++)
+		{
+			first = min(first, results[i].start[rep]);
+			last = max(last, results[i].end[rep]);
+			double gbps = cbThread / (double)chrono::duration_cast<chrono::nanoseconds>(results[i].end[rep] - results[i].start[rep]).count();
+			gbpsMin = (0 == i) ? gbps : min(gbpsMin, gbps);
+			gbpsMax = (0 == i) ? gbps : max(gbpsMax, gbps);
+		}
+		pScalingRecord->gbpsAggregate.push_back(cbThread * cntThreads / (double)chrono::duration_cast<chrono::nanoseconds>(last - first).count());
+		pScalingRecord->gbpsMinThread.push_back(gbpsMin);
+		pScalingRecord->gbpsMaxThread.push_back(gbpsMax);
+	}
+
+	return 0;
+}
@@ -0,0 +1,156 @@
+#include <string.h>
+#include <stdio.h>
+#include <algorithm>
+#include <vector>
+
+#include <iostream>
+
+#include "sha1.h"
+
+#include "test_util_lib.h"
+#include "../common/aligned_arena.hpp"
+
+#include <boost/timer/timer.hpp>
+
+using namespace std;
+
+size_t StreamingRingBytes(
+	const string	&strRing)
+{
+	cache_sizes cs = detect_cache_sizes();
+	vector<working_set> sets = cache_working_sets(cs);
+
+	if ("l2" == strRing)
+	{
+		return sets[1].bytes;
+	}
+	if ("llc" == strRing)
+	{
+		return sets[2].bytes;
+	}
+	if ("dram" == strRing)
+	{
+		return sets[3].bytes;
+	}
+	return (size_t)strtoull(strRing.c_str(), NULL, 10);
+}
+
+// hashes cntMessages successive messages of cbMessage bytes from the ring starting at *pPosRing,
+// a message may wrap around the end of the ring
+void HashRingMessages(
+	const unsigned char	*pbRing,
+	size_t			cbRing,
+	size_t			*pPosRing,
+	size_t			cbMessage,
+	size_t			cntMessages,
+	bool			fDetect,
+	bool			fUBCCheck)
+{
+	SHA1_CTX ctx;
+	unsigned char hash[20];
+
+	size_t posRing = *pPosRing;
+
+	for (size_t i = 0; i < cntMessages; i++)
+	{
+		SHA1DCInit(&ctx);
+		if (!fDetect)
+		{
+			SHA1DCSetUseDetectColl(&ctx, 0);
+		}
+		else if (!fUBCCheck)
+		{
+			SHA1DCSetUseUBC(&ctx, 0);
+		}
+
+		size_t cbLeft = cbMessage;
+		while (0 < cbLeft)
+		{
+			size_t cb = min(cbLeft, cbRing - posRing);
+			SHA1DCUpdate(&ctx, (const char*)&pbRing[posRing], cb);
+			cbLeft -= cb;
+			posRing += cb;
+			if (posRing == cbRing)
+			{
+				posRing = 0;
+			}
+		}
+
+		SHA1DCFinal(hash, &ctx);
+	}
+
+	*pPosRing = posRing;
+}
+
+// hashes cbVolume bytes as successive messages of cbMessage bytes taken from a ring buffer,
+// once without and once with collision detection per repetition; the ring is filled and
+// hashed once before timing so that only steady-state hashing is measured
+int StreamingHashTimings(
+	size_t			cbMessage,
+	size_t			cbRing,
+	size_t			cbVolume,
+	unsigned int	cntReps,
+	bool			fUBCCheck,
+	fast_rng		&rng,
+	StreamingRecord	*pStreamingRecord)
+{
+	int ret = -1;
+
+	size_t cntMessages = 0;
+	size_t posRing = 0;
+
+	if ((0 == cbMessage) || (0 == cbRing) || (0 == cntReps))
+	{
+		goto Cleanup;
+	}
+
+	{
+		aligned_arena<unsigned char> ring(cbRing);
+
+		GenRandomBytes(ring.data(), cbRing, rng);
+
+		cntMessages = (cbVolume + cbMessage - 1) / cbMessage;
+
+		pStreamingRecord->cbMessage = cbMessage;
+		pStreamingRecord->cbRing = cbRing;
+		pStreamingRecord->cbHashed = cntMessages * cbMessage;
+		pStreamingRecord->gbpsDetect.clear();
+		pStreamingRecord->gbpsNoDetect.clear();
+
+		// fDetect == false: no collision detection, fDetect == true: collision detection (with UBC if fUBCCheck)
+		for (unsigned int rep = 0; rep <= cntReps; rep++)
+		{
+			for (int fDetect = 0; fDetect <= 1; fDetect++)
+			{
+				// the first repetition warms up caches, TLB and clock frequency and is not recorded
+				size_t cntMessagesRep = (0 == rep) ? (cbRing + cbMessage - 1) / cbMessage : cntMessages;
+
+				boost::timer::cpu_timer t;
+				t.start();
+
+				HashRingMessages(ring.data(), cbRing, &posRing, cbMessage, cntMessagesRep, (0 != fDetect), fUBCCheck);
+
+				t.stop();
+
+				if (0 < rep)
+				{
+					double gbps = (double)(cntMessagesRep * cbMessage) / (double)t.elapsed().wall;
+					if (fDetect)
+					{
+						pStreamingRecord->gbpsDetect.push_back(gbps);
+					}
+					else
+					{
+						pStreamingRecord->gbpsNoDetect.push_back(gbps);
+					}
+				}
+			}
+		}
+	}
+
+	ret = 0;
+
+Cleanup:
+
+	return ret;
+}
@@ -1,11 +1,14 @@
-#include <boost/random/mersenne_twister.hpp>
+#include <stdint.h>
+#include <string>
+#include <vector>
 
-namespace br = boost::random;
+#include "../common/fast_rng.hpp"
+#include "../common/git_workload.hpp"
 
 int GenRandomBytes(
 	unsigned char*	pb,
 	size_t			cb,
-	br::mt19937		&rng);
+	fast_rng		&rng);
 
 int HashRandomBytes(
 	size_t			cntBytesToHash,
@@ -14,3 +17,100 @@ int HashRandomBytes(
 int UBCVerifyRandomBytes(
 	size_t			cntBytesToHash,
 	unsigned int	uiSeed);
+
+typedef struct _StreamingRecord
+{
+	size_t	cbMessage;
+	size_t	cbRing;
+	size_t	cbHashed;
+	std::vector<double>	gbpsDetect;
+	std::vector<double>	gbpsNoDetect;
+} StreamingRecord;
+
+void HashRingMessages(
+	const unsigned char	*pbRing,
+	size_t			cbRing,
+	size_t			*pPosRing,
+	size_t			cbMessage,
+	size_t			cntMessages,
+	bool			fDetect,
+	bool			fUBCCheck);
+
+size_t StreamingRingBytes(
+	const std::string	&strRing);
+
+int StreamingHashTimings(
+	size_t			cbMessage,
+	size_t			cbRing,
+	size_t			cbVolume,
+	unsigned int	cntReps,
+	bool			fUBCCheck,
+	fast_rng		&rng,
+	StreamingRecord	*pStreamingRecord);
+
+typedef struct _ScalingRecord
+{
+	unsigned int	cntThreads;
+	size_t	cbMessage;
+	std::vector<double>	gbpsAggregate;
+	std::vector<double>	gbpsMinThread;
+	std::vector<double>	gbpsMaxThread;
+} ScalingRecord;
+
+int ThreadScalingTimings(
+	size_t			cbMessage,
+	size_t			cbRing,
+	size_t			cbVolume,
+	unsigned int	cntThreads,
+	unsigned int	cntReps,
+	bool			fDetect,
+	bool			fUBCCheck,
+	bool			fPin,
+	fast_rng		&rng,
+	ScalingRecord	*pScalingRecord);
+
+#define LATENCY_MODE_NODETECT	0
+#define LATENCY_MODE_DC_NOUBC	1
+#define LATENCY_MODE_DC_UBC		2
+
+typedef struct _LatencyRecord
+{
+	size_t	cbMessage;
+	int		mode;
+	uint64_t	overhead;
+	std::vector<uint64_t>	cycles;
+} LatencyRecord;
+
+const char* LatencyModeName(
+	int		mode);
+
+int HashLatencyTimings(
+	size_t			cbMessage,
+	size_t			cntCalls,
+	int				mode,
+	fast_rng		&rng,
+	LatencyRecord	*pLatencyRecord);
+
+uint64_t LatencyPercentile(
+	const std::vector<uint64_t>	&cycles,
+	double						percentile);
+
+void PrintLatencyHistogram(
+	const LatencyRecord	&record,
+	unsigned int		cntBins);
+
+typedef struct _GitObjectRecord
+{
+	size_t	cntObjects;
+	uint64_t	cbContent;
+	uint64_t	cbHeaders;
+	std::vector<double>	secObjects;
+	std::vector<double>	secStream;
+} GitObjectRecord;
+
+int GitObjectTimings(
+	const git_workload	&workload,
+	unsigned int		cntReps,
+	bool				fDetect,
+	bool				fUBCCheck,
+	GitObjectRecord		*pGitObjectRecord);
@@ -0,0 +1,400 @@
+/***
+* Copyright 2017 Marc Stevens <marc@marc-stevens.nl>, Dan Shumow <danshu@microsoft.com>
+* Distributed under the MIT Software License.
+* See accompanying file LICENSE.txt or copy at
+* https://opensource.org/licenses/MIT
+***/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // O_DIRECT
+#endif
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <new>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#include "io_backends.hpp"
+
+using namespace std;
+
+const char* io_backend_name(io_backend backend)
+{
+	switch (backend)
+	{
+	case io_read: return "read";
+	case io_mmap: return "mmap";
+	case io_direct: return "direct";
+	case io_uring: return "uring";
+	}
+	return "unknown";
+}
+
+bool parse_io_backend(const string& name, io_backend& backend)
+{
+	const io_backend all[] = { io_read, io_mmap, io_direct, io_uring };
+	for (unsigned i = 0; i < sizeof(all) / sizeof(all[0]); ++i)
+		if (name == io_backend_name(all[i]))
+		{
+			backend = all[i];
+			return true;
+		}
+	return false;
+}
+
+bool io_backend_available(io_backend backend)
+{
+#ifdef HAVE_LIBURING
+	(void)backend;
+	return true;
+#else
+	return backend != io_uring;
+#endif
+}
+
+namespace {
+
+	// O_DIRECT requires the buffer, offsets and lengths to be aligned to the logical block size,
+	// a page covers all common devices
+	const size_t direct_alignment = 4096;
+
+	string errno_string(const char* what)
+	{
+		return string(what) + ": " + strerror(errno);
+	}
+
+	// a page aligned buffer
+	class page_buffer
+	{
+	public:
+		explicit page_buffer(size_t bytes)
+			: ptr(0), len(bytes)
+		{
+			if (posix_memalign(&ptr, direct_alignment, bytes) != 0)
+				throw std::bad_alloc();
+		}
+		~page_buffer() { free(ptr); }
+		char* data() { return static_cast<char*>(ptr); }
+		size_t size() const { return len; }
+	private:
+		void* ptr;
+		size_t len;
+		page_buffer(const page_buffer&);
+		page_buffer& operator=(const page_buffer&);
+	};
+
+	// closes the file descriptor when leaving scope
+	struct fd_guard
+	{
+		int fd;
+		explicit fd_guard(int f) : fd(f) {}
+		~fd_guard() { if (fd >= 0) close(fd); }
+	};
+
+	// reads fd to the end into buf, passing each filled piece to consume
+	bool read_to_end(int fd, char* buf, size_t bufsize, const file_consumer& consume, string& error)
+	{
+		while (true)
+		{
+			ssize_t len = read(fd, buf, bufsize);
+			if (len < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				error = errno_string("read");
+				return false;
+			}
+			if (len == 0)
+				return true;
+			consume(buf, size_t(len));
+		}
+	}
+
+	class read_reader : public file_reader
+	{
+	public:
+		explicit read_reader(size_t bufsize) : buffer(bufsize) {}
+
+		bool read_file(const string& path, uint64_t size, const file_consumer& consume, string& error)
+		{
+			fd_guard fd(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+			if (fd.fd < 0)
+			{
+				error = errno_string("open");
+				return false;
+			}
+#ifdef POSIX_FADV_SEQUENTIAL
+			// small files fit in one read, the advice only pays off for larger ones
+			if (size > buffer.size())
+				posix_fadvise(fd.fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+			return read_to_end(fd.fd, buffer.data(), buffer.size(), consume, error);
+		}
+
+	private:
+		page_buffer buffer;
+	};
+
+	class mmap_reader : public file_reader
+	{
+	public:
+		bool read_file(const string& path, uint64_t, const file_consumer& consume, string& error)
+		{
+			fd_guard fd(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+			if (fd.fd < 0)
+			{
+				error = errno_string("open");
+				return false;
+			}
+			// map the current size, the one from the directory walk may be stale
+			struct stat st;
+			if (fstat(fd.fd, &st) != 0)
+			{
+				error = errno_string("fstat");
+				return false;
+			}
+			if (st.st_size == 0)
+				return true;
+			size_t len = size_t(st.st_size);
+			void* p = mmap(0, len, PROT_READ, MAP_PRIVATE, fd.fd, 0);
+			if (p == MAP_FAILED)
+			{
+				error = errno_string("mmap");
+				return false;
+			}
+			madvise(p, len, MADV_SEQUENTIAL);
+			madvise(p, len, MADV_WILLNEED);
+			consume(static_cast<const char*>(p), len);
+			munmap(p, len);
+			return true;
+		}
+	};
+
+	class direct_reader : public file_reader
+	{
+	public:
+		explicit direct_reader(size_t bufsize)
+			: buffer(((bufsize + direct_alignment - 1) / direct_alignment) * direct_alignment)
+		{
+		}
+
+		bool read_file(const string& path, uint64_t, const file_consumer& consume, string& error)
+		{
+			fd_guard fd(open(path.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECT));
+			if (fd.fd < 0 && errno == EINVAL)
+			{
+				// e.g. tmpfs does not support O_DIRECT
+				++fallbacks;
+				fd.fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+			}
+			if (fd.fd < 0)
+			{
+				error = errno_string("open");
+				return false;
+			}
+			// reads at the (unaligned) end of the file simply return fewer bytes
+			return read_to_end(fd.fd, buffer.data(), buffer.size(), consume, error);
+		}
+
+	private:
+		page_buffer buffer;
+	};
+
+#ifdef HAVE_LIBURING
+	// keeps up to queue_depth reads of consecutive chunks of the file in flight and passes the
+	// chunks to consume in file order as they complete, resubmitting each consumed buffer for the
+	// next chunk not yet requested
+	class uring_reader : public file_reader
+	{
+	public:
+		uring_reader(size_t bufsize, unsigned queue_depth)
+			: chunk(bufsize), depth(queue_depth ? queue_depth : 1), buffer(chunk * depth), slots(depth)
+		{
+			int ret = io_uring_queue_init(depth, &ring, 0);
+			if (ret < 0)
+			{
+				errno = -ret;
+				throw std::runtime_error(errno_string("io_uring_queue_init"));
+			}
+		}
+
+		~uring_reader()
+		{
+			io_uring_queue_exit(&ring);
+		}
+
+		bool read_file(const string& path, uint64_t, const file_consumer& consume, string& error)
+		{
+			fd_guard fd(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+			if (fd.fd < 0)
+			{
+				error = errno_string("open");
+				return false;
+			}
+			struct stat st;
+			if (fstat(fd.fd, &st) != 0)
+			{
+				error = errno_string("fstat");
+				return false;
+			}
+			uint64_t size = uint64_t(st.st_size), next = 0;
+			deque<unsigned> order;
+			for (unsigned s = 0; s < depth && next < size; ++s)
+			{
+				submit(fd.fd, s, next, size);
+				order.push_back(s);
+			}
+			bool ok = submit_pending(error);
+
+			while (ok && !order.empty())
+			{
+				slot& front = slots[order.front()];
+				while (ok && !front.done)
+					ok = complete_one(error);
+				if (!ok)
+					break;
+				if (front.res < 0)
+				{
+					errno = -front.res;
+					error = errno_string("read");
+					ok = false;
+					break;
+				}
+				// finish short reads synchronously, the later chunks are already on their way
+				size_t have = size_t(front.res);
+				while (have < front.len)
+				{
+					ssize_t len = pread(fd.fd, buf(order.front()) + have, front.len - have, off_t(front.offset + have));
+					if (len < 0 && errno == EINTR)
+						continue;
+					if (len <= 0)
+					{
+						error = (len < 0) ? errno_string("pread") : string("file shrank while reading");
+						ok = false;
+						break;
+					}
+					have += size_t(len);
+				}
+				if (!ok)
+					break;
+				consume(buf(order.front()), front.len);
+
+				unsigned s = order.front();
+				order.pop_front();
+				if (next < size)
+				{
+					submit(fd.fd, s, next, size);
+					order.push_back(s);
+					ok = submit_pending(error);
+				}
+			}
+
+			// the buffers may not be reused while reads into them are still in flight
+			while (inflight > 0)
+			{
+				string ignored;
+				if (!complete_one(ignored))
+					break;
+			}
+			return ok;
+		}
+
+	private:
+		struct slot
+		{
+			uint64_t offset;
+			size_t len;
+			int res;
+			bool done;
+		};
+
+		size_t chunk;
+		unsigned depth;
+		page_buffer buffer;
+		vector<slot> slots;
+		struct io_uring ring;
+		unsigned inflight = 0;
+
+		char* buf(unsigned s) { return buffer.data() + size_t(s) * chunk; }
+
+		void submit(int fd, unsigned s, uint64_t& next, uint64_t size)
+		{
+			slot& sl = slots[s];
+			sl.offset = next;
+			sl.len = size_t((size - next < chunk) ? size - next : chunk);
+			sl.res = 0;
+			sl.done = false;
+			next += sl.len;
+			struct io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+			io_uring_prep_read(sqe, fd, buf(s), unsigned(sl.len), sl.offset);
+			io_uring_sqe_set_data(sqe, &sl);
+			++inflight;
+		}
+
+		bool submit_pending(string& error)
+		{
+			int ret = io_uring_submit(&ring);
+			if (ret < 0)
+			{
+				errno = -ret;
+				error = errno_string("io_uring_submit");
+				return false;
+			}
+			return true;
+		}
+
+		bool complete_one(string& error)
+		{
+			struct io_uring_cqe* cqe = 0;
+			int ret = io_uring_wait_cqe(&ring, &cqe);
+			if (ret == -EINTR)
+				return true;
+			if (ret < 0)
+			{
+				errno = -ret;
+				error = errno_string("io_uring_wait_cqe");
+				return false;
+			}
+			slot* sl = static_cast<slot*>(io_uring_cqe_get_data(cqe));
+			sl->res = cqe->res;
+			sl->done = true;
+			--inflight;
+			io_uring_cqe_seen(&ring, cqe);
+			return true;
+		}
+	};
+#endif // HAVE_LIBURING
+
+} // namespace
+
+std::unique_ptr<file_reader> make_file_reader(io_backend backend, size_t bufsize, unsigned queue_depth)
+{
+	switch (backend)
+	{
+	case io_read:
+		return std::unique_ptr<file_reader>(new read_reader(bufsize));
+	case io_mmap:
+		return std::unique_ptr<file_reader>(new mmap_reader());
+	case io_direct:
+		return std::unique_ptr<file_reader>(new direct_reader(bufsize));
+	case io_uring:
+#ifdef HAVE_LIBURING
+		return std::unique_ptr<file_reader>(new uring_reader(bufsize, queue_depth));
+#else
+		break;
+#endif
+	}
+	(void)queue_depth;
+	return std::unique_ptr<file_reader>();
+}
@@ -0,0 +1,59 @@
+/***
+* Copyright 2017 Marc Stevens <marc@marc-stevens.nl>, Dan Shumow <danshu@microsoft.com>
+* Distributed under the MIT Software License.
+* See accompanying file LICENSE.txt or copy at
+* https://opensource.org/licenses/MIT
+***/
+
+#ifndef SCAN_IO_BACKENDS_HPP
+#define SCAN_IO_BACKENDS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+
+// the ways the scanner can read files:
+// read:   buffered read() into a reusable buffer, with sequential read-ahead advice
+// mmap:   the whole file mapped at once with MADV_SEQUENTIAL and MADV_WILLNEED
+// direct: O_DIRECT read() into a page aligned buffer, bypassing the page cache
+//         (falls back to buffered reads on file systems that do not support it)
+// uring:  io_uring with several reads in flight per file (only when built with HAVE_LIBURING)
+enum io_backend
+{
+	io_read,
+	io_mmap,
+	io_direct,
+	io_uring
+};
+
+const char* io_backend_name(io_backend backend);
+bool parse_io_backend(const std::string& name, io_backend& backend);
+bool io_backend_available(io_backend backend);
+
+// receives the contents of a file in order, in one or more pieces
+typedef std::function<void(const char* data, size_t len)> file_consumer;
+
+// reads whole files for one worker thread, owning its buffers (and io_uring instance)
+class file_reader
+{
+public:
+	virtual ~file_reader() {}
+
+	// passes the contents of 'path' to 'consume', returns false with a description in 'error' on failure
+	virtual bool read_file(const std::string& path, uint64_t size, const file_consumer& consume, std::string& error) = 0;
+
+	// number of files that could not be opened with O_DIRECT and were read buffered instead
+	uint64_t direct_fallbacks() const { return fallbacks; }
+
+protected:
+	file_reader() : fallbacks(0) {}
+	uint64_t fallbacks;
+};
+
+// 'bufsize' is the size of each read, 'queue_depth' the number of reads in flight for io_uring
+std::unique_ptr<file_reader> make_file_reader(io_backend backend, size_t bufsize, unsigned queue_depth);
+
+#endif // SCAN_IO_BACKENDS_HPP
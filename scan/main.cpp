@@ -0,0 +1,409 @@
+/***
+* Copyright 2017 Marc Stevens <marc@marc-stevens.nl>, Dan Shumow <danshu@microsoft.com>
+* Distributed under the MIT Software License.
+* See accompanying file LICENSE.txt or copy at
+* https://opensource.org/licenses/MIT
+***/
+
+#include <cstdio>
+#include <cstdint>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <stdexcept>
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+
+#include "../common/bench_results.hpp"
+#include "../common/sha1dc_stream.hpp"
+#include "io_backends.hpp"
+#include "two_phase.hpp"
+
+extern "C"
+{
+#include "sha1.h"
+}
+
+using namespace std;
+
+namespace po = boost::program_options;
+namespace fs = boost::filesystem;
+
+// hashes every regular file of the given directory trees and file lists with collision detection,
+// reports files that contain a (near-)collision attack and the end-to-end scan throughput
+// with --two-phase the files are hashed one after the other, each with the detection spread over
+// all threads (see two_phase.hpp), for a few huge files rather than many small ones
+
+struct scan_file
+{
+	string path;
+	uint64_t size;
+};
+
+// dc_simd is dc_ubc on sha1dc_stream, with the SIMD ubc_check over consecutive blocks
+enum scan_mode
+{
+	mode_dc_ubc,
+	mode_dc_noubc,
+	mode_nodetect,
+	mode_dc_simd
+};
+
+const char* scan_mode_name(scan_mode mode)
+{
+	switch (mode)
+	{
+	case mode_dc_ubc: return "dc_ubc";
+	case mode_dc_noubc: return "dc_noubc";
+	case mode_nodetect: return "nodetect";
+	case mode_dc_simd: return "dc_simd";
+	}
+	return "unknown";
+}
+
+struct scan_totals
+{
+	atomic<uint64_t> files, bytes, errors, collisions, fallbacks;
+	scan_totals() : files(0), bytes(0), errors(0), collisions(0), fallbacks(0) {}
+};
+
+struct scan_options
+{
+	io_backend backend;
+	scan_mode mode;
+	size_t bufsize;
+	unsigned queue_depth;
+	bool print;
+};
+
+// adds the regular files below 'root' (or 'root' itself) to 'files', symbolic links are not followed
+void collect_files(const string& root, vector<scan_file>& files, uint64_t& errors)
+{
+	boost::system::error_code ec;
+	fs::file_status st = fs::symlink_status(root, ec);
+	if (ec)
+	{
+		cerr << root << ": " << ec.message() << endl;
+		++errors;
+		return;
+	}
+	if (fs::is_regular_file(st))
+	{
+		scan_file f = { root, uint64_t(fs::file_size(root, ec)) };
+		if (!ec)
+			files.push_back(f);
+		return;
+	}
+	if (!fs::is_directory(st))
+		return;
+	fs::recursive_directory_iterator it(root, ec), end;
+	for (; !ec && it != end; it.increment(ec))
+	{
+		if (!fs::is_regular_file(it->symlink_status(ec)) || ec)
+			continue;
+		scan_file f = { it->path().string(), uint64_t(fs::file_size(it->path(), ec)) };
+		if (!ec)
+			files.push_back(f);
+	}
+	if (ec)
+	{
+		cerr << root << ": " << ec.message() << endl;
+		++errors;
+	}
+}
+
+// reads one path per line, '-' reads the list from stdin
+bool read_file_list(const string& listfile, vector<string>& paths)
+{
+	ifstream ifs;
+	if (listfile != "-")
+	{
+		ifs.open(listfile.c_str());
+		if (!ifs)
+		{
+			cerr << "Could not open " << listfile << endl;
+			return false;
+		}
+	}
+	istream& is = (listfile == "-") ? cin : ifs;
+	string line;
+	while (getline(is, line))
+		if (!line.empty())
+			paths.push_back(line);
+	return true;
+}
+
+string hash_hex(const unsigned char hash[20])
+{
+	char hex[41];
+	for (unsigned i = 0; i < 20; ++i)
+		sprintf(hex + 2 * i, "%02x", hash[i]);
+	return string(hex, 40);
+}
+
+// workers take the next file from the list, which is sorted by decreasing size: the huge files
+// start first and the tiny ones fill up the remaining time of all workers at the end
+void scan_worker(const vector<scan_file>& files, atomic<size_t>& next, const scan_options& opt, scan_totals& totals, mutex& outmutex)
+{
+	std::unique_ptr<file_reader> reader;
+	try
+	{
+		reader = make_file_reader(opt.backend, opt.bufsize, opt.queue_depth);
+	}
+	catch (std::exception& e)
+	{
+		lock_guard<mutex> lock(outmutex);
+		cerr << "Could not set up " << io_backend_name(opt.backend) << " reader: " << e.what() << endl;
+	}
+	if (!reader)
+	{
+		// the files of this worker are left to the others
+		return;
+	}
+
+	SHA1_CTX ctx;
+	std::unique_ptr<sha1dc_stream> stream;
+	if (opt.mode == mode_dc_simd)
+		stream.reset(new sha1dc_stream());
+	unsigned char hash[20];
+	string error;
+	file_consumer consume = [&ctx, &stream](const char* data, size_t len)
+	{
+		if (stream)
+			stream->update(data, len);
+		else
+			SHA1DCUpdate(&ctx, data, len);
+	};
+
+	for (size_t i = next++; i < files.size(); i = next++)
+	{
+		SHA1DCInit(&ctx);
+		if (stream)
+			stream->init();
+		if (opt.mode == mode_nodetect)
+			SHA1DCSetUseDetectColl(&ctx, 0);
+		else if (opt.mode == mode_dc_noubc)
+			SHA1DCSetUseUBC(&ctx, 0);
+
+		uint64_t bytes = 0;
+		file_consumer counted = [&consume, &bytes](const char* data, size_t len) { bytes += len; consume(data, len); };
+		if (!reader->read_file(files[i].path, files[i].size, counted, error))
+		{
+			++totals.errors;
+			lock_guard<mutex> lock(outmutex);
+			cerr << files[i].path << ": " << error << endl;
+			continue;
+		}
+		bool collision = stream ? stream->final(hash) : (SHA1DCFinal(hash, &ctx) != 0);
+
+		++totals.files;
+		totals.bytes += bytes;
+		if (collision)
+			++totals.collisions;
+		if (collision || opt.print)
+		{
+			// sha1sum format, collisions marked like sha1dcsum does
+			lock_guard<mutex> lock(outmutex);
+			cout << hash_hex(hash) << "  " << (collision ? "*coll* " : "") << files[i].path << endl;
+		}
+	}
+	totals.fallbacks += reader->direct_fallbacks();
+}
+
+int main(int argc, char** argv)
+{
+	vector<string> inputs, lists;
+	string backend, mode, resultsfile;
+	unsigned threads, reps;
+	size_t chunk;
+	scan_options opt;
+
+	po::options_description desc("Allowed options");
+	desc.add_options()
+		("help,h", "Show options")
+		("path,p", po::value<vector<string>>(&inputs), "File or directory tree to scan (may be given multiple times)")
+		("files-from,f", po::value<vector<string>>(&lists), "Scan the paths listed in this file, one per line, - for stdin")
+		("io", po::value<string>(&backend)->default_value("read"), "I/O backend: read, mmap, direct or uring")
+		("bufsize", po::value<size_t>(&opt.bufsize)->default_value(size_t(1) << 20), "Bytes per read for read, direct and uring")
+		("qd", po::value<unsigned>(&opt.queue_depth)->default_value(4), "Reads in flight per file for uring")
+		("threads,t", po::value<unsigned>(&threads)->default_value(std::max(1u, thread::hardware_concurrency())), "Worker threads")
+		("mode", po::value<string>(&mode)->default_value("dc_ubc"), "dc_ubc, dc_noubc (detection without UBC), dc_simd (detection with the SIMD ubc_check over consecutive blocks) or nodetect (plain SHA-1)")
+		("print", "Print the hash of every file (in sha1sum format)")
+		("reps", po::value<unsigned>(&reps)->default_value(1), "Scan this many times, e.g. to measure the warm page cache")
+		("two-phase", "Compute the SHA-1 chain of one file at a time on one thread and check its blocks on the others")
+		("chunk", po::value<size_t>(&chunk)->default_value(size_t(1) << 20), "Bytes per hand-off from the chain thread to the checking threads for --two-phase")
+		("results", po::value<string>(&resultsfile), "Append results as JSON lines to this file, or to <host>_<cpu>.jsonl in this directory")
+		;
+	po::positional_options_description pos;
+	pos.add("path", -1);
+	po::variables_map vm;
+	try
+	{
+		po::store(po::command_line_parser(argc, argv).options(desc).positional(pos).run(), vm);
+		po::notify(vm);
+	}
+	catch (std::exception& e)
+	{
+		cerr << e.what() << endl;
+		return 2;
+	}
+
+	if (vm.count("help") || (inputs.empty() && lists.empty()))
+	{
+		cout << "Usage: " << argv[0] << " [options] <path>..." << endl << desc << endl;
+		return vm.count("help") ? 0 : 2;
+	}
+	if (!parse_io_backend(backend, opt.backend) || !io_backend_available(opt.backend))
+	{
+		cerr << "I/O backend '" << backend << "' is not available" << (backend == "uring" ? " (build with HAVE_LIBURING=1)" : "") << endl;
+		return 2;
+	}
+	if (mode == "dc_ubc")
+		opt.mode = mode_dc_ubc;
+	else if (mode == "dc_noubc")
+		opt.mode = mode_dc_noubc;
+	else if (mode == "nodetect")
+		opt.mode = mode_nodetect;
+	else if (mode == "dc_simd")
+		opt.mode = mode_dc_simd;
+	else
+	{
+		cerr << "Unknown mode '" << mode << "'" << endl;
+		return 2;
+	}
+	if (opt.bufsize == 0 || threads == 0 || reps == 0 || chunk == 0)
+	{
+		cerr << "--bufsize, --threads, --reps and --chunk must be positive" << endl;
+		return 2;
+	}
+	opt.print = vm.count("print") > 0;
+	bool twophase = vm.count("two-phase") > 0;
+
+	bench_results results;
+	if (vm.count("results") && !results.open(resultsfile, "scan"))
+	{
+		cerr << "Could not open " << results.filename() << endl;
+		return 2;
+	}
+
+	for (size_t i = 0; i < lists.size(); ++i)
+		if (!read_file_list(lists[i], inputs))
+			return 2;
+
+	vector<scan_file> files;
+	uint64_t walkerrors = 0;
+	for (size_t i = 0; i < inputs.size(); ++i)
+		collect_files(inputs[i], files, walkerrors);
+	stable_sort(files.begin(), files.end(), [](const scan_file& a, const scan_file& b) { return a.size > b.size; });
+	uint64_t totalsize = 0;
+	for (size_t i = 0; i < files.size(); ++i)
+		totalsize += files[i].size;
+	cerr << "Scanning " << files.size() << " files, " << totalsize << " bytes with " << threads << " threads, "
+		<< io_backend_name(opt.backend) << " I/O and " << scan_mode_name(opt.mode);
+	if (opt.mode == mode_dc_simd || (twophase && opt.mode == mode_dc_ubc))
+		cerr << " (" << dispatch_ubc_check_kernel().name << " ubc_check)";
+	if (twophase)
+		cerr << ", two-phase with the " << two_phase_chain_kernel() << " SHA-1 chain and " << std::max(1u, threads - 1) << " checking threads";
+	cerr << "." << endl;
+
+	vector<double> gbps, filesps, chaingbps;
+	uint64_t collisions = 0, errors = walkerrors;
+	for (unsigned rep = 0; rep < reps; ++rep)
+	{
+		scan_totals totals;
+		atomic<size_t> next(0);
+		mutex outmutex;
+		scan_options repopt = opt;
+		// print the hashes once
+		repopt.print = opt.print && rep == 0;
+
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		if (twophase)
+		{
+			vector<string> paths(files.size());
+			vector<uint64_t> sizes(files.size());
+			for (size_t i = 0; i < files.size(); ++i)
+			{
+				paths[i] = files[i].path;
+				sizes[i] = files[i].size;
+			}
+			two_phase_options tpopt;
+			tpopt.backend = opt.backend;
+			tpopt.bufsize = opt.bufsize;
+			tpopt.queue_depth = opt.queue_depth;
+			tpopt.workers = std::max(1u, threads - 1);
+			tpopt.chunk_bytes = chunk;
+			tpopt.detect = opt.mode != mode_nodetect;
+			tpopt.ubc = opt.mode != mode_dc_noubc;
+			two_phase_report report = [&](size_t i, const unsigned char* hash, bool collision, const string& error)
+			{
+				if (!hash)
+					cerr << files[i].path << ": " << error << endl;
+				else if (collision || repopt.print)
+					cout << hash_hex(hash) << "  " << (collision ? "*coll* " : "") << files[i].path << endl;
+			};
+			two_phase_stats tpstats;
+			string error;
+			if (!two_phase_scan(paths, sizes, tpopt, report, tpstats, error))
+			{
+				cerr << "Could not set up " << io_backend_name(opt.backend) << " reader: " << error << endl;
+				return 2;
+			}
+			totals.files = tpstats.files;
+			totals.bytes = tpstats.bytes;
+			totals.errors = tpstats.errors;
+			totals.collisions = tpstats.collisions;
+			totals.fallbacks = tpstats.fallbacks;
+			chaingbps.push_back(tpstats.chain_seconds > 0 ? double(tpstats.bytes) / tpstats.chain_seconds / 1e9 : 0);
+			cerr << "SHA-1 chain: " << chaingbps.back() << " GB/s while hashing, " << tpstats.recompressed << " blocks with a non-zero dvmask." << endl;
+		}
+		else
+		{
+			vector<thread> workers;
+			for (unsigned t = 0; t < threads; ++t)
+				workers.push_back(thread(scan_worker, std::cref(files), std::ref(next), std::cref(repopt), std::ref(totals), std::ref(outmutex)));
+			for (unsigned t = 0; t < threads; ++t)
+				workers[t].join();
+		}
+		double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+		if (totals.files + totals.errors < files.size())
+		{
+			cerr << "No worker could set up the " << io_backend_name(opt.backend) << " reader" << endl;
+			return 2;
+		}
+
+		gbps.push_back(double(totals.bytes) / seconds / 1e9);
+		filesps.push_back(double(totals.files) / seconds);
+		collisions = std::max<uint64_t>(collisions, totals.collisions);
+		errors = std::max<uint64_t>(errors, walkerrors + totals.errors);
+
+		cerr << "files\tbytes\terrors\tcollisions\tseconds\tGB/s\tfiles/s" << endl;
+		cerr << totals.files << "\t" << totals.bytes << "\t" << totals.errors << "\t" << totals.collisions << "\t"
+			<< fixed << setprecision(3) << seconds << "\t" << gbps.back() << "\t" << setprecision(0) << filesps.back() << endl;
+		cerr.unsetf(ios::floatfield);
+		if (totals.fallbacks)
+			cerr << totals.fallbacks << " files did not support O_DIRECT and were read buffered." << endl;
+	}
+
+	string key = string("scan/") + io_backend_name(opt.backend) + "/" + scan_mode_name(opt.mode) + (twophase ? "/two_phase" : "");
+	results.record(key, "throughput", "GB/s", true, gbps);
+	results.record(key, "files_per_sec", "files/s", true, filesps);
+	if (twophase)
+		results.record(key, "chain_throughput", "GB/s", true, chaingbps);
+
+	if (collisions)
+	{
+		cerr << collisions << " files contain a collision attack." << endl;
+		return 1;
+	}
+	return errors ? 2 : 0;
+}
@@ -0,0 +1,344 @@
+/***
+* Copyright 2017 Marc Stevens <marc@marc-stevens.nl>, Dan Shumow <danshu@microsoft.com>
+* Distributed under the MIT Software License.
+* See accompanying file LICENSE.txt or copy at
+* https://opensource.org/licenses/MIT
+***/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include "../common/sha1_baselines.hpp"
+#include "../common/sha1_expand.hpp"
+#include "../common/sha1dc_recompress.hpp"
+#include "../common/sha1dc_stream.hpp"
+#include "../common/ubc_check_dispatch.hpp"
+#include "two_phase.hpp"
+
+extern "C"
+{
+#include "sha1.h"
+}
+
+using namespace std;
+
+namespace {
+
+	// the plain compression of one block for cpus without the SHA extensions
+	void compress_scalar(uint32_t* ihv, const uint32_t* m)
+	{
+		uint32_t W[80];
+		memcpy(W, m, 16 * sizeof(uint32_t));
+		sha1_expand(W);
+		sha1_compression_W(ihv, W);
+	}
+
+	// the fastest one lane baseline of sha1_baselines.hpp the cpu supports
+	sha1_baseline chain_kernel()
+	{
+		vector<sha1_baseline> baselines = available_sha1_baselines();
+		for (size_t i = 0; i < baselines.size(); ++i)
+			if (baselines[i].lanes == 1)
+				return baselines[i];
+		sha1_baseline scalar = { "scalar", 1, compress_scalar };
+		return scalar;
+	}
+
+	// consecutive blocks of a file with the chaining value before each of them
+	struct chunk
+	{
+		size_t file;
+		size_t blocks;
+		vector<unsigned char> data;
+		vector<uint32_t> ihv; // before block b at [5 * b], the output of the last block at [5 * blocks]
+	};
+
+	struct file_state
+	{
+		// the chunks of the file still being checked, plus one while the chain thread is on it
+		atomic<uint64_t> pending;
+		atomic<bool> collision;
+		bool failed;
+		string error;
+		uint64_t bytes;
+		unsigned char hash[20];
+		future<bool> confirmed; // of a collision, see confirm_collision
+
+		file_state() : pending(1), collision(false), failed(false), bytes(0) {}
+	};
+
+	// a fixed pool of chunks circulates between the chain thread and the workers, so slow
+	// workers throttle the chain thread rather than letting it buffer whole files
+	class chunk_queue
+	{
+	public:
+		chunk_queue(size_t count, size_t chunk_bytes)
+			: closed(false)
+		{
+			for (size_t i = 0; i < count; ++i)
+			{
+				pool.push_back(unique_ptr<chunk>(new chunk));
+				// room for two padding blocks after a full chunk of data
+				pool.back()->data.resize(chunk_bytes + 128);
+				pool.back()->ihv.resize(5 * (chunk_bytes / 64 + 3));
+				idle.push_back(pool.back().get());
+			}
+		}
+
+		chunk* acquire()
+		{
+			unique_lock<mutex> lock(m);
+			idle_cv.wait(lock, [this]() { return !idle.empty(); });
+			chunk* c = idle.back();
+			idle.pop_back();
+			return c;
+		}
+
+		void release(chunk* c)
+		{
+			lock_guard<mutex> lock(m);
+			idle.push_back(c);
+			idle_cv.notify_one();
+		}
+
+		void push(chunk* c)
+		{
+			lock_guard<mutex> lock(m);
+			work.push_back(c);
+			work_cv.notify_one();
+		}
+
+		// returns 0 once closed and all work is taken
+		chunk* pop()
+		{
+			unique_lock<mutex> lock(m);
+			work_cv.wait(lock, [this]() { return !work.empty() || closed; });
+			if (work.empty())
+				return 0;
+			chunk* c = work.front();
+			work.pop_front();
+			return c;
+		}
+
+		void close()
+		{
+			lock_guard<mutex> lock(m);
+			closed = true;
+			work_cv.notify_all();
+		}
+
+	private:
+		vector<unique_ptr<chunk>> pool;
+		vector<chunk*> idle;
+		deque<chunk*> work;
+		bool closed;
+		mutex m;
+		condition_variable idle_cv, work_cv;
+	};
+
+	// the second phase: ubc_check of every block of a chunk and, for the blocks whose dvmask is
+	// non-zero, the recompressions from their chaining value as SHA1DCUpdate does them. The
+	// blocks are checked 'lanes' at a time by sha1dc_block_batch on the dispatched SIMD ubc_check
+	// variant, it does not depend on the chaining values
+	void check_worker(chunk_queue& queue, vector<file_state>& files, bool ubc, atomic<uint64_t>& recompressed)
+	{
+		sha1dc_block_batch batch(dispatch_ubc_check_kernel(), ubc);
+		const size_t L = batch.lanes();
+		while (chunk* c = queue.pop())
+		{
+			file_state& f = files[c->file];
+			uint64_t rec = 0;
+			for (size_t b = 0; b < c->blocks && !f.collision; b += L)
+			{
+				batch.check(&c->data[64 * b], std::min(L, c->blocks - b), [&](size_t j, const uint32_t* Wj, const uint32_t* mask)
+				{
+					++rec;
+					if (sha1dc_check_block(&c->ihv[5 * (b + j)], Wj, mask, &c->ihv[5 * (b + j + 1)]))
+						f.collision = true;
+				});
+			}
+			recompressed += rec;
+			queue.release(c);
+			--f.pending;
+		}
+	}
+
+	// hashes a file with a detected collision once more with SHA1DCUpdate, which confirms it and
+	// gives the safe hash; on a reader of its own as it runs next to the chain thread's.
+	// returns whether there is a collision, f.failed is set if the file could not be read
+	bool confirm_collision(const string& path, uint64_t size, const two_phase_options& opt, file_state& f)
+	{
+		unique_ptr<file_reader> reader;
+		try
+		{
+			reader = make_file_reader(opt.backend, opt.bufsize, opt.queue_depth);
+		}
+		catch (std::exception& e)
+		{
+			f.failed = true;
+			f.error = e.what();
+			return false;
+		}
+		SHA1_CTX ctx;
+		SHA1DCInit(&ctx);
+		if (!opt.ubc)
+			SHA1DCSetUseUBC(&ctx, 0);
+		file_consumer consume = [&ctx](const char* data, size_t len) { SHA1DCUpdate(&ctx, data, len); };
+		if (!reader->read_file(path, size, consume, f.error))
+		{
+			f.failed = true;
+			return false;
+		}
+		return SHA1DCFinal(f.hash, &ctx) != 0;
+	}
+
+}
+
+const char* two_phase_chain_kernel()
+{
+	return chain_kernel().name;
+}
+
+bool two_phase_scan(const vector<string>& paths, const vector<uint64_t>& sizes, const two_phase_options& opt,
+	const two_phase_report& report, two_phase_stats& stats, string& error)
+{
+	unique_ptr<file_reader> reader;
+	try
+	{
+		reader = make_file_reader(opt.backend, opt.bufsize, opt.queue_depth);
+	}
+	catch (std::exception& e)
+	{
+		error = e.what();
+		return false;
+	}
+
+	const sha1_baseline kernel = chain_kernel();
+	const size_t chunk_bytes = std::max<size_t>(64, opt.chunk_bytes / 64 * 64);
+	const unsigned workers = opt.detect ? std::max(1u, opt.workers) : 0;
+	chunk_queue queue(2 * workers + 2, chunk_bytes);
+	vector<file_state> files(paths.size());
+	atomic<uint64_t> recompressed(0);
+	vector<thread> pool;
+	for (unsigned w = 0; w < workers; ++w)
+		pool.push_back(thread(check_worker, std::ref(queue), std::ref(files), opt.ubc, std::ref(recompressed)));
+
+	// reports the files up to 'end' that are done, in order. A collision is confirmed by
+	// confirm_collision on a thread of its own, so that the chain thread goes on; the files after
+	// it are reported once that is done, or waited for if 'wait'
+	size_t reported = 0;
+	auto report_done = [&](size_t end, bool wait)
+	{
+		for (; reported < end && files[reported].pending == 0; ++reported)
+		{
+			file_state& f = files[reported];
+			bool collision = f.collision;
+			// f.failed and f.hash belong to confirm_collision until it is done
+			if (collision && !f.confirmed.valid() && !f.failed)
+				f.confirmed = async(launch::async, confirm_collision, std::cref(paths[reported]), sizes[reported], std::cref(opt), std::ref(f));
+			if (f.confirmed.valid())
+			{
+				if (!wait && f.confirmed.wait_for(chrono::seconds(0)) != future_status::ready)
+					break;
+				collision = f.confirmed.get();
+			}
+			if (f.failed)
+			{
+				++stats.errors;
+				report(reported, 0, false, f.error);
+				continue;
+			}
+			++stats.files;
+			stats.bytes += f.bytes;
+			if (collision)
+				++stats.collisions;
+			report(reported, f.hash, collision, string());
+		}
+	};
+
+	// the first phase: the plain SHA-1 chain over each file and its padding
+	for (size_t i = 0; i < paths.size(); ++i)
+	{
+		file_state& f = files[i];
+		uint32_t ihv[5] = { sha1dc_iv[0], sha1dc_iv[1], sha1dc_iv[2], sha1dc_iv[3], sha1dc_iv[4] };
+		chunk* c = queue.acquire();
+		size_t fill = 0;
+
+		// chains the 'blocks' blocks of the current chunk and passes it on
+		auto flush = [&](size_t blocks, bool last)
+		{
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			uint32_t m[16];
+			for (size_t b = 0; b < blocks; ++b)
+			{
+				memcpy(&c->ihv[5 * b], ihv, sizeof(ihv));
+				const unsigned char* p = &c->data[64 * b];
+				for (unsigned j = 0; j < 16; ++j)
+					m[j] = sha1dc_load_be32(p + 4 * j);
+				kernel.compress(ihv, m);
+			}
+			memcpy(&c->ihv[5 * blocks], ihv, sizeof(ihv));
+			stats.chain_seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+			c->file = i;
+			c->blocks = blocks;
+			if (workers)
+			{
+				++f.pending;
+				queue.push(c);
+			}
+			else
+				queue.release(c);
+			// the files before this one whose chunks the workers finished meanwhile
+			report_done(i, false);
+			c = last ? 0 : queue.acquire();
+		};
+
+		file_consumer consume = [&](const char* data, size_t len)
+		{
+			f.bytes += len;
+			while (len > 0)
+			{
+				size_t n = std::min(len, chunk_bytes - fill);
+				memcpy(&c->data[fill], data, n);
+				fill += n;
+				data += n;
+				len -= n;
+				if (fill == chunk_bytes)
+				{
+					flush(chunk_bytes / 64, false);
+					fill = 0;
+				}
+			}
+		};
+
+		if (!reader->read_file(paths[i], sizes[i], consume, f.error))
+		{
+			f.failed = true;
+			queue.release(c);
+		}
+		else
+		{
+			flush(sha1dc_pad(&c->data[0], fill, f.bytes), true);
+			sha1dc_store_hash(ihv, f.hash);
+		}
+		--f.pending;
+		report_done(i + 1, false);
+	}
+
+	queue.close();
+	for (size_t w = 0; w < pool.size(); ++w)
+		pool[w].join();
+	report_done(paths.size(), true);
+	stats.recompressed = recompressed;
+	stats.fallbacks = reader->direct_fallbacks();
+	return true;
+}
@@ -0,0 +1,59 @@
+/***
+* Copyright 2017 Marc Stevens <marc@marc-stevens.nl>, Dan Shumow <danshu@microsoft.com>
+* Distributed under the MIT Software License.
+* See accompanying file LICENSE.txt or copy at
+* https://opensource.org/licenses/MIT
+***/
+
+#ifndef SCAN_TWO_PHASE_HPP
+#define SCAN_TWO_PHASE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "io_backends.hpp"
+
+// two-phase collision detection for a few large files: the SHA-1 chain is sequential, but the
+// ubc_check of a block only depends on the block, and its recompressions only on the block and
+// its input chaining value. So one thread reads the files in order and computes the plain SHA-1
+// chain at full speed, recording the chaining value before every block, and hands chunks of
+// blocks with their chaining values to a pool of workers that run the dispatched SIMD ubc_check
+// on consecutive blocks and the needed recompressions in parallel. Files are reported in order
+// once all their chunks are done, by the chain thread between its chunks.
+// a file with a collision is hashed once more with SHA1DCUpdate, for its safe hash, on a thread
+// of its own next to the chain thread; the files after it are reported once that is done
+
+struct two_phase_options
+{
+	io_backend backend;
+	size_t bufsize;
+	unsigned queue_depth;
+	unsigned workers; // check threads next to the chain thread
+	size_t chunk_bytes; // per hand-off, a multiple of 64
+	bool detect, ubc;
+};
+
+struct two_phase_stats
+{
+	uint64_t files, bytes, errors, collisions, fallbacks;
+	uint64_t recompressed; // blocks with a non-zero dvmask
+	double chain_seconds; // the chain thread's time spent hashing (not reading or waiting)
+
+	two_phase_stats() : files(0), bytes(0), errors(0), collisions(0), fallbacks(0), recompressed(0), chain_seconds(0) {}
+};
+
+// called in the order of 'paths' (from the thread that called two_phase_scan): hash is 0 for a
+// file that could not be read, with the error in 'error'
+typedef std::function<void(size_t index, const unsigned char* hash, bool collision, const std::string& error)> two_phase_report;
+
+// the name of the plain SHA-1 compression the chain thread uses on this cpu
+const char* two_phase_chain_kernel();
+
+// returns false if the reader could not be set up, with the reason in 'error'
+bool two_phase_scan(const std::vector<std::string>& paths, const std::vector<uint64_t>& sizes, const two_phase_options& opt,
+	const two_phase_report& report, two_phase_stats& stats, std::string& error);
+
+#endif // SCAN_TWO_PHASE_HPP
@@ -10,7 +10,17 @@
 
 #ifdef INCLUDE_AVX256_TEST
 #include "test_simd.h"
+
+// compiled for avx2 whatever the target flags, see the SIMD wrappers in ../common/ubc_check_dispatch.hpp
+#pragma GCC push_options
+#pragma GCC target("avx2")
 extern "C" {
 #include "../../lib/ubc_check_simd_avx256.c"
 }
-#endif
\ No newline at end of file
+
+void ubc_check_lanes_avx256(const uint32_t* W, uint32_t* dvmask)
+{
+	ubc_check_avx256(reinterpret_cast<const __m256i*>(W), reinterpret_cast<__m256i*>(dvmask));
+}
+#pragma GCC pop_options
+#endif
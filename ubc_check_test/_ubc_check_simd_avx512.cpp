@@ -0,0 +1,28 @@
+/***
+* Copyright 2017 Marc Stevens <marc@marc-stevens.nl>, Dan Shumow <danshu@microsoft.com>
+* Distributed under the MIT Software License.
+* See accompanying file LICENSE.txt or copy at
+* https://opensource.org/licenses/MIT
+***/
+
+
+#include "ubc_check_test.h"
+
+#ifdef INCLUDE_AVX512_TEST
+#include "test_simd.h"
+
+// compiled for avx512f whatever the target flags, see the SIMD wrappers in ../common/ubc_check_dispatch.hpp
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+extern "C" {
+// the library has no AVX-512 variant, instantiate its generated SIMD ubc_check for 16 lanes
+#include "../common/simd_avx512.h"
+#include "../../lib/ubc_check_simd.cinc"
+}
+
+void ubc_check_lanes_avx512(const uint32_t* W, uint32_t* dvmask)
+{
+	ubc_check_avx512(reinterpret_cast<const __m512i*>(W), reinterpret_cast<__m512i*>(dvmask));
+}
+#pragma GCC pop_options
+#endif
@@ -10,7 +10,19 @@
 
 #ifdef INCLUDE_MMX64_TEST
 #include "test_simd.h"
+
+// compiled for mmx whatever the target flags, see the SIMD wrappers in ../common/ubc_check_dispatch.hpp
+#pragma GCC push_options
+#pragma GCC target("mmx")
 extern "C" {
 #include "../../lib/ubc_check_simd_mmx64.c"
 }
-#endif
\ No newline at end of file
+
+void ubc_check_lanes_mmx64(const uint32_t* W, uint32_t* dvmask)
+{
+	ubc_check_mmx64(reinterpret_cast<const __m64*>(W), reinterpret_cast<__m64*>(dvmask));
+	// leave the x87 registers usable for the caller
+	_mm_empty();
+}
+#pragma GCC pop_options
+#endif
@@ -7,10 +7,20 @@
 
 
 #include "ubc_check_test.h"
+
 #ifdef INCLUDE_SSE128_TEST
 #include "test_simd.h"
+
+// compiled for sse2 whatever the target flags, see the SIMD wrappers in ../common/ubc_check_dispatch.hpp
+#pragma GCC push_options
+#pragma GCC target("sse2")
 extern "C" {
 #include "../../lib/ubc_check_simd_sse128.c"
 }
-#endif
 
+void ubc_check_lanes_sse128(const uint32_t* W, uint32_t* dvmask)
+{
+	ubc_check_sse128(reinterpret_cast<const __m128i*>(W), reinterpret_cast<__m128i*>(dvmask));
+}
+#pragma GCC pop_options
+#endif
@@ -11,6 +11,9 @@
 #include <string.h>
 
 #include <iostream>
+#include <vector>
+#include <string>
+#include <thread>
 
 #include <boost/cstdint.hpp>
 
@@ -19,6 +22,10 @@ using boost::uint32_t;
 
 #include "ubc_check_test.h"
 #include "test_simd.h"
+#include "../common/bench_results.hpp"
+#include "../common/ubc_check_dispatch.hpp"
+#include "../common/sha1_expand.hpp"
+#include "../common/transpose_lanes.hpp"
 
 extern "C" {
 #include "../../lib/ubc_check_verify.c"
@@ -38,11 +45,30 @@ char*	usage_str = "%s usage:\n"
 #ifdef INCLUDE_AVX256_TEST
 					"\t--avx256   - Run UBC tests with avx256 improvements.\n"
 #endif
+#ifdef INCLUDE_AVX512_TEST
+					"\t--avx512   - Run UBC tests with avx512 improvements.\n"
+#endif
+#ifdef INCLUDE_VEC_TEST
+					"\t--vec4, --vec8, --vec16, --vec32 - Run UBC tests with vector extensions of 4 to 32 lanes.\n"
+#endif
 #ifdef INCLUDE_NEON128_TEST
 					"\t--neon128  - Run unavoidable bit condition check tests with neon128 improvements.\n"
 #endif
+					"\t--list     - List the ubc_check variants compiled in, which ones this cpu supports and the dispatched one.\n"
+					"\t--bench-all - Benchmark every ubc_check variant this cpu supports.\n"
+					"\t--bench-expand - Benchmark the message expansion of the test inputs against the dispatched ubc_check.\n"
+					"\t--bench-transpose - Benchmark the SIMD ubc_check variants on separate AoS messages, including their transposition.\n"
 					"-p,--nocheck - Supress correctness checks.\n"
 					"-c,--noperf  - Supress performance tests.\n"
+					"\t--budget <s> - Time budget in seconds per performance test (default 3).\n"
+					"\t--ci <pct> - Stop a performance test once the 95%% confidence interval is within pct%% of the mean (default 1).\n"
+					"\t--counters - Report hardware performance counters per ubc_check call.\n"
+					"\t--cache    - Measure performance with inputs resident in L1, L2, LLC and DRAM.\n"
+					"\t--hugepages - Request transparent huge pages for performance test inputs.\n"
+					"\t--threads <n> - Number of threads for the correctness checks (default: all cores).\n"
+					"\t--seed <n> - Seed for the test inputs, to reproduce a reported error (default: random).\n"
+					"\t--ubcdir <dir> - Unavoidable bit relations for the batched reference (default ../ubcdatafiles/3565).\n"
+					"\t--results <path> - Append results as JSON lines to this file, or to <host>_<cpu>.jsonl in this directory.\n"
 					"\t-h,--help  - Print this help message\n"
 					"\n";
 
@@ -55,6 +81,7 @@ typedef struct {
 	TestUBCFunction fn_test_ubc_check;
 	bool run_test;
 	char* arg_str;
+	const char* kernel_name; // as in ubc_check_dispatch.hpp, to skip tests the cpu does not support
 } TestConfigEntry;
 
 TestConfigEntry testConfig[] =
@@ -63,35 +90,74 @@ TestConfigEntry testConfig[] =
 	{
 		test_ubc_check,
 		true,
-		"--basic"
+		"--basic",
+		"scalar"
 	},
 #endif
 #ifdef INCLUDE_MMX64_TEST
 	{
 		test_ubc_check_mmx64,
 		false,
-		"--mmx64"
+		"--mmx64",
+		"mmx64"
 	},
 #endif
 #ifdef INCLUDE_SSE128_TEST
 	{
 		test_ubc_check_sse128,
 		false,
-		"--sse128"
+		"--sse128",
+		"sse128"
 	},
 #endif
 #ifdef INCLUDE_AVX256_TEST
 	{
 		test_ubc_check_avx256,
 		false,
-		"--avx256"
+		"--avx256",
+		"avx256"
+	},
+#endif
+#ifdef INCLUDE_AVX512_TEST
+	{
+		test_ubc_check_avx512,
+		false,
+		"--avx512",
+		"avx512"
+	},
+#endif
+#ifdef INCLUDE_VEC_TEST
+	{
+		test_ubc_check_vec4,
+		false,
+		"--vec4",
+		"vec4"
+	},
+	{
+		test_ubc_check_vec8,
+		false,
+		"--vec8",
+		"vec8"
+	},
+	{
+		test_ubc_check_vec16,
+		false,
+		"--vec16",
+		"vec16"
+	},
+	{
+		test_ubc_check_vec32,
+		false,
+		"--vec32",
+		"vec32"
 	},
 #endif
 #ifdef INCLUDE_NEON128_TEST
 	{
 		test_ubc_check_neon128,
 		false,
-		"--neon128"
+		"--neon128",
+		"neon128"
 	}
 #endif
 };
@@ -100,15 +166,304 @@ const size_t cntTestConfig = sizeof(testConfig) / sizeof(TestConfigEntry);
 
 bool run_correctness_checks = true;
 bool run_perf_tests = true;
+bool run_perf_counters = false;
+bool run_cache_tests = false;
+bool use_hugepages = false;
+bench_results results;
+unsigned check_threads = std::thread::hardware_concurrency();
+bool check_seed_set = false;
+uint64_t check_seed = 0;
+std::string check_ubcdir = "../ubcdatafiles/3565";
+double perf_budget = 3;
+double perf_ci = 1;
 
 void usage(char* program_name)
 {
 	printf(usage_str, program_name);
 }
 
+bool kernel_supported(const char* name)
+{
+	vector<ubc_check_kernel> kernels = compiled_ubc_check_kernels();
+	for (size_t i = 0; i < kernels.size(); ++i)
+	{
+		if (0 == strcmp(kernels[i].name, name))
+		{
+			return kernels[i].supported;
+		}
+	}
+	return false;
+}
+
+void list_kernels()
+{
+	vector<ubc_check_kernel> kernels = compiled_ubc_check_kernels();
+	const ubc_check_kernel& dispatched = dispatch_ubc_check_kernel();
+	cout << "cpu features: " << detect_cpu_features().describe() << endl;
+	for (size_t i = 0; i < kernels.size(); ++i)
+	{
+		cout << (kernels[i].check == dispatched.check ? "* " : "  ") << kernels[i].name << "\t" << kernels[i].lanes << " lanes\t"
+			<< (kernels[i].supported ? "supported" : "not supported by this cpu") << endl;
+	}
+	cout << "(* is the variant dispatched to, set UBC_CHECK_KERNEL to override)" << endl;
+}
+
+// measures every variant the cpu supports on the same random expanded blocks
+void bench_all_kernels()
+{
+	vector<ubc_check_kernel> kernels = available_ubc_check_kernels();
+	uint32_t x = 0;
+	double scalar = 0;
+	vector<double> sec(kernels.size());
+
+	// the scalar variant is last, measure it first for the ratios
+	for (size_t i = kernels.size(); i-- > 0; )
+	{
+		sec[i] = time_ubc_check_kernel(kernels[i], size_t(1) << 20, 5, x);
+	}
+	scalar = sec.back();
+
+	cout << "Measuring the ubc_check variants supported by this cpu (" << detect_cpu_features().describe() << "):" << endl;
+	cout << "variant\tlanes\tns/block\tMblocks/s\tspeedup" << endl;
+	size_t fastest = 0;
+	for (size_t i = 0; i < kernels.size(); ++i)
+	{
+		cout << kernels[i].name << "\t" << kernels[i].lanes << "\t" << sec[i] * 1e9 << "\t" << 1e-6 / sec[i] << "\t" << scalar / sec[i] << endl;
+		results.record(string("dispatch/") + kernels[i].name, "rate", "blocks/s", true, 1.0 / sec[i]);
+		if (sec[i] < sec[fastest])
+		{
+			fastest = i;
+		}
+	}
+	cout << "Fastest: " << kernels[fastest].name << ", dispatched at startup: " << dispatch_ubc_check_kernel().name << (x ? "" : " ") << endl;
+}
+
+// the time per block to expand W[16..79] of 'blocks' blocks in SoA groups of 'lanes' blocks,
+// with the vectorized expansion or the plain one per block, the best of 'reps' runs
+double time_expansion(size_t lanes, bool vectorized, size_t blocks, unsigned reps, uint32_t& x)
+{
+	const size_t groups = std::max<size_t>(1, blocks / lanes);
+	aligned_arena<uint32_t> W(groups * 80 * lanes);
+	fast_rng rng(0x65787061);
+	rng.fill(&W[0], groups * 80 * lanes * sizeof(uint32_t));
+	double best = 0;
+	for (unsigned r = 0; r < reps; ++r)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (size_t g = 0; g < groups; ++g)
+		{
+			uint32_t* Wg = &W[g * 80 * lanes];
+			if (vectorized)
+			{
+				sha1_expand_soa(Wg, lanes);
+			}
+			else
+			{
+				sha1_expand_scalar(Wg);
+			}
+			x += Wg[79 * lanes];
+		}
+		double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / double(groups * lanes);
+		if (r == 0 || sec < best)
+		{
+			best = sec;
+		}
+	}
+	return best;
+}
+
+// measures the message expansion on its own, the cost that generating test inputs adds to
+// every ubc_check call and that checking on the unexpanded message would have to beat
+void bench_expansion()
+{
+	struct expansion
+	{
+		const char* name;
+		size_t lanes;
+		bool vectorized;
+	};
+	const expansion expansions[] = { { "scalar", 1, false }, { "block", 1, true }, { "soa4", 4, true }, { "soa8", 8, true }, { "soa16", 16, true }, { "soa32", 32, true } };
+	const size_t count = sizeof(expansions) / sizeof(expansions[0]);
+	// 4096 blocks of 320 bytes stay in L2, so that this measures computation rather than memory
+	const size_t blocks = 4096;
+	uint32_t x = 0;
+
+	const ubc_check_kernel& kernel = dispatch_ubc_check_kernel();
+	double check = time_ubc_check_kernel(kernel, blocks, 5, x);
+	double scalar = 0;
+
+	cout << "Measuring the message expansion of " << blocks << " blocks (ubc_check " << kernel.name << ": " << check * 1e9 << " ns/block):" << endl;
+	cout << "expansion\tlanes\tns/block\tMblocks/s\tspeedup\tof ubc_check" << endl;
+	for (size_t i = 0; i < count; ++i)
+	{
+		double sec = time_expansion(expansions[i].lanes, expansions[i].vectorized, blocks, 200, x);
+		if (i == 0)
+		{
+			scalar = sec;
+		}
+		cout << expansions[i].name << "\t" << expansions[i].lanes << "\t" << sec * 1e9 << "\t" << 1e-6 / sec << "\t" << scalar / sec << "\t" << 100 * sec / check << "%" << endl;
+		results.record(string("expand/") + expansions[i].name, "rate", "blocks/s", true, 1.0 / sec);
+	}
+	cout << (x ? "" : " ") << endl;
+}
+
+// measures what the SIMD variants cost when fed from independent scalar hashing contexts: each
+// context has its own expanded message W[80] and 'lanes' of them are transposed into the SoA
+// layout before every call, compared to the library's ubc_check on each message directly.
+// Before timing, the transposes are checked against transpose_lanes() and the resulting dvmasks
+// against ubc_check; returns non-zero if any disagrees
+int bench_transpose()
+{
+	// 4096 messages of 320 bytes, in a shuffled order so that the lanes of a call are not
+	// adjacent in memory
+	const size_t blocks = 4096;
+	const unsigned reps = 20;
+	aligned_arena<uint32_t> aos(blocks * 80), soa(80 * 32), dvmask(DVMASKSIZE * 32);
+	vector<const uint32_t*> contexts(blocks);
+	fast_rng rng(0x74726e73);
+	for (size_t b = 0; b < blocks; ++b)
+	{
+		rng.fill(&aos[b * 80], 16 * sizeof(uint32_t));
+		sha1_expand(&aos[b * 80]);
+		contexts[b] = &aos[b * 80];
+	}
+	for (size_t b = blocks - 1; b > 0; --b)
+	{
+		std::swap(contexts[b], contexts[rng() % (b + 1)]);
+	}
+
+	aligned_arena<uint32_t> expected_soa(80 * 32), expected(blocks * DVMASKSIZE);
+	for (size_t b = 0; b < blocks; ++b)
+	{
+		ubc_check(contexts[b], &expected[b * DVMASKSIZE]);
+	}
+	vector<transpose_kernel> transposes = available_transpose_kernels();
+	for (size_t k = 0; k < transposes.size(); ++k)
+	{
+		const unsigned lanes = transposes[k].lanes;
+		for (size_t c = 0; c < blocks / lanes; ++c)
+		{
+			transposes[k].transpose(&contexts[c * lanes], &soa[0], 80);
+			transpose_lanes(&contexts[c * lanes], lanes, &expected_soa[0], 80);
+			if (0 != memcmp(&soa[0], &expected_soa[0], 80 * lanes * sizeof(uint32_t)))
+			{
+				cerr << "Found error: transpose " << transposes[k].name << " disagrees with transpose_lanes() on call " << c << endl;
+				return 1;
+			}
+		}
+	}
+
+	vector<ubc_check_kernel> kernels = available_ubc_check_kernels();
+	for (size_t k = 0; k < kernels.size(); ++k)
+	{
+		const unsigned lanes = kernels[k].lanes;
+		transpose_lanes_fn transpose = find_transpose_kernel(lanes);
+		for (size_t c = 0; c < blocks / lanes; ++c)
+		{
+			if (transpose)
+			{
+				transpose(&contexts[c * lanes], &soa[0], 80);
+			}
+			else
+			{
+				transpose_lanes(&contexts[c * lanes], lanes, &soa[0], 80);
+			}
+			kernels[k].check(&soa[0], &dvmask[0]);
+			for (unsigned j = 0; j < lanes; ++j)
+			{
+				for (unsigned i = 0; i < DVMASKSIZE; ++i)
+				{
+					if (dvmask[i * lanes + j] != expected[(c * lanes + j) * DVMASKSIZE + i])
+					{
+						cerr << "Found error: ubc_check " << kernels[k].name << " on transposed messages disagrees with ubc_check (call " << c << ", lane " << j << ")" << endl;
+						return 1;
+					}
+				}
+			}
+		}
+	}
+
+	uint32_t x = 0;
+	double scalar = 0;
+	for (unsigned r = 0; r < reps; ++r)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (size_t b = 0; b < blocks; ++b)
+		{
+			ubc_check(contexts[b], &dvmask[0]);
+			x += dvmask[0];
+		}
+		double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / double(blocks);
+		if (r == 0 || sec < scalar)
+		{
+			scalar = sec;
+		}
+	}
+
+	cout << "Measuring the ubc_check variants on " << blocks << " separate expanded messages, transposed to SoA per call:" << endl;
+	cout << "variant\tlanes\ttranspose\ttranspose ns/block\tcheck ns/block\ttotal ns/block\tspeedup over scalar" << endl;
+	cout << "scalar\t1\t-\t0\t" << scalar * 1e9 << "\t" << scalar * 1e9 << "\t1" << endl;
+	results.record("transpose/scalar", "rate", "blocks/s", true, 1.0 / scalar);
+
+	for (size_t k = 0; k < kernels.size(); ++k)
+	{
+		const ubc_check_kernel& kernel = kernels[k];
+		const unsigned lanes = kernel.lanes;
+		if (lanes == 1)
+		{
+			continue;
+		}
+		transpose_lanes_fn transpose = find_transpose_kernel(lanes);
+		const char* transpose_name = transpose ? "simd" : "scalar";
+		const size_t calls = blocks / lanes;
+
+		// the transposition alone, then transposition and check
+		double sec[2] = { 0, 0 };
+		for (unsigned mode = 0; mode < 2; ++mode)
+		{
+			for (unsigned r = 0; r < reps; ++r)
+			{
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				for (size_t c = 0; c < calls; ++c)
+				{
+					if (transpose)
+					{
+						transpose(&contexts[c * lanes], &soa[0], 80);
+					}
+					else
+					{
+						transpose_lanes(&contexts[c * lanes], lanes, &soa[0], 80);
+					}
+					if (mode == 1)
+					{
+						kernel.check(&soa[0], &dvmask[0]);
+						x += dvmask[0];
+					}
+					else
+					{
+						x += soa[79 * lanes];
+					}
+				}
+				double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / double(calls * lanes);
+				if (r == 0 || t < sec[mode])
+				{
+					sec[mode] = t;
+				}
+			}
+		}
+		double check = time_ubc_check_kernel(kernel, blocks, reps, x);
+		cout << kernel.name << "\t" << lanes << "\t" << transpose_name << "\t" << sec[0] * 1e9 << "\t" << check * 1e9 << "\t" << sec[1] * 1e9 << "\t" << scalar / sec[1] << endl;
+		results.record(string("transpose/") + kernel.name, "rate", "blocks/s", true, 1.0 / sec[1]);
+	}
+	cout << (x ? "" : " ") << endl;
+	return 0;
+}
+
 
 int main(int argc, char** argv)
 {
+	bool list = false, bench_all = false, bench_expand = false, bench_transpose_kernels = false;
+
 	for (size_t i = 1; i < argc; i++)
 	{
 		bool fTestArgStrFound = false;
@@ -136,6 +491,64 @@ int main(int argc, char** argv)
 		{
 			run_perf_tests = false;
 		}
+		else if (0 == strcmp(argv[i], "--list"))
+		{
+			list = true;
+		}
+		else if (0 == strcmp(argv[i], "--bench-all"))
+		{
+			bench_all = true;
+		}
+		else if (0 == strcmp(argv[i], "--bench-expand"))
+		{
+			bench_expand = true;
+		}
+		else if (0 == strcmp(argv[i], "--bench-transpose"))
+		{
+			bench_transpose_kernels = true;
+		}
+		else if (0 == strcmp(argv[i], "--counters"))
+		{
+			run_perf_counters = true;
+		}
+		else if (0 == strcmp(argv[i], "--cache"))
+		{
+			run_cache_tests = true;
+		}
+		else if (0 == strcmp(argv[i], "--hugepages"))
+		{
+			use_hugepages = true;
+		}
+		else if ((0 == strcmp(argv[i], "--threads")) && (i + 1 < argc))
+		{
+			check_threads = (unsigned)strtoul(argv[++i], NULL, 0);
+		}
+		else if ((0 == strcmp(argv[i], "--budget")) && (i + 1 < argc))
+		{
+			perf_budget = strtod(argv[++i], NULL);
+		}
+		else if ((0 == strcmp(argv[i], "--ci")) && (i + 1 < argc))
+		{
+			perf_ci = strtod(argv[++i], NULL);
+		}
+		else if ((0 == strcmp(argv[i], "--seed")) && (i + 1 < argc))
+		{
+			check_seed = strtoull(argv[++i], NULL, 0);
+			check_seed_set = true;
+		}
+		else if ((0 == strcmp(argv[i], "--ubcdir")) && (i + 1 < argc))
+		{
+			check_ubcdir = argv[++i];
+		}
+		else if ((0 == strcmp(argv[i], "--results")) && (i + 1 < argc))
+		{
+			++i;
+			if (!results.open(argv[i], "ubc_check_test"))
+			{
+				printf("Could not open %s\n", results.filename().c_str());
+				exit(-1);
+			}
+		}
 		else if ((0 == strcmp(argv[i], "-h")) || 
 				 (0 == strcmp(argv[i], "--help")))
 		{
@@ -153,9 +566,34 @@ int main(int argc, char** argv)
 		}
 	}
 
+	if (list || bench_all || bench_expand || bench_transpose_kernels)
+	{
+		if (list)
+		{
+			list_kernels();
+		}
+		if (bench_all)
+		{
+			bench_all_kernels();
+		}
+		if (bench_expand)
+		{
+			bench_expansion();
+		}
+		if (bench_transpose_kernels && 0 != bench_transpose())
+		{
+			return 1;
+		}
+		return 0;
+	}
+
 	for (size_t j = 0; j < cntTestConfig; j++)
 	{
-		if (run_all_test || testConfig[j].run_test)
+		if ((run_all_test || testConfig[j].run_test) && !kernel_supported(testConfig[j].kernel_name))
+		{
+			cout << "Skipping " << testConfig[j].arg_str << ": not supported by this cpu." << endl;
+		}
+		else if (run_all_test || testConfig[j].run_test)
 		{
 			cout << "=====================================================================" << endl;
 			testConfig[j].fn_test_ubc_check();
@@ -9,6 +9,13 @@
 #include <iostream>
 #include <iomanip>
 #include <vector>
+#include <algorithm>
+#include <cmath>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <stdexcept>
 
 #include <boost/cstdint.hpp>
 #include <boost/random/random_device.hpp>
@@ -16,9 +23,18 @@
 #include <boost/progress.hpp>
 #include <boost/timer.hpp>
 #include <boost/array.hpp>
+#include <boost/math/distributions/students_t.hpp>
 
 #include "ubc_check_test.h"
 #include "test_simd.h"
+#include "../common/perf_counters.hpp"
+#include "../common/aligned_arena.hpp"
+#include "../common/cycle_counter.hpp"
+#include "../common/bench_results.hpp"
+#include "../common/fast_rng.hpp"
+#include "../common/sha1_expand.hpp"
+#include "../common/ubc_blockgen.hpp"
+#include "../common/ubc_verify_batch.hpp"
 
 using namespace std;
 using boost::uint32_t;
@@ -30,155 +46,401 @@ using boost::uint32_t;
 #define VECTOR_COUNT (1 << 20)
 #endif 
 
-inline uint32_t rotate_left(const uint32_t x, const unsigned n)
+template<typename SIMD_WORD>
+inline
+void gen_W(fast_rng& rng, SIMD_WORD* W)
 {
-	return (x << n) | (x >> (32 - n));
+	const size_t SIMD_VECSIZE = sizeof(SIMD_WORD) / sizeof(uint32_t);
+
+	rng.fill(W, 16 * sizeof(SIMD_WORD));
+	sha1_expand_soa(reinterpret_cast<uint32_t*>(W), SIMD_VECSIZE);
 }
 
-template<typename RNG, typename SIMD_WORD>
-inline
-void gen_W(RNG& rng, SIMD_WORD* W)
+extern bool run_correctness_checks;
+extern bool run_perf_tests;
+extern bool run_perf_counters;
+extern bool run_cache_tests;
+extern bool use_hugepages;
+extern bench_results results;
+extern unsigned check_threads;
+extern bool check_seed_set;
+extern uint64_t check_seed;
+extern std::string check_ubcdir;
+extern double perf_budget;
+extern double perf_ci;
+
+// the performance test times trials of at least this long, at least PERF_MIN_TRIALS of them
+#define PERF_TRIAL_SECONDS 0.02
+#define PERF_MIN_TRIALS 5
+
+// returns the half width of the 95% confidence interval of the mean of the samples relative to
+// the mean, and the mean; the samples are taken to be independent and about normally distributed
+inline double relative_ci95(const vector<double>& samples, double& mean)
 {
-	const size_t SIMD_VECSIZE = sizeof(SIMD_WORD) / sizeof(uint32_t);
+	const size_t n = samples.size();
+	double sum = 0, sumsq = 0;
+	for (size_t i = 0; i < n; ++i)
+		sum += samples[i];
+	mean = sum / double(n);
+	for (size_t i = 0; i < n; ++i)
+		sumsq += (samples[i] - mean) * (samples[i] - mean);
+	if (n < 2 || mean <= 0)
+		return 0;
+	boost::math::students_t dist(double(n - 1));
+	double t = boost::math::quantile(boost::math::complement(dist, 0.025));
+	return t * sqrt(sumsq / double(n - 1) / double(n)) / mean;
+}
+
+// the correctness pass generates and checks blocks in batches of this many calls per thread
+#define CHECK_BATCH_CALLS 64
 
-	for (unsigned i = 0; i < 16; ++i)
+// sets up the batched reference from the relations in check_ubcdir and checks it against
+// ubc_check_verify() on random blocks and on blocks crafted to pass each DV's relations;
+// returns false (and the per block ubc_check_verify() is used instead) if that fails
+inline bool init_batch_reference(ubc_verify_batch& ref, fast_rng& rng)
+{
+	vector<ubc_dv_relations> dvs;
+	try
+	{
+		dvs = load_ubc_relations(check_ubcdir);
+	}
+	catch (std::exception& e)
 	{
-		union {
-			SIMD_WORD v;
-			uint32_t w[SIMD_VECSIZE];
-		} tmp;
-		for (unsigned j = 0; j < SIMD_VECSIZE; ++j)
-			tmp.w[j] = rng();
-		W[i] = tmp.v;
+		cout << "Could not load the unavoidable bit relations (" << e.what() << "), verifying per block." << endl;
+		return false;
+	}
+	if (!ref.init(dvs))
+	{
+		cout << "The unavoidable bit relations in " << check_ubcdir << " do not cover all DVs, verifying per block." << endl;
+		return false;
 	}
 
-	for (unsigned i = 16; i < 80; ++i)
+	const size_t lanes = 4096 + 64 * dvs.size();
+	vector<uint32_t> W(80 * lanes), dvmask(DVMASKSIZE * lanes);
+	rng.fill(&W[0], 16 * lanes * sizeof(uint32_t));
+	for (size_t j = 4096; j < lanes; ++j)
 	{
-		for (size_t j = 0; j < SIMD_VECSIZE; j++)
-			((uint32_t*)&W[i])[j] = rotate_left((((uint32_t*)&W[i - 3])[j] ^ ((uint32_t*)&W[i - 8])[j] ^ ((uint32_t*)&W[i - 14])[j] ^ ((uint32_t*)&W[i - 16])[j]), 1);
+		uint32_t m[16];
+		ubc_block_generator(dvs[(j - 4096) / 64]).generate(rng, m);
+		for (unsigned t = 0; t < 16; ++t)
+			W[t * lanes + j] = m[t];
+	}
+	sha1_expand_soa(&W[0], lanes);
+	ref.verify(&W[0], lanes, &dvmask[0]);
+	for (size_t j = 0; j < lanes; ++j)
+	{
+		uint32_t W2[80], dvmask2[DVMASKSIZE];
+		for (unsigned t = 0; t < 80; ++t)
+			W2[t] = W[t * lanes + j];
+		ubc_check_verify(W2, dvmask2);
+		for (unsigned i = 0; i < DVMASKSIZE; ++i)
+			if (dvmask[i * lanes + j] != dvmask2[i])
+			{
+				cout << "The unavoidable bit relations in " << check_ubcdir << " do not match ubc_check_verify(), verifying per block." << endl;
+				return false;
+			}
 	}
+	return true;
 }
 
-extern bool run_correctness_checks;
-extern bool run_perf_tests;
-
+// the first discrepancy found by any thread of the correctness pass
+struct check_failure
+{
+	std::mutex mutex;
+	bool found;
+	unsigned stream;
+	uint64_t call;
+	unsigned lane, maski;
+	uint32_t dvmask, dvmask2;
+
+	check_failure() : found(false) {}
+};
+
+// checks 'calls' calls of ubc_check_simd on blocks from its own rng stream in batches: the
+// kernel is called on each SIMD_WORD of the batch and all its lanes are compared at once to the
+// batched reference, or to ubc_check_verify() per block if 'batchref' is 0
 template<typename SIMD_WORD, void(*ubc_check_simd)(const SIMD_WORD*, SIMD_WORD*)>
-inline
-int test_ubc_check_simd(const char* simd_name_str)
+void check_ubc_check_simd_worker(uint64_t seed, unsigned stream, uint64_t calls, const ubc_verify_batch* batchref, std::atomic<uint64_t>* done, std::atomic<bool>* failed, check_failure* failure)
 {
-	boost::random::random_device seeder;
-	boost::random::mt19937 rng(seeder);
-
 	const size_t SIMD_VECSIZE = sizeof(SIMD_WORD) / sizeof(uint32_t);
+	const size_t lanes = CHECK_BATCH_CALLS * SIMD_VECSIZE;
 
+	fast_rng rng(seed, stream);
+	vector<uint32_t> Wb(80 * lanes), got(DVMASKSIZE * lanes), want(DVMASKSIZE * lanes);
 	SIMD_WORD W[80];
 	SIMD_WORD dvmask[DVMASKSIZE];
-	uint32_t dvmask_test[DVMASKSIZE];
-	union {
-		SIMD_WORD v;
-		uint32_t w[SIMD_VECSIZE];
-	} tmp;
 
-	if (run_correctness_checks)
+	for (uint64_t call = 0; call < calls && !failed->load(); call += CHECK_BATCH_CALLS)
 	{
-		cout << "Verifying ubc_check" << simd_name_str << "() against ubc_check_verify():" << endl;
-		boost::progress_display pd(1 << 24);
-		for (unsigned ll = 0; ll < (1 << 24); ++ll, ++pd)
+		const size_t batch = size_t(std::min<uint64_t>(CHECK_BATCH_CALLS, calls - call));
+		rng.fill(&Wb[0], 16 * lanes * sizeof(uint32_t));
+		sha1_expand_soa(&Wb[0], lanes);
+
+		for (size_t k = 0; k < batch; ++k)
 		{
-			gen_W(rng, W);
+			for (unsigned t = 0; t < 80; ++t)
+				memcpy(&W[t], &Wb[t * lanes + k * SIMD_VECSIZE], sizeof(SIMD_WORD));
+			memset(dvmask, 0, sizeof(dvmask));
+			ubc_check_simd(W, dvmask);
+			for (unsigned i = 0; i < DVMASKSIZE; ++i)
+				memcpy(&got[i * lanes + k * SIMD_VECSIZE], &dvmask[i], sizeof(SIMD_WORD));
+		}
 
+		if (batchref)
+			batchref->verify(&Wb[0], lanes, &want[0]);
+		for (size_t j = 0; j < batch * SIMD_VECSIZE; ++j)
+		{
+			uint32_t W2[80], dvmask2[DVMASKSIZE];
+			bool differs = false;
+			for (unsigned i = 0; i < DVMASKSIZE; ++i)
+				differs |= batchref && got[i * lanes + j] != want[i * lanes + j];
+			if (batchref && !differs)
+				continue;
+			// report against ubc_check_verify(), also when only the batched reference differs
+			for (unsigned t = 0; t < 80; ++t)
+				W2[t] = Wb[t * lanes + j];
+			ubc_check_verify(W2, dvmask2);
 			for (unsigned i = 0; i < DVMASKSIZE; ++i)
 			{
-				for (size_t j = 0; j < SIMD_VECSIZE; j++)
-					((uint32_t*)&dvmask[i])[j] = 0;
+				if (got[i * lanes + j] == dvmask2[i] && !(batchref && want[i * lanes + j] != dvmask2[i]))
+					continue;
+				std::lock_guard<std::mutex> lock(failure->mutex);
+				if (!failure->found)
+				{
+					failure->found = true;
+					failure->stream = stream;
+					failure->call = call + j / SIMD_VECSIZE;
+					failure->lane = unsigned(j % SIMD_VECSIZE);
+					failure->maski = i;
+					failure->dvmask = got[i * lanes + j];
+					failure->dvmask2 = dvmask2[i];
+				}
+				failed->store(true);
+				return;
 			}
+		}
+		done->fetch_add(batch);
+	}
+}
 
-			ubc_check_simd(W, dvmask);
+// measures ubc_check_simd over contiguous arenas with working set sizes chosen to sit in L1, L2 and LLC
+// and one that streams from DRAM, and reports the cost per message block
+template<typename RNG, typename SIMD_WORD, void(*ubc_check_simd)(const SIMD_WORD*, SIMD_WORD*)>
+void test_ubc_check_simd_cache(RNG& rng, const char* simd_name_str)
+{
+	const size_t SIMD_VECSIZE = sizeof(SIMD_WORD) / sizeof(uint32_t);
+	const size_t calls = size_t(1) << 22;
+	const unsigned reps = 5;
 
-			for (unsigned w = 0; w < SIMD_VECSIZE; ++w)
-			{
-				uint32_t W2[80];
-				for (unsigned i = 0; i < 80; ++i)
-				{
-					tmp.v = W[i];
-					W2[i] = tmp.w[w];
-				}
+	SIMD_WORD dvmask[DVMASKSIZE];
+	SIMD_WORD x;
+	for (size_t j = 0; j < SIMD_VECSIZE; j++)
+		((uint32_t*)&x)[j] = 0;
 
-				ubc_check_verify(W2, dvmask_test);
+	cache_sizes cs = detect_cache_sizes();
+	vector<working_set> sets = cache_working_sets(cs);
 
-				for (unsigned i = 0; i < DVMASKSIZE; ++i)
-				{
-					tmp.v = dvmask[i];
-					if (tmp.w[w] != dvmask_test[i])
-					{
-						cerr << "Found error:" << endl
-							<< "dvmask [" << i << "] = 0x" << hex << std::setw(8) << std::setfill('0') << tmp.w[w] << dec << endl
-							<< "dvmask2[" << i << "] = 0x" << hex << std::setw(8) << std::setfill('0') << dvmask_test[i] << dec << endl
-							;
-						return 1;
-					}
-				}
+	cout << "Measuring ubc_check" << simd_name_str << "() per working set (L1d " << (cs.l1d >> 10) << " KiB, L2 " << (cs.l2 >> 10) << " KiB, LLC " << (cs.llc >> 10) << " KiB):" << endl;
+	cout << "set\tbytes\tcalls\thugepages\t" << cycle_counter_unit() << "/block\tratio to " << sets.front().name << endl;
+	double hot = 0;
+	for (size_t s = 0; s < sets.size(); ++s)
+	{
+		size_t count = sets[s].bytes / (80 * sizeof(SIMD_WORD));
+		if (count == 0)
+			count = 1;
+		aligned_arena<SIMD_WORD> vec_Ws(count * 80, use_hugepages);
+		for (size_t k = 0; k < count; ++k)
+			gen_W(rng, &vec_Ws[k * 80]);
+
+		vector<double> samples;
+		for (unsigned r = 0; r < reps; ++r)
+		{
+			uint64_t start = cycle_counter();
+			for (size_t i = 0, k = 0; i < calls; ++i)
+			{
+				ubc_check_simd(&vec_Ws[k * 80], dvmask);
+				for (size_t j = 0; j < SIMD_VECSIZE; j++)
+					((uint32_t*)&x)[j] += ((uint32_t*)&dvmask[0])[j];
+				if (++k == count)
+					k = 0;
 			}
+			uint64_t end = cycle_counter();
+			samples.push_back(double(end - start) / double(calls * SIMD_VECSIZE));
 		}
-		cout << "Found no discrepancies between ubc_check" << simd_name_str << "() and ubc_check_verify()." << endl << endl;
+		results.record("cache/ubc_check" + string(simd_name_str) + "/" + sets[s].name, "per_block", cycle_counter_unit(), false, samples);
+		std::sort(samples.begin(), samples.end());
+		double perblock = samples[reps / 2];
+		if (s == 0)
+			hot = perblock;
+		cout << sets[s].name << "\t" << count * 80 * sizeof(SIMD_WORD) << "\t" << calls << "\t" << (vec_Ws.hugepages() ? "yes" : "no") << "\t" << perblock << "\t" << perblock / hot << endl;
 	}
+	cout << "[ " << hex;
+	for (size_t j = 0; j < SIMD_VECSIZE; j++)
+		cout << ((uint32_t*)&x)[j] << " ";
+	cout << "]" << dec << endl;
+}
 
-	if (run_perf_tests)
+template<typename SIMD_WORD, void(*ubc_check_simd)(const SIMD_WORD*, SIMD_WORD*)>
+inline
+int test_ubc_check_simd(const char* simd_name_str)
+{
+	uint64_t seed = check_seed;
+	if (!check_seed_set)
 	{
-		cout << "Measuring performance of ubc_check" << simd_name_str << "() " << VECTOR_COUNT << " iterations :" << endl;
+		boost::random::random_device seeder;
+		seed = (uint64_t(seeder()) << 32) | seeder();
+	}
+	fast_rng rng(seed);
 
-		vector< boost::array<SIMD_WORD, 80> > vec_Ws(VECTOR_COUNT);
-		typename vector< boost::array<SIMD_WORD, 80> >::iterator it;
-		for (it = vec_Ws.begin(); it != vec_Ws.end(); ++it)
-			gen_W(rng, &((*it)[0]));
+	const size_t SIMD_VECSIZE = sizeof(SIMD_WORD) / sizeof(uint32_t);
 
-		boost::timer timer;
-		SIMD_WORD x;
-		int count = 1;
-		double sec = 0, perf = 0;
+	SIMD_WORD dvmask[DVMASKSIZE];
+	union {
+		SIMD_WORD v;
+		uint32_t w[SIMD_VECSIZE];
+	} tmp;
 
+	if (run_correctness_checks)
+	{
+		const uint64_t calls = uint64_t(1) << 24;
+		unsigned threads = std::max(1u, check_threads);
+		ubc_verify_batch batchref;
+		bool batched = init_batch_reference(batchref, rng);
+
+		cout << "Verifying ubc_check" << simd_name_str << "() against " << (batched ? "the batched reference of ubc_check_verify()" : "ubc_check_verify()")
+			<< " on " << threads << " threads (seed " << seed << "):" << endl;
+		std::atomic<uint64_t> done(0);
+		std::atomic<bool> failed(false);
+		check_failure failure;
+		vector<std::thread> workers;
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		// one seed, stream 0 is the main thread's, thread t checks its share on stream t + 1
+		for (unsigned t = 0; t < threads; ++t)
+			workers.push_back(std::thread(check_ubc_check_simd_worker<SIMD_WORD, ubc_check_simd>, seed, t + 1,
+				calls / threads + (t < calls % threads ? 1 : 0), batched ? &batchref : (const ubc_verify_batch*)0, &done, &failed, &failure));
+		boost::progress_display pd((unsigned long)(calls));
+		for (uint64_t shown = 0; shown < calls && !failed.load(); )
+		{
+			std::this_thread::sleep_for(chrono::milliseconds(100));
+			uint64_t now = done.load();
+			pd += (unsigned long)(now - shown);
+			shown = now;
+		}
+		for (size_t t = 0; t < workers.size(); ++t)
+			workers[t].join();
+		double sec = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+		if (failure.found)
+		{
+			cerr << "Found error (seed " << seed << ", stream " << failure.stream << ", call " << failure.call << ", lane " << failure.lane << "):" << endl
+				<< "dvmask [" << failure.maski << "] = 0x" << hex << std::setw(8) << std::setfill('0') << failure.dvmask << dec << endl
+				<< "dvmask2[" << failure.maski << "] = 0x" << hex << std::setw(8) << std::setfill('0') << failure.dvmask2 << dec << endl
+				;
+			if (failure.dvmask == failure.dvmask2)
+				cerr << "(the batched reference disagrees with ubc_check_verify())" << endl;
+			return 1;
+		}
+		cout << "Found no discrepancies between ubc_check" << simd_name_str << "() and ubc_check_verify() in " << sec << "s." << endl << endl;
+		results.record("check/ubc_check" + string(simd_name_str), "rate", "calls/s", true, double(calls) / sec);
+	}
+
+	if (run_perf_tests)
+	{
+		// the arena streams from memory like the original 2^20 inputs did, capped for wide vectors
+		const size_t count = std::max<size_t>(1, std::min<size_t>(VECTOR_COUNT, (size_t(1) << 28) / (80 * sizeof(SIMD_WORD))));
+		aligned_arena<SIMD_WORD> vec_Ws(count * 80, use_hugepages);
+		for (size_t k = 0; k < count; ++k)
+			gen_W(rng, &vec_Ws[k * 80]);
+
+		cout << "Measuring performance of ubc_check" << simd_name_str << "() on " << count << " inputs (budget " << perf_budget
+			<< "s, until the 95% confidence interval is within " << perf_ci << "% of the mean):" << endl;
+
+		perf_counters counters;
+		perf_counter_values counter_values;
+		if (run_perf_counters && !counters.available())
+			cout << "Hardware performance counters are not available." << endl;
+		SIMD_WORD x;
 		for (size_t j = 0; j < SIMD_VECSIZE; j++)
 			((uint32_t*)&x)[j] = 0;
 
-		cout << "(";
-		while (true)
+		// one trial is 'calls' calls cycling through the arena, returns its cycles and (through 'sec') seconds
+		auto trial = [&](uint64_t calls, double& sec) -> uint64_t
 		{
-			timer.restart();
-
-			for (int ll = 0; ll < count; ++ll)
+			chrono::steady_clock::time_point start_time = chrono::steady_clock::now();
+			uint64_t start = cycle_counter();
+			for (uint64_t i = 0, k = 0; i < calls; ++i)
 			{
-				for (it = vec_Ws.begin(); it != vec_Ws.end(); ++it)
+				ubc_check_simd(&vec_Ws[k * 80], dvmask);
+				for (unsigned d = 0; d < DVMASKSIZE; ++d)
 				{
-					ubc_check_simd(&((*it)[0]), dvmask);
-					for (unsigned i = 0; i < DVMASKSIZE; ++i)
-					{
-						uint32_t* px = (uint32_t*)&x;
-						for (size_t j = 0; j < SIMD_VECSIZE; j++)
-							px[j] = px[j] + ((uint32_t*)&dvmask[i])[j];
-					}
+					uint32_t* px = (uint32_t*)&x;
+					for (size_t j = 0; j < SIMD_VECSIZE; j++)
+						px[j] = px[j] + ((uint32_t*)&dvmask[d])[j];
 				}
+				if (++k == count)
+					k = 0;
 			}
-
-			sec = timer.elapsed();
-			perf = double(vec_Ws.size())*double(count) / sec;
-			cout << " " << sec << flush;
-			if (sec >= 10)
+			uint64_t end = cycle_counter();
+			sec = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+			return end - start;
+		};
+
+		// calibrate the calls per trial to the minimum trial time, the first trials also warm up
+		uint64_t calls = 256;
+		double sec = 0;
+		for (trial(calls, sec); sec < PERF_TRIAL_SECONDS && calls < (uint64_t(1) << 40); calls *= 2)
+			trial(2 * calls, sec);
+
+		vector<double> cycles, rates;
+		double mean = 0, ci = 0;
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		if (run_perf_counters)
+			counters.start();
+		while (true)
+		{
+			uint64_t c = trial(calls, sec);
+			cycles.push_back(double(c) / double(calls * SIMD_VECSIZE));
+			rates.push_back(double(calls * SIMD_VECSIZE) / sec);
+			if (cycles.size() >= 2)
+				ci = relative_ci95(cycles, mean);
+			if (cycles.size() >= PERF_MIN_TRIALS && ci * 100 <= perf_ci)
+				break;
+			if (cycles.size() >= PERF_MIN_TRIALS && chrono::duration<double>(chrono::steady_clock::now() - start).count() >= perf_budget)
 				break;
-
-			count *= 2;
 		}
-
-		cout << " ) [ " << hex;
+		if (run_perf_counters)
+			counter_values = counters.stop();
+
+		vector<double> sorted = cycles;
+		std::sort(sorted.begin(), sorted.end());
+		vector<double> sorted_rates = rates;
+		std::sort(sorted_rates.begin(), sorted_rates.end());
+		cout << cycles.size() << " trials of " << calls << " calls" << (ci * 100 <= perf_ci ? "" : " (budget exhausted before the target precision)") << ":" << endl;
+		cout << cycle_counter_unit() << "/block: mean " << mean << " +- " << ci * mean << " (" << ci * 100 << "%), median " << sorted[sorted.size() / 2]
+			<< ", min " << sorted.front() << endl;
+		cout << "Performance: " << sorted_rates[sorted_rates.size() / 2] << " blocks/s (" << SIMD_VECSIZE << " blocks per call) [ " << hex;
 		for (size_t j = 0; j < SIMD_VECSIZE; j++)
 		{
 			tmp.w[j] = ((uint32_t*)&x)[j];
 			cout << tmp.w[j] << " ";
 		}
-
 		cout << "]" << dec << endl;
+		results.record("ubc_check" + string(simd_name_str), "per_block", cycle_counter_unit(), false, cycles);
+		results.record("ubc_check" + string(simd_name_str), "rate", "blocks/s", true, rates);
 
-		cout << "Performance: " << SIMD_VECSIZE << " x 2^" << log(perf) / log(2.0) << " #/s" << endl;
+		if (run_perf_counters && counters.available())
+		{
+			double allcalls = double(calls) * double(cycles.size());
+			cout << "Counters ";
+			counter_values.print(cout, allcalls, "ubc_check" + string(simd_name_str) + " call");
+			cout << endl << "Counters ";
+			counter_values.print(cout, allcalls * double(SIMD_VECSIZE), "message block");
+			cout << endl;
+		}
 	}
 
+	if (run_cache_tests)
+		test_ubc_check_simd_cache<fast_rng, SIMD_WORD, ubc_check_simd>(rng, simd_name_str);
+
 	return 0;
 }
@@ -9,7 +9,7 @@
 #include <arm_neon.h>
 #endif
 
-#if defined(HAVE_MMX) || defined(HAVE_SSE) || defined(HAVE_AVX)
+#if defined(HAVE_MMX) || defined(HAVE_SSE) || defined(HAVE_AVX) || defined(HAVE_AVX512)
 #include <immintrin.h>
 #endif
 
@@ -26,6 +26,9 @@ extern "C"
 #ifdef INCLUDE_AVX256_TEST
 	void ubc_check_avx256(const __m256i* W, __m256i* dvmask);
 #endif
+#ifdef INCLUDE_AVX512_TEST
+	void ubc_check_avx512(const __m512i* W, __m512i* dvmask);
+#endif
 #ifdef INCLUDE_NEON128_TEST
 	void ubc_check_neon128(const int32x4_t* W, int32x4_t* dvmask);
 #endif
@@ -48,6 +51,17 @@ int test_ubc_check_sse128();
 int test_ubc_check_avx256();
 #endif
 
+#ifdef INCLUDE_AVX512_TEST
+int test_ubc_check_avx512();
+#endif
+
+#ifdef INCLUDE_VEC_TEST
+int test_ubc_check_vec4();
+int test_ubc_check_vec8();
+int test_ubc_check_vec16();
+int test_ubc_check_vec32();
+#endif
+
 #ifdef INCLUDE_NEON128_TEST
 int test_ubc_check_neon128();
 #endif
@@ -0,0 +1,55 @@
+/***
+* Copyright 2017 Marc Stevens <marc@marc-stevens.nl>, Dan Shumow <danshu@microsoft.com>
+* Distributed under the MIT Software License.
+* See accompanying file LICENSE.txt or copy at
+* https://opensource.org/licenses/MIT
+***/
+
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/random/random_device.hpp>
+#include <boost/random.hpp>
+#include <boost/progress.hpp>
+#include <boost/timer.hpp>
+#include <boost/array.hpp>
+
+#include "ubc_check_test.h"
+#include "test_simd.h"
+
+#include "test_simd.cpp"
+
+#ifdef INCLUDE_VEC_TEST
+// the SIMD_WORD of each lane count, the kernels are defined in _ubc_check_simd_vec.cpp
+#define UBC_CHECK_VEC_TEST(lanes) \
+	namespace simd_vec##lanes { \
+		void ubc_check_vec##lanes(const SIMD_WORD* W, SIMD_WORD* dvmask); \
+	} \
+	int test_ubc_check_vec##lanes() \
+	{ \
+		return test_ubc_check_simd<SIMD_WORD, simd_vec##lanes::ubc_check_vec##lanes>("_vec" #lanes); \
+	}
+
+#define SIMD_VEC_LANES 4
+#include "../common/simd_vec.h"
+UBC_CHECK_VEC_TEST(4)
+#undef SIMD_VEC_LANES
+
+#define SIMD_VEC_LANES 8
+#include "../common/simd_vec.h"
+UBC_CHECK_VEC_TEST(8)
+#undef SIMD_VEC_LANES
+
+#define SIMD_VEC_LANES 16
+#include "../common/simd_vec.h"
+UBC_CHECK_VEC_TEST(16)
+#undef SIMD_VEC_LANES
+
+#define SIMD_VEC_LANES 32
+#include "../common/simd_vec.h"
+UBC_CHECK_VEC_TEST(32)
+#undef SIMD_VEC_LANES
+#endif
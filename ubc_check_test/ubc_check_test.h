@@ -20,8 +20,15 @@
 #ifdef HAVE_AVX
 #define INCLUDE_AVX256_TEST
 #endif
+#ifdef HAVE_AVX512
+#define INCLUDE_AVX512_TEST
+#endif
 #ifdef HAVE_NEON
 #define INCLUDE_NEON128_TEST
+#endif
+// the GCC/Clang vector extension kernels, see ../common/simd_vec.h
+#ifdef UBC_CHECK_VEC
+#define INCLUDE_VEC_TEST
 #endif 
 
 #endif // UBC_CHECK_TEST_HPP
\ No newline at end of file